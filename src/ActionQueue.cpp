@@ -20,73 +20,411 @@
  *
  */
 
+#include "p8-platform/util/util.h"
 #include "ActionQueue.hpp"
+#include <algorithm>
 
 namespace ActionQueue {
     
+    static const size_t c_MinWorkers = 4;
+    // Actions may block on network, so pool grows when all workers are busy
+    static const size_t c_MaxWorkers = 32;
+    static const uint32_t c_IdleTimeout = 1000;
+    // Initial capacity of queue rings, grows on demand
+    static const size_t c_WorkerQueueCapacity = 256;
+    static const size_t c_ActionQueueCapacity = 64;
+    // Destructor waits for current action this many times
+    static const int c_StopAttempts = 3;
+    static const int c_StopTimeout = 5000;
+    // Check interval of awaited event while pool worker helps with pending actions
+    static const uint32_t c_HelpWaitStep = 10;
     
+    // Worker index of current thread, -1 outside the pool
+    static thread_local int t_workerIndex = -1;
     
-    static const int32_t INFINITE_QUEUE_TIMEOUT = 0x7FFFFFFF;
+#pragma mark - Serial lane
     
-    void* CActionQueue::Process()
+    // State of action queue. Scheduled pool tasks share it with the queue,
+    // so a turn still in flight never refers to destroyed queue.
+    class CSerialLane : public std::enable_shared_from_this<CSerialLane>
     {
-        // NOTE: Keep commented out! Debug code
-//        if(!_name.empty()){
-//            if (pthread_setname_np( _name.c_str()) != 0)
-//                Globals::LogError("pthread_setname_np failed!");
-//            _name.clear();
-//        }
-
-        while (!IsStopped())
+    public:
+        CSerialLane(size_t maxSize, const char* name, ActionPriority priority)
+        : _maxSize(maxSize)
+        , _actions(std::min(maxSize, c_ActionQueueCapacity))
+        , _isRunning(false)
+        , _isScheduled(false)
+        , _priority(priority)
+        , _name(name ? name : "")
+        {}
+        
+        void Start() {
+            P8PLATFORM::CLockObject lock(_mutex);
+            _isRunning = true;
+        }
+        bool IsRunning() const {return _isRunning;}
+        void Push(QueueItem&& item, bool toFront);
+        void PerformNext();
+        void CancelPending();
+        // Cancels pending actions of the turn removed from the pool
+        void CancelTurn();
+        bool Stop(int iWaitMs);
+        const std::string& Name() const {return _name;}
+        
+    private:
+        const size_t _maxSize;
+        CRingBuffer<QueueItem> _actions;
+        bool _isRunning;
+        bool _isScheduled;
+        const ActionPriority _priority;
+        P8PLATFORM::CMutex _mutex;
+        std::string _name;
+    };
+    
+    void CSerialLane::Push(QueueItem&& item, bool toFront)
+    {
+        bool isAccepted = false;
+        bool shouldSchedule = false;
         {
-            IActionQueueItem* action = NULL;
-            // Do not wait infinite when pipeline is stopped.
-            // Could be no new task will arrive, e.g. on StopThead()
-            if( _actions.Pop(action, (_willStop) ? 1000 : INFINITE_QUEUE_TIMEOUT))
-            {
-                if(NULL == action)
-                    continue;
-                if(_willStop)
-                    action->Cancel();
+            P8PLATFORM::CLockObject lock(_mutex);
+            if(_isRunning && _actions.Size() < _maxSize) {
+                if(toFront)
+                    _actions.PushFront(std::move(item));
                 else
-                    action->Perform();
-                delete action;
+                    _actions.PushBack(std::move(item));
+                shouldSchedule = !_isScheduled;
+                _isScheduled = true;
+                isAccepted = true;
+            } else if(_isRunning) {
+                Globals::LogError("CActionQueue %s: too many pending actions.", _name.c_str());
             }
-            // Check for priority task
-            if(_priorityAction) {
-                P8PLATFORM::CLockObject lock(_priorityActionMutex);
-                if(_priorityAction) {
-                    _priorityAction->Perform();
-                    delete _priorityAction;
-                    _priorityAction = nullptr;
-
-                }
+        }
+        if(!isAccepted) {
+            item.Cancel();
+            return;
+        }
+        if(shouldSchedule)
+            CThreadPool::Shared().Schedule(CThreadPool::PoolTask(shared_from_this()), _priority);
+    }
+    
+    void CSerialLane::PerformNext()
+    {
+        QueueItem action;
+        {
+            P8PLATFORM::CLockObject lock(_mutex);
+            if(_actions.IsEmpty()) {
+                _isScheduled = false;
+                return;
             }
-            
+            action = _actions.PopFront();
+        }
+        action.Perform();
+        
+        bool hasMore = false;
+        {
+            P8PLATFORM::CLockObject lock(_mutex);
+            hasMore = !_actions.IsEmpty();
+            _isScheduled = hasMore;
         }
-        return NULL;
+        // Next action may be performed by another worker
+        if(hasMore)
+            CThreadPool::Shared().Schedule(CThreadPool::PoolTask(shared_from_this()), _priority);
     }
     
-    void CActionQueue::TerminatePipeline()
+    void CSerialLane::CancelPending()
     {
-        // In case of no active tasks unlocks .Pop() waiting
-        _willStop = false;
-        PerformAsync([this] {
-            _willStop = true;
-        }, [](const ActionResult& s) {});
-        _willStop = true;
+        CRingBuffer<QueueItem> actions;
+        {
+            P8PLATFORM::CLockObject lock(_mutex);
+            actions.Swap(_actions);
+        }
+        while(!actions.IsEmpty())
+            actions.PopFront().Cancel();
+        // Keep preallocated storage
+        P8PLATFORM::CLockObject lock(_mutex);
+        if(_actions.IsEmpty())
+            _actions.Swap(actions);
+    }
+    
+    void CSerialLane::CancelTurn()
+    {
+        CancelPending();
+        P8PLATFORM::CLockObject lock(_mutex);
+        _isScheduled = false;
+    }
+    
+    bool CSerialLane::Stop(int iWaitMs)
+    {
+        {
+            P8PLATFORM::CLockObject lock(_mutex);
+            _isRunning = false;
+        }
+        CancelPending();
+        // Wait for current action
+        static const int c_WaitStep = 10;
+        for(int waited = 0; iWaitMs < 0 || waited < iWaitMs; waited += c_WaitStep) {
+            {
+                P8PLATFORM::CLockObject lock(_mutex);
+                if(!_isScheduled)
+                    return true;
+            }
+            P8PLATFORM::CEvent::Sleep(c_WaitStep);
+        }
+        return false;
+    }
+    
+#pragma mark - Thread pool
+    
+    class CThreadPool::CWorker : public P8PLATFORM::CThread
+    {
+    public:
+        CWorker(CThreadPool& pool, size_t index)
+        : actions(c_WorkerQueueCapacity)
+        , _pool(pool)
+        , _index(index)
+        {}
         
+        // Owner takes actions from the front, thieves from the back
+        CRingBuffer<PoolTask> actions;
+        P8PLATFORM::CMutex mutex;
+        
+    private:
+        virtual void *Process(void)
+        {
+            t_workerIndex = (int)_index;
+            while (!IsStopped())
+            {
+                PoolTask task;
+                if(!_pool.Pop(_index, task)) {
+                    _pool.WaitForWork();
+                    continue;
+                }
+                {
+                    P8PLATFORM::CLockObject lock(_pool._mutex);
+                    ++_pool._busyWorkers;
+                    _pool.GrowIfBusy();
+                }
+                PerformTask(task);
+                {
+                    P8PLATFORM::CLockObject lock(_pool._mutex);
+                    --_pool._busyWorkers;
+                }
+            }
+            return NULL;
+        }
+        
+        CThreadPool& _pool;
+        const size_t _index;
+    };
+    
+    CThreadPool& CThreadPool::Shared()
+    {
+        static CThreadPool pool(c_MinWorkers, c_MaxWorkers);
+        return pool;
+    }
+    
+    CThreadPool::CThreadPool(size_t minWorkers, size_t maxWorkers)
+    : _workers(maxWorkers, nullptr)
+    , _workersCount(0)
+    , _nextWorker(0)
+    , _pendingActions(0)
+    , _hiPriorityActions(c_WorkerQueueCapacity)
+    , _busyWorkers(0)
+    , _isStopping(false)
+    {
+        P8PLATFORM::CLockObject lock(_mutex);
+        while(_workersCount < minWorkers)
+            AddWorker();
+    }
+    
+    void CThreadPool::AddWorker()
+    {
+        // Under _mutex lock. Workers vector is preallocated,
+        // so other workers may read it without lock.
+        const size_t index = _workersCount;
+        _workers[index] = new CWorker(*this, index);
+        _workersCount = index + 1;
+        _workers[index]->CreateThread();
     }
     
-    bool CActionQueue::StopThread(int iWaitMs)
+    void CThreadPool::GrowIfBusy()
     {
-        TerminatePipeline();
-        return this->CThread::StopThread(iWaitMs);
+        if(_busyWorkers == _workersCount && _pendingActions > 0 && _workersCount < c_MaxWorkers)
+            AddWorker();
+    }
+    
+    void CThreadPool::PerformAsync(TAction action, TCompletion completion, ActionPriority priority)
+    {
+        Schedule(PoolTask(QueueItem(std::move(action), std::move(completion))), priority);
+    }
+    
+    void CThreadPool::Wait(P8PLATFORM::CEvent& event)
+    {
+        if(t_workerIndex < 0) {
+            event.Wait();
+            return;
+        }
+        // Worker is counted as busy already
+        while(!event.Wait(c_HelpWaitStep)) {
+            PoolTask task;
+            if(Pop(t_workerIndex, task))
+                PerformTask(task);
+        }
+    }
+    
+    void CThreadPool::Schedule(PoolTask&& task, ActionPriority priority)
+    {
+        {
+            P8PLATFORM::CLockObject lock(_mutex);
+            if(_isStopping) {
+                CancelTask(task);
+                return;
+            }
+            ++_pendingActions;
+            GrowIfBusy();
+            if(kPriorityHi == priority) {
+                _hiPriorityActions.PushBack(std::move(task));
+                _hasWork.Signal();
+                return;
+            }
+        }
+        CWorker* worker = _workers[_nextWorker++ % _workersCount];
+        {
+            P8PLATFORM::CLockObject lock(worker->mutex);
+            worker->actions.PushBack(std::move(task));
+        }
+        _hasWork.Signal();
+    }
+    
+    bool CThreadPool::Pop(size_t workerIndex, PoolTask& task)
+    {
+        bool hasAction = false;
+        bool hasMore = false;
+        {
+            P8PLATFORM::CLockObject lock(_mutex);
+            if(!_hiPriorityActions.IsEmpty()) {
+                task = _hiPriorityActions.PopFront();
+                hasAction = true;
+                hasMore = !_hiPriorityActions.IsEmpty();
+            }
+        }
+        // Own actions first, then steal from other workers
+        const size_t workersCount = _workersCount;
+        for(size_t i = 0; !hasAction && i < workersCount; ++i) {
+            CWorker* worker = _workers[(workerIndex + i) % workersCount];
+            P8PLATFORM::CLockObject lock(worker->mutex);
+            if(worker->actions.IsEmpty())
+                continue;
+            task = (0 == i) ? worker->actions.PopFront() : worker->actions.PopBack();
+            hasAction = true;
+            hasMore = !worker->actions.IsEmpty();
+        }
+        if(hasAction)
+            --_pendingActions;
+        // Signals are not counted. Wake up next idle worker for the rest.
+        if(hasMore)
+            _hasWork.Signal();
+        return hasAction;
+    }
+    
+    void CThreadPool::PerformTask(PoolTask& task)
+    {
+        if(task.queue)
+            task.queue->PerformNext();
+        else
+            task.item.Perform();
+    }
+    
+    void CThreadPool::CancelTask(PoolTask& task)
+    {
+        if(task.queue) {
+            task.queue->CancelTurn();
+        } else {
+            task.item.Cancel();
+        }
+    }
+    
+    bool CThreadPool::WaitForWork()
+    {
+        return _hasWork.Wait(c_IdleTimeout);
+    }
+    
+    CThreadPool::~CThreadPool()
+    {
+        {
+            P8PLATFORM::CLockObject lock(_mutex);
+            _isStopping = true;
+        }
+        const size_t workersCount = _workersCount;
+        for(size_t i = 0; i < workersCount; ++i)
+            _workers[i]->StopThread(-1);
+        _hasWork.Broadcast();
+        for(size_t i = 0; i < workersCount; ++i) {
+            _workers[i]->StopThread();
+            while(!_workers[i]->actions.IsEmpty()) {
+                PoolTask task(_workers[i]->actions.PopFront());
+                CancelTask(task);
+            }
+            SAFE_DELETE(_workers[i]);
+        }
+        while(!_hiPriorityActions.IsEmpty()) {
+            PoolTask task(_hiPriorityActions.PopFront());
+            CancelTask(task);
+        }
+    }
+    
+#pragma mark - Action queue
+    
+    CActionQueue::CActionQueue(size_t maxSize, const char* name, ActionPriority priority)
+    : _lane(std::make_shared<CSerialLane>(maxSize, name, priority))
+    {}
+    
+    void CActionQueue::Start()
+    {
+        _lane->Start();
+    }
+    
+    bool CActionQueue::IsRunning() const
+    {
+        return _lane->IsRunning();
+    }
+    
+    void CActionQueue::PerformHiPriority(TAction action, TCompletion completion)
+    {
+        P8PLATFORM::CEvent done;
+        _lane->Push(QueueItem(std::move(action), std::move(completion), &done), true);
+        CThreadPool::Shared().Wait(done);
+    }
+    
+    void CActionQueue::PerformAsync(TAction action, TCompletion completion)
+    {
+        _lane->Push(QueueItem(std::move(action), std::move(completion)), false);
+    }
+    
+    void CActionQueue::CancellAllBefore(TAction action, TCompletion completion)
+    {
+        _lane->CancelPending();
+        PerformAsync(std::move(action), std::move(completion));
+    }
+    
+    bool CActionQueue::Stop(int iWaitMs)
+    {
+        return _lane->Stop(iWaitMs);
     }
     
     CActionQueue::~CActionQueue(void)
     {
-        StopThread(0);
+        int stopCounter = 1;
+        bool isStopped = false;
+        while(!(isStopped = Stop(c_StopTimeout))) {
+            if(stopCounter++ >= c_StopAttempts)
+                break;
+            Globals::LogNotice("CActionQueue %s: can't stop in %d ms", _lane->Name().c_str(), c_StopTimeout);
+        }
+        // Scheduled turn owns the lane, so it finishes safely without the queue
+        if(!isStopped)
+            Globals::LogError("CActionQueue %s: current action is still running after %d ms. Queue is destroyed without it.",
+                              _lane->Name().c_str(), c_StopAttempts * c_StopTimeout);
     }
     
 }
@@ -24,7 +24,6 @@
 #define Action_Queue_hpp
 
 
-#include "p8-platform/util/buffer.h"
 #include "p8-platform/threads/threads.h"
 #include "p8-platform/threads/mutex.h"
 #include "ActionQueueTypes.hpp"
@@ -32,6 +31,9 @@
 #include <exception>
 #include <stdexcept>
 #include <string>
+#include <vector>
+#include <utility>
+#include <memory>
 
 
 namespace ActionQueue
@@ -46,111 +48,175 @@ namespace ActionQueue
         std::string r;
     };
 
-    class CActionQueue : public P8PLATFORM::CThread
+    // Growable ring buffer. Slots are reused, so push and pop
+    // do not allocate until the capacity is exceeded.
+    template <typename T>
+    class CRingBuffer
     {
+    public:
+        CRingBuffer(size_t capacity = 0) : _items(capacity), _head(0), _size(0) {}
+        
+        bool IsEmpty() const {return 0 == _size;}
+        size_t Size() const {return _size;}
+        void PushBack(T&& item) {
+            Grow();
+            _items[Index(_size)] = std::move(item);
+            ++_size;
+        }
+        void PushFront(T&& item) {
+            Grow();
+            _head = (_head + _items.size() - 1) % _items.size();
+            _items[_head] = std::move(item);
+            ++_size;
+        }
+        // Popped slot is reset to release resources captured by the item
+        T PopFront() {
+            T item(std::move(_items[_head]));
+            _items[_head] = T();
+            _head = Index(1);
+            --_size;
+            return item;
+        }
+        T PopBack() {
+            const size_t index = Index(_size - 1);
+            T item(std::move(_items[index]));
+            _items[index] = T();
+            --_size;
+            return item;
+        }
+        void Swap(CRingBuffer& other) {
+            _items.swap(other._items);
+            std::swap(_head, other._head);
+            std::swap(_size, other._size);
+        }
+        
     private:
-//        template<typename TAction>
-        class QueueItem : public IActionQueueItem
-        {
-        public:
-            QueueItem(TAction action, TCompletion completion)
-            : _action(action)
-            , _completion(completion)
-            {}
-            virtual void Perform() {
-                try {
-                    _action();
-                    _completion(ActionResult(kActionCompleted));
-                } catch (...) {
-                    Failed(std::current_exception());
-                }
-            }
-            virtual void Cancel() {_completion(ActionResult(kActionCancelled));}
-            
-        private:
-            const TAction _action;
-            const TCompletion _completion;
-            void Failed(std::exception_ptr e) {_completion(ActionResult(kActionFailed, e));}
-        };
+        size_t Index(size_t i) const {return (_head + i) % _items.size();}
+        void Grow() {
+            if(_size < _items.size())
+                return;
+            std::vector<T> items(_items.empty() ? 16 : _items.size() * 2);
+            for(size_t i = 0; i < _size; ++i)
+                items[i] = std::move(_items[Index(i)]);
+            _items.swap(items);
+            _head = 0;
+        }
+        
+        std::vector<T> _items;
+        size_t _head;
+        size_t _size;
+    };
+    
+    // Action stored by value in queues. Callables are moved, never copied.
+    class QueueItem : public IActionQueueItem
+    {
     public:
-        CActionQueue(size_t maxSize, const char* name = nullptr)
-        : _actions(maxSize)
-        , _willStop(false)
-        , _priorityAction(nullptr)
-        , _name(name)
+        QueueItem() : _done(nullptr) {}
+        QueueItem(TAction&& action, TCompletion&& completion, P8PLATFORM::CEvent* done = nullptr)
+        : _action(std::move(action))
+        , _completion(std::move(completion))
+        , _done(done)
         {}
-
-        void PerformHiPriority(TAction action, TCompletion completion)
-        {
-            using namespace P8PLATFORM;
-            
-            CEvent done;
-            TAction doneAction = [action, &done ](){
-                try{
-                    action();
-                    done.Signal();
-                } catch  (...){
-                    Globals::LogError("CActionQueue: execption during process HI-priority request!");
-                    done.Signal();
-                    throw;
-                }
-            };
-            auto item = new QueueItem(doneAction, completion);
-            if(_willStop){
-                item->Cancel();
-                done.Signal();
-                delete item;
-                item = nullptr;
-            } else {
-                if(_priorityAction != nullptr) // Can't be
-                    throw ActionQueueException("Too many priority tasks.");
-                {
-                    CLockObject lock(_priorityActionMutex);
-                    _priorityAction = item;
-                }
-                // In case when pipline has no tasks
-                // push dummy wakeup task
-                _actions.Push(new QueueItem([]{}, [](const ActionResult&){}));
-            }
-            done.Wait();
-        }
-
-//        template<typename TAction>
-        void PerformAsync(TAction action, TCompletion completion)
-        {
-            auto item = new QueueItem(action, completion);
-            if(!_willStop)
-                _actions.Push(item);
-            else{
-                item->Cancel();
-                delete item;
+        QueueItem(QueueItem&& other) = default;
+        QueueItem& operator=(QueueItem&& other) = default;
+        
+        virtual void Perform() {
+            try {
+                _action();
+                _completion(ActionResult(kActionCompleted));
+            } catch (...) {
+                Failed(std::current_exception());
             }
+            Done();
         }
-//        template<typename TAction>
-        void CancellAllBefore(TAction action, TCompletion completion)
-        {
-            // Set _willStop
-            TerminatePipeline();
-            // Reset _willStop when queue becomes empty
-            PerformAsync([]{}, [this, action, completion](const ActionResult& s) {
-                _willStop = false;
-                PerformAsync(action, completion);
-            });
+        virtual void Cancel() {
+            _completion(ActionResult(kActionCancelled));
+            Done();
         }
-        virtual bool StopThread(int iWaitMs = 5000);
-        virtual ~CActionQueue(void);
         
     private:
-        virtual void *Process(void);
-        void TerminatePipeline();
+        TAction _action;
+        TCompletion _completion;
+        // Signaled when the item is performed or cancelled
+        P8PLATFORM::CEvent* _done;
+        void Failed(std::exception_ptr e) {_completion(ActionResult(kActionFailed, e));}
+        void Done() {if(_done) _done->Signal();}
+    };
+    
+    class CSerialLane;
+    
+    // Work-stealing pool of worker threads shared by all action queues.
+    // Grows when all workers are busy (actions may block on network).
+    class CThreadPool
+    {
+    public:
+        static CThreadPool& Shared();
+        
+        // Performs action on any worker, no ordering guaranties.
+        void PerformAsync(TAction action, TCompletion completion,
+                          ActionPriority priority = kPriorityLow);
+        // Waits for the event. Pool worker performs pending actions meanwhile,
+        // so nested waits can't exhaust the pool.
+        void Wait(P8PLATFORM::CEvent& event);
+        ~CThreadPool();
+        
+    private:
+        friend class CSerialLane;
+        class CWorker;
+        // Either single action or turn of serial queue
+        struct PoolTask
+        {
+            PoolTask(std::shared_ptr<CSerialLane> q = nullptr) : queue(std::move(q)) {}
+            PoolTask(QueueItem&& i) : item(std::move(i)) {}
+            std::shared_ptr<CSerialLane> queue;
+            QueueItem item;
+        };
+        
+        CThreadPool(size_t minWorkers, size_t maxWorkers);
+        void Schedule(PoolTask&& task, ActionPriority priority);
+        bool Pop(size_t workerIndex, PoolTask& task);
+        static void PerformTask(PoolTask& task);
+        static void CancelTask(PoolTask& task);
+        bool WaitForWork();
+        // Should be called under _mutex lock
+        void AddWorker();
+        // Adds worker when all workers are busy and actions are pending
+        void GrowIfBusy();
+        
+        std::vector<CWorker*> _workers;
+        std::atomic<size_t> _workersCount;
+        std::atomic<size_t> _nextWorker;
+        std::atomic<size_t> _pendingActions;
+        CRingBuffer<PoolTask> _hiPriorityActions;
+        size_t _busyWorkers;
+        bool _isStopping;
+        P8PLATFORM::CMutex _mutex;
+        P8PLATFORM::CEvent _hasWork;
+    };
+    
+    // Named serial lane of the shared thread pool.
+    // Actions are performed one by one in FIFO order.
+    class CActionQueue
+    {
+    public:
+        CActionQueue(size_t maxSize, const char* name = nullptr, ActionPriority priority = kPriorityLow);
         
-        typedef P8PLATFORM::SyncedBuffer <IActionQueueItem*> TActionQueue;
-        TActionQueue _actions;
-        P8PLATFORM::CMutex _priorityActionMutex;
-        IActionQueueItem* _priorityAction;
-        bool _willStop;
-        std::string _name;
+        void Start();
+        bool IsRunning() const;
+
+        // Performs action before all pending ones and waits for completion.
+        void PerformHiPriority(TAction action, TCompletion completion);
+        void PerformAsync(TAction action, TCompletion completion);
+        // Cancels all pending actions, then performs the action
+        void CancellAllBefore(TAction action, TCompletion completion);
+        // Cancels pending actions and waits for current one
+        bool Stop(int iWaitMs = 5000);
+        // Queue may be destroyed before its current action is done.
+        // The lane stays alive until the action returns.
+        virtual ~CActionQueue(void);
         
+    private:
+        std::shared_ptr<CSerialLane> _lane;
     };
 }
 #endif /* Action_Queue_hpp */
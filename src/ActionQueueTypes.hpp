@@ -10,6 +10,13 @@
 #define ActionQueueTypes_h
 
 #include <functional>
+#include <memory>
+#include <atomic>
+#include <exception>
+#include <new>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
 
 namespace ActionQueue
 {
@@ -38,8 +45,134 @@ namespace ActionQueue
         : status(s), exception(e)
         {}
     };
-    typedef std::function<void(void)> TAction;
-    typedef std::function<void(const ActionResult&)> TCompletion;
+    
+    // Copyable callable wrapper like std::function with larger inline storage.
+    // Callables up to InlineSize bytes are kept inside the object, larger ones
+    // are allocated on the heap. Data owned by the callable itself
+    // (e.g. captured std::string) is allocated as usual.
+    template <typename TSignature, size_t InlineSize = 64>
+    class CInlineFunction;
+    
+    template <typename R, typename... Args, size_t InlineSize>
+    class CInlineFunction<R(Args...), InlineSize>
+    {
+    public:
+        CInlineFunction() : _ops(nullptr) {}
+        CInlineFunction(std::nullptr_t) : _ops(nullptr) {}
+        template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, CInlineFunction>::value>::type>
+        CInlineFunction(F&& f) : _ops(nullptr) {
+            typedef typename std::decay<F>::type Functor;
+            typedef typename std::conditional<IsInline<Functor>::value, InlineOps<Functor>, HeapOps<Functor> >::type Ops;
+            Ops::Create(&_storage, std::forward<F>(f));
+            _ops = Ops::Get();
+        }
+        CInlineFunction(const CInlineFunction& other) : _ops(nullptr) {
+            if(other._ops)
+                other._ops->copy(&_storage, &other._storage);
+            _ops = other._ops;
+        }
+        CInlineFunction(CInlineFunction&& other) : _ops(nullptr) {
+            MoveFrom(other);
+        }
+        CInlineFunction& operator=(const CInlineFunction& other) {
+            if(this != &other) {
+                CInlineFunction copy(other);
+                Reset();
+                MoveFrom(copy);
+            }
+            return *this;
+        }
+        CInlineFunction& operator=(CInlineFunction&& other) {
+            if(this != &other) {
+                Reset();
+                MoveFrom(other);
+            }
+            return *this;
+        }
+        CInlineFunction& operator=(std::nullptr_t) {
+            Reset();
+            return *this;
+        }
+        ~CInlineFunction() {Reset();}
+        
+        explicit operator bool() const {return nullptr != _ops;}
+        R operator()(Args... args) const {
+            if(nullptr == _ops)
+                throw std::bad_function_call();
+            return _ops->invoke(const_cast<Storage*>(&_storage), std::forward<Args>(args)...);
+        }
+        
+    private:
+        typedef typename std::aligned_storage<InlineSize, alignof(std::max_align_t)>::type Storage;
+        struct Ops
+        {
+            R (*invoke)(void* storage, Args&&... args);
+            void (*copy)(void* dst, const void* src);
+            // Leaves source storage destroyed
+            void (*move)(void* dst, void* src);
+            void (*destroy)(void* storage);
+        };
+        
+        template <typename F>
+        struct IsInline : std::integral_constant<bool,
+            sizeof(F) <= sizeof(Storage) && alignof(F) <= alignof(Storage) && std::is_nothrow_move_constructible<F>::value> {};
+        
+        template <typename F>
+        struct InlineOps
+        {
+            template <typename T>
+            static void Create(void* storage, T&& f) {new(storage) F(std::forward<T>(f));}
+            static R Invoke(void* storage, Args&&... args) {return (*static_cast<F*>(storage))(std::forward<Args>(args)...);}
+            static void Copy(void* dst, const void* src) {new(dst) F(*static_cast<const F*>(src));}
+            static void Move(void* dst, void* src) {
+                new(dst) F(std::move(*static_cast<F*>(src)));
+                static_cast<F*>(src)->~F();
+            }
+            static void Destroy(void* storage) {static_cast<F*>(storage)->~F();}
+            static const Ops* Get() {
+                static const Ops ops = {&Invoke, &Copy, &Move, &Destroy};
+                return &ops;
+            }
+        };
+        
+        template <typename F>
+        struct HeapOps
+        {
+            template <typename T>
+            static void Create(void* storage, T&& f) {*static_cast<F**>(storage) = new F(std::forward<T>(f));}
+            static R Invoke(void* storage, Args&&... args) {return (**static_cast<F**>(storage))(std::forward<Args>(args)...);}
+            static void Copy(void* dst, const void* src) {*static_cast<F**>(dst) = new F(**static_cast<F* const*>(src));}
+            static void Move(void* dst, void* src) {*static_cast<F**>(dst) = *static_cast<F**>(src);}
+            static void Destroy(void* storage) {delete *static_cast<F**>(storage);}
+            static const Ops* Get() {
+                static const Ops ops = {&Invoke, &Copy, &Move, &Destroy};
+                return &ops;
+            }
+        };
+        
+        void MoveFrom(CInlineFunction& other) {
+            if(other._ops)
+                other._ops->move(&_storage, &other._storage);
+            _ops = other._ops;
+            other._ops = nullptr;
+        }
+        void Reset() {
+            if(_ops)
+                _ops->destroy(&_storage);
+            _ops = nullptr;
+        }
+        
+        Storage _storage;
+        const Ops* _ops;
+    };
+    
+    typedef CInlineFunction<void(void)> TAction;
+    typedef CInlineFunction<void(const ActionResult&)> TCompletion;
+    
+    typedef enum {
+        kPriorityHi = 0,
+        kPriorityLow
+    } ActionPriority;
 }
 
 #endif /* ActionQueueTypes_h */
@@ -20,6 +20,8 @@
  *
  */
 
+#include <cctype>
+#include <cstdlib>
 #include "HttpEngine.hpp"
 #include "p8-platform/util/util.h"
 #include "p8-platform/threads/mutex.h"
@@ -34,18 +36,27 @@ namespace CurlUtils
 using namespace ActionQueue;
 
 static const size_t c_MaxQueueSize = 100000;
+static const unsigned int c_MaxConcurrentApiCalls = 4;
 long HttpEngine::c_CurlTimeout = 15; // in sec
 
 HttpEngine::HttpEngine()
-    :   m_apiCalls(new CActionQueue(c_MaxQueueSize, "API Calls")),
+    :   m_DebugRequestId(1),
+        m_apiCalls(new CActionQueue(c_MaxQueueSize, "API Calls")),
+        m_nextConcurrentApiCall(0),
+        m_nextConcurrentApiCallCompletion(0),
         m_apiCallCompletions(new CActionQueue(c_MaxQueueSize, "API Complition")),
-        m_apiHiPriorityCallCompletions(new CActionQueue(c_MaxQueueSize, "API Hi Priority Comp")),
-        m_DebugRequestId(1)
+        m_apiHiPriorityCallCompletions(new CActionQueue(c_MaxQueueSize, "API Hi Priority Comp"))
 {
 
-    m_apiCalls->CreateThread();
-    m_apiCallCompletions->CreateThread();
-    m_apiHiPriorityCallCompletions->CreateThread();
+    m_apiCalls->Start();
+    for(unsigned int i = 0; i < c_MaxConcurrentApiCalls; ++i) {
+        m_concurrentApiCalls.push_back(new CActionQueue(c_MaxQueueSize, "Concurrent API Calls"));
+        m_concurrentApiCalls.back()->Start();
+        m_concurrentApiCallCompletions.push_back(new CActionQueue(c_MaxQueueSize, "Concurrent API Complition"));
+        m_concurrentApiCallCompletions.back()->Start();
+    }
+    m_apiCallCompletions->Start();
+    m_apiHiPriorityCallCompletions->Start();
 }
 
 
@@ -90,6 +101,11 @@ void HttpEngine::CancelAllRequests()
     m_apiCalls->CancellAllBefore([=]{},
                              [&](const ActionResult& s) {event.Signal();});
     event.Wait();
+    for(auto& queue : m_concurrentApiCalls) {
+        queue->CancellAllBefore([=]{},
+                                [&](const ActionResult& s) {event.Signal();});
+        event.Wait();
+    }
     Globals::LogNotice("All API requests canceled.");
 }
 
@@ -97,25 +113,63 @@ HttpEngine::~HttpEngine()
 {
     if(m_apiCalls) {
         Globals::LogInfo("Destroying API calls queue...");
-        m_apiCalls->StopThread();
+        m_apiCalls->Stop();
         SAFE_DELETE(m_apiCalls);
         Globals::LogInfo("API calls queue deleted.");
     }
+    if(!m_concurrentApiCalls.empty()) {
+        Globals::LogInfo("Destroying concurrent API calls queues...");
+        for(auto& queue : m_concurrentApiCalls) {
+            queue->Stop();
+            SAFE_DELETE(queue);
+        }
+        m_concurrentApiCalls.clear();
+        Globals::LogInfo("Concurrent API calls queues deleted.");
+    }
+    if(!m_concurrentApiCallCompletions.empty()) {
+        Globals::LogInfo("Destroying concurrent API completion queues...");
+        for(auto& queue : m_concurrentApiCallCompletions) {
+            queue->Stop();
+            SAFE_DELETE(queue);
+        }
+        m_concurrentApiCallCompletions.clear();
+        Globals::LogInfo("Concurrent API completion queues deleted.");
+    }
     if(m_apiCallCompletions) {
         Globals::LogInfo("Destroying API completion queue...");
-        m_apiCallCompletions->StopThread();
+        m_apiCallCompletions->Stop();
         SAFE_DELETE(m_apiCallCompletions);
         Globals::LogInfo("API completion queue deleted.");
     }
     if(m_apiHiPriorityCallCompletions) {
         Globals::LogInfo("Destroying API hi-priority completion queue...");
-        m_apiHiPriorityCallCompletions->StopThread();
+        m_apiHiPriorityCallCompletions->Stop();
         SAFE_DELETE(m_apiHiPriorityCallCompletions);
         Globals::LogInfo("API hi-priority completion queue deleted.");
     }
 
 }
 
+ActionQueue::CActionQueue* HttpEngine::NextConcurrentApiQueue()
+{
+    P8PLATFORM::CLockObject lock(m_concurrentApiCallsMutex);
+    if(!m_concurrentApiCalls[m_nextConcurrentApiCall]->IsRunning())
+        throw QueueNotRunningException("Concurrent API request queue in not running.");
+    auto queue = m_concurrentApiCalls[m_nextConcurrentApiCall];
+    m_nextConcurrentApiCall = (m_nextConcurrentApiCall + 1) % m_concurrentApiCalls.size();
+    return queue;
+}
+
+ActionQueue::CActionQueue* HttpEngine::NextConcurrentCompletionQueue()
+{
+    P8PLATFORM::CLockObject lock(m_concurrentApiCallsMutex);
+    auto queue = m_concurrentApiCallCompletions[m_nextConcurrentApiCallCompletion];
+    if(!queue->IsRunning())
+        throw QueueNotRunningException("Concurrent API completion queue in not running.");
+    m_nextConcurrentApiCallCompletion = (m_nextConcurrentApiCallCompletion + 1) % m_concurrentApiCallCompletions.size();
+    return queue;
+}
+
 size_t HttpEngine::CurlWriteData(void *buffer, size_t size, size_t nmemb, void *userp)
 {
     std::string *response = (std::string *)userp;
@@ -123,6 +177,56 @@ size_t HttpEngine::CurlWriteData(void *buffer, size_t size, size_t nmemb, void *
     return size * nmemb;
 }
 
+size_t HttpEngine::CurlHeaderData(char *buffer, size_t size, size_t nitems, void *userp)
+{
+    static const char c_ContentLength[] = "content-length:";
+    static const size_t c_ContentLengthSize = sizeof(c_ContentLength) - 1;
+    
+    const size_t length = size * nitems;
+    if(length <= c_ContentLengthSize)
+        return length;
+    for(size_t i = 0; i < c_ContentLengthSize; ++i) {
+        if(tolower(buffer[i]) != c_ContentLength[i])
+            return length;
+    }
+    // Reserve space for whole body to avoid reallocations on append.
+    // All-channel EPG responses may take tens of MB.
+    // Header value is untrusted, larger bodies just grow on append.
+    static const unsigned long long c_MaxReservedBody = 64 * 1024 * 1024;
+    std::string *response = (std::string *)userp;
+    const unsigned long long contentLength = strtoull(std::string(buffer + c_ContentLengthSize, length - c_ContentLengthSize).c_str(), nullptr, 10);
+    if(contentLength > response->capacity() && contentLength <= c_MaxReservedBody) {
+        try {
+            response->reserve(contentLength);
+        } catch (std::exception& ex) {
+            Globals::LogError("HttpEngine: failed to reserve %llu bytes for response body. %s", contentLength, ex.what());
+        }
+    }
+    return length;
+}
+
+void HttpEngine::TraceCurlPhases(CURL* curl, uint64_t start, unsigned long long requestId)
+{
+    // Phase times are seconds from the transfer start, zero for skipped phases
+    double dns = 0, connect = 0, tls = 0, ttfb = 0, total = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &dns);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &tls);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &ttfb);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total);
+    auto at = [start](double t) {return start + uint64_t(t * 1000000);};
+    
+    Tracing::TraceRecorder& recorder = Tracing::TraceRecorder::Shared();
+    recorder.Add("request", "api", requestId, start, at(total));
+    recorder.Add("dns", "api", requestId, start, at(dns));
+    recorder.Add("connect", "api", requestId, at(dns), at(connect));
+    if(tls > 0)
+        recorder.Add("tls", "api", requestId, at(connect), at(tls));
+    const double requestSent = std::max(std::max(dns, connect), tls);
+    recorder.Add("ttfb", "api", requestId, at(requestSent), at(ttfb));
+    recorder.Add("transfer", "api", requestId, at(ttfb), at(total));
+}
+
 void HttpEngine::SetCurlTimeout(long timeout)
 {
     HttpEngine::c_CurlTimeout = timeout;
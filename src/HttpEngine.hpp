@@ -37,8 +37,13 @@
 
 #include <map>
 #include <string>
+#include <vector>
 #include <exception>
+#include <atomic>
+#include <memory>
 #include "ActionQueue.hpp"
+#include "TraceRecorder.hpp"
+#include "helpers.h"
 #include "globals.hpp"
 
 class QueueNotRunningException : public std::exception
@@ -66,7 +71,10 @@ public:
     
     enum RequestPriority{
         RequestPriority_Hi = 0,
-        RequestPriority_Low
+        RequestPriority_Low,
+        // Low priority request performed on one of concurrent API threads.
+        // Use for independent requests only, e.g. per-channel EPG.
+        RequestPriority_Concurrent
     };
     
     typedef std::map<std::string, std::string> TCoocies;
@@ -80,24 +88,28 @@ public:
         if(!m_apiCalls->IsRunning())
             throw QueueNotRunningException("API request queue in not running.");
         auto pThis = this;
-        ActionQueue::TAction action = [pThis, request,  parser, completion, priority](){
-            pThis->SendHttpRequest(request, pThis->m_sessionCookie, parser,completion, priority);
+        auto apiRequest = std::make_shared<ApiRequest<TParser, TCompletion> >(request, parser, completion, priority, m_DebugRequestId++);
+        ActionQueue::TAction action = [pThis, apiRequest](){
+            Tracing::TraceRecorder::Shared().Add("queue wait", "api", apiRequest->requestId, apiRequest->enqueued, monotonic_time_us());
+            pThis->SendHttpRequest(apiRequest);
         };
-        ActionQueue::TCompletion comp = [completion](const ActionQueue::ActionResult& s) {
+        ActionQueue::TCompletion comp = [apiRequest](const ActionQueue::ActionResult& s) {
             if(s.status != ActionQueue::kActionCompleted){
-                completion(s);
+                apiRequest->completion(s);
             }
         };
         if(priority == RequestPriority_Hi)
-            m_apiCalls->PerformHiPriority(action, comp);
+            m_apiCalls->PerformHiPriority(std::move(action), std::move(comp));
+        else if(priority == RequestPriority_Concurrent)
+            NextConcurrentApiQueue()->PerformAsync(std::move(action), std::move(comp));
         else
-            m_apiCalls->PerformAsync(action, comp);
+            m_apiCalls->PerformAsync(std::move(action), std::move(comp));
     }
     
     //template <typename TParser, typename TCompletion>
     void RunOnCompletionQueueAsync(ActionQueue::TAction action, ActionQueue::TCompletion completion)
     {
-        m_apiCallCompletions->PerformAsync(action,  completion);
+        m_apiCallCompletions->PerformAsync(std::move(action), std::move(completion));
     }
     void CancelAllRequests();
     static void SetCurlTimeout(long timeout);
@@ -122,6 +134,9 @@ public:
         
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlWriteData);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+        // Response buffer is preallocated from Content-Length
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, CurlHeaderData);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, response);
         curl_easy_setopt(curl, CURLOPT_TIMEOUT, c_CurlTimeout);
         
         std::string cookieStr;
@@ -140,7 +155,9 @@ public:
         
         while (retries-- > 0)
         {
+            const uint64_t attemptStart = monotonic_time_us();
             curlCode = curl_easy_perform(curl);
+            TraceCurlPhases(curl, attemptStart, requestId);
             
             if (curlCode == CURLE_OPERATION_TIMEDOUT)
             {
@@ -168,50 +185,82 @@ public:
             *response = "";
         
         curl_easy_cleanup(curl);
-        if(curlCode != CURLE_OK){
-            delete response;
+        if(curlCode != CURLE_OK)
             throw CurlErrorException(&errorMessage[0]);
-        }
     }
     
 private:
+    // State of single API call shared by its queued actions.
+    // Actions capture only the pointer and fit inline storage of TAction,
+    // the call costs one allocation.
+    template <typename TParser, typename TCompletion>
+    struct ApiRequest
+    {
+        ApiRequest(const std::string& u, const TParser& p, const TCompletion& c, RequestPriority pr, unsigned long long id)
+        : url(u), parser(p), completion(c), priority(pr), requestId(id), enqueued(monotonic_time_us()), responseTime(0)
+        {}
+        const std::string url;
+        TParser parser;
+        TCompletion completion;
+        const RequestPriority priority;
+        const unsigned long long requestId;
+        const uint64_t enqueued;
+        uint64_t responseTime;
+        std::string response;
+    };
+
     static size_t CurlWriteData(void *buffer, size_t size, size_t nmemb, void *userp);
+    static size_t CurlHeaderData(char *buffer, size_t size, size_t nitems, void *userp);
     static  long c_CurlTimeout;
-    mutable unsigned long long m_DebugRequestId;
+    std::atomic<unsigned long long> m_DebugRequestId;
+    // Adds spans of DNS, connect, TLS, TTFB and transfer phases
+    static void TraceCurlPhases(CURL* curl, uint64_t start, unsigned long long requestId);
 
-    template <typename TResultCallback, typename TCompletion>
-    void SendHttpRequest(const std::string &url, const TCoocies &cookie, TResultCallback result, TCompletion completion, RequestPriority priority) const
+    // Round robin over concurrent API queues
+    ActionQueue::CActionQueue* NextConcurrentApiQueue();
+    // Round robin over completion queues of concurrent API requests
+    ActionQueue::CActionQueue* NextConcurrentCompletionQueue();
+
+    template <typename TRequest>
+    void SendHttpRequest(const std::shared_ptr<TRequest>& request)
     {
-        std::string* response = new std::string();
-        const unsigned long long requestId = m_DebugRequestId++;
-        
-        DoCurl(url, cookie, response, requestId);
+        DoCurl(request->url, m_sessionCookie, &request->response, request->requestId);
+        request->responseTime = monotonic_time_us();
         
-        ActionQueue::TAction action = [result, response, requestId]() {
-            Globals::LogDebug("Processing response. ID=%llu", requestId);
-            result(*response);
+        ActionQueue::TAction action = [request]() {
+            Tracing::TraceRecorder::Shared().Add("completion wait", "api", request->requestId, request->responseTime, monotonic_time_us());
+            Globals::LogDebug("Processing response. ID=%llu", request->requestId);
+            Tracing::ScopedSpan span("parse", "api", request->requestId);
+            request->parser(request->response);
         };
-        ActionQueue::TCompletion comp =[completion, response, requestId](const ActionQueue::ActionResult& s) {
-            delete response;
-            Globals::LogDebug("Complete response. ID=%llu", requestId);
-            completion(s);
+        ActionQueue::TCompletion comp =[request](const ActionQueue::ActionResult& s) {
+            // Release response body before completion
+            std::string().swap(request->response);
+            Globals::LogDebug("Complete response. ID=%llu", request->requestId);
+            Tracing::ScopedSpan span("completion", "api", request->requestId);
+            request->completion(s);
         };
-        if(priority == RequestPriority_Hi) {
-            if(!m_apiHiPriorityCallCompletions->IsRunning()){
-                delete response;
+        if(request->priority == RequestPriority_Hi) {
+            if(!m_apiHiPriorityCallCompletions->IsRunning())
                 throw QueueNotRunningException("API call completion queue in not running.");
-            }
-            m_apiHiPriorityCallCompletions->PerformAsync(action, comp);
+            m_apiHiPriorityCallCompletions->PerformAsync(std::move(action), std::move(comp));
+        } else if(request->priority == RequestPriority_Concurrent) {
+            // Responses of concurrent requests are independent, process them in parallel
+            NextConcurrentCompletionQueue()->PerformAsync(std::move(action), std::move(comp));
         } else {
-            if(!m_apiCallCompletions->IsRunning()){
-                delete response;
+            if(!m_apiCallCompletions->IsRunning())
                 throw QueueNotRunningException("API call completion queue in not running.");
-            }
-            m_apiCallCompletions->PerformAsync(action, comp);
+            m_apiCallCompletions->PerformAsync(std::move(action), std::move(comp));
         }
     }
     
     ActionQueue::CActionQueue* m_apiCalls;
+    std::vector<ActionQueue::CActionQueue*> m_concurrentApiCalls;
+    unsigned int m_nextConcurrentApiCall;
+    // Engine owns completion queues, so no completion outlives the engine
+    std::vector<ActionQueue::CActionQueue*> m_concurrentApiCallCompletions;
+    unsigned int m_nextConcurrentApiCallCompletion;
+    P8PLATFORM::CMutex m_concurrentApiCallsMutex;
     ActionQueue::CActionQueue* m_apiCallCompletions;
     ActionQueue::CActionQueue* m_apiHiPriorityCallCompletions;
 
@@ -207,7 +207,7 @@ namespace Buffers {
                 auto currentIdx = mediaIndex++;
                 m_segmentUrls[currentIdx] = TSegmentUrls::mapped_type(duration, url, currentIdx);
             }
-            LogDebug("m_segmentUrls.size = %d, %s", m_segmentUrls.size(), hasContent ? "Not empty." : "Empty."  );
+            LOG_TRACE("m_segmentUrls.size = %d, %s", m_segmentUrls.size(), hasContent ? "Not empty." : "Empty."  );
             return hasContent;
         } catch (std::exception& ex) {
             LogError("Bad M3U : parser error %s", ex.what() );
@@ -223,7 +223,7 @@ namespace Buffers {
     {
         char buffer[1024];
         
-        LogDebug(">>> PlaylistBuffer: (re)loading playlist %s.", m_playListUrl.c_str());
+        LOG_DEBUG(">>> PlaylistBuffer: (re)loading playlist %s.", m_playListUrl.c_str());
         
         auto f = XBMC->OpenFile(m_playListUrl.c_str(), XFILE::READ_NO_CACHE | XFILE::READ_CHUNKED | XFILE::READ_TRUNCATED);
         if (!f)
@@ -233,11 +233,12 @@ namespace Buffers {
             buffer[0]= 0;
             auto bytesRead = XBMC->ReadFile(f, buffer, sizeof(buffer));
             isEof = bytesRead <= 0;
-            data.append(&buffer[0], bytesRead);
+            if(!isEof)
+                data.append(&buffer[0], bytesRead);
         }while(!isEof);
         XBMC->CloseFile(f);
         
-        LogDebug(">>> PlaylistBuffer: (re)loading done. Content: \n%s", data.substr(0, 16000).c_str());
+        LOG_TRACE(">>> PlaylistBuffer: (re)loading done. Content: \n%s", data.substr(0, 16000).c_str());
         
     }
     
@@ -266,11 +267,11 @@ namespace Buffers {
     
     bool Playlist::SetNextSegmentIndex(uint64_t idx) {
         if(m_segmentUrls.size() < idx) {
-            LogDebug("Playlist: failed to next segment to #%" PRIu64 ". Total segments %d .", idx, m_segmentUrls.size());
+            LOG_DEBUG("Playlist: failed to next segment to #%" PRIu64 ". Total segments %d .", idx, m_segmentUrls.size());
             return false;
         }
         m_loadIterator = idx;
-        LogDebug("Playlist: next segment index set to #%" PRIu64 ".", m_loadIterator);
+        LOG_TRACE("Playlist: next segment index set to #%" PRIu64 ".", m_loadIterator);
         return true;
     }
 }
@@ -0,0 +1,137 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <atomic>
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+#include "TraceRecorder.hpp"
+#include "helpers.h"
+#include "globals.hpp"
+
+namespace Tracing
+{
+    using namespace Globals;
+    
+    static const size_t c_TraceCapacity = 8192;
+    
+    // Small sequential thread IDs are easier to read in trace viewer
+    static uint32_t CurrentThreadId()
+    {
+        static std::atomic<uint32_t> s_nextThreadId(1);
+        static thread_local uint32_t s_threadId = s_nextThreadId++;
+        return s_threadId;
+    }
+    
+    TraceRecorder& TraceRecorder::Shared()
+    {
+        static TraceRecorder recorder(c_TraceCapacity);
+        return recorder;
+    }
+    
+    TraceRecorder::TraceRecorder(size_t capacity)
+    : m_spans(capacity)
+    , m_next(0)
+    , m_count(0)
+    {}
+    
+    void TraceRecorder::Add(const char* name, const char* category, uint64_t id, uint64_t start, uint64_t end)
+    {
+        const TraceSpan span = {name, category, id, start, end > start ? end - start : 0, CurrentThreadId()};
+        P8PLATFORM::CLockObject lock(m_mutex);
+        m_spans[m_next] = span;
+        m_next = (m_next + 1) % m_spans.size();
+        if(m_count < m_spans.size())
+            ++m_count;
+    }
+    
+    std::string TraceRecorder::ToChromeTraceJson() const
+    {
+        std::vector<TraceSpan> spans;
+        {
+            P8PLATFORM::CLockObject lock(m_mutex);
+            spans.reserve(m_count);
+            const size_t first = (m_next + m_spans.size() - m_count) % m_spans.size();
+            for(size_t i = 0; i < m_count; ++i)
+                spans.push_back(m_spans[(first + i) % m_spans.size()]);
+        }
+        
+        using namespace rapidjson;
+        StringBuffer s;
+        Writer<StringBuffer> writer(s);
+        writer.StartObject();
+        writer.Key("traceEvents");
+        writer.StartArray();
+        for(const auto& span : spans) {
+            writer.StartObject();
+            writer.Key("name");
+            writer.String(span.name);
+            writer.Key("cat");
+            writer.String(span.category);
+            writer.Key("ph");
+            writer.String("X");
+            writer.Key("ts");
+            writer.Uint64(span.start);
+            writer.Key("dur");
+            writer.Uint64(span.duration);
+            writer.Key("pid");
+            writer.Uint(1);
+            writer.Key("tid");
+            writer.Uint(span.threadId);
+            if(span.id != 0) {
+                writer.Key("args");
+                writer.StartObject();
+                writer.Key("id");
+                writer.Uint64(span.id);
+                writer.EndObject();
+            }
+            writer.EndObject();
+        }
+        writer.EndArray();
+        writer.EndObject();
+        return s.GetString();
+    }
+    
+    bool TraceRecorder::Dump(const std::string& path) const
+    {
+        const std::string json = ToChromeTraceJson();
+        void* file = XBMC->OpenFileForWrite(path.c_str(), true);
+        if(NULL == file) {
+            LogError("TraceRecorder: failed to open %s", path.c_str());
+            return false;
+        }
+        const bool succeeded = XBMC->WriteFile(file, json.c_str(), json.size()) == (ssize_t)json.size();
+        XBMC->CloseFile(file);
+        return succeeded;
+    }
+    
+    ScopedSpan::ScopedSpan(const char* name, const char* category, uint64_t id)
+    : m_name(name)
+    , m_category(category)
+    , m_id(id)
+    , m_start(monotonic_time_us())
+    {}
+    
+    ScopedSpan::~ScopedSpan()
+    {
+        TraceRecorder::Shared().Add(m_name, m_category, m_id, m_start, monotonic_time_us());
+    }
+}
@@ -0,0 +1,80 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef TraceRecorder_hpp
+#define TraceRecorder_hpp
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "p8-platform/threads/mutex.h"
+
+namespace Tracing
+{
+    // Timing span in Chrome trace terms ("complete" event).
+    // Names and categories should be string literals.
+    struct TraceSpan
+    {
+        const char* name;
+        const char* category;
+        uint64_t id;
+        uint64_t start;
+        uint64_t duration;
+        uint32_t threadId;
+    };
+    
+    // Keeps latest spans in a ring buffer
+    class TraceRecorder
+    {
+    public:
+        static TraceRecorder& Shared();
+        
+        // Times are in microseconds of monotonic_time_us()
+        void Add(const char* name, const char* category, uint64_t id, uint64_t start, uint64_t end);
+        std::string ToChromeTraceJson() const;
+        // Writes Chrome trace JSON (chrome://tracing, Perfetto) to the file
+        bool Dump(const std::string& path) const;
+        
+    private:
+        TraceRecorder(size_t capacity);
+        
+        std::vector<TraceSpan> m_spans;
+        size_t m_next;
+        size_t m_count;
+        mutable P8PLATFORM::CMutex m_mutex;
+    };
+    
+    // Records span from construction to destruction
+    class ScopedSpan
+    {
+    public:
+        ScopedSpan(const char* name, const char* category, uint64_t id = 0);
+        ~ScopedSpan();
+    private:
+        const char* m_name;
+        const char* m_category;
+        const uint64_t m_id;
+        const uint64_t m_start;
+    };
+}
+
+#endif /* TraceRecorder_hpp */
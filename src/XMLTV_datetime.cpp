@@ -0,0 +1,129 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *   Copyright (C) 2013-2015 Anton Fedchin
+ *   http://github.com/afedchin/xbmc-addon-iptvsimple/
+ *
+ *   Copyright (C) 2011 Pulse-Eight
+ *   http://www.pulse-eight.com/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include "XMLTV_datetime.hpp"
+
+namespace XMLTV {
+    
+    // Reads count decimal digits. Returns false on any non-digit character.
+    static inline bool ParseDigits(const char* p, int count, int& value)
+    {
+        value = 0;
+        for(int i = 0; i < count; ++i) {
+            const unsigned int digit = static_cast<unsigned char>(p[i]) - '0';
+            if(digit > 9)
+                return false;
+            value = value * 10 + digit;
+        }
+        return true;
+    }
+    
+    // Number of days since 1970-01-01 for proleptic Gregorian date
+    // (H. Hinnant's days_from_civil algorithm).
+    static inline long DaysFromCivil(int y, int m, int d)
+    {
+        y -= m <= 2;
+        const long era = (y >= 0 ? y : y - 399) / 400;
+        const long yoe = y - era * 400;                                 // [0, 399]
+        const long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;  // [0, 365]
+        const long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;         // [0, 146096]
+        return era * 146097 + doe - 719468;
+    }
+    
+    // Fast path for "YYYYMMDDhhmmss +zzzz" (time zone is optional).
+    // Returns false when string does not strictly match the format.
+    bool ParseXmltvDateTime(const std::string& strDate, long& utcTime)
+    {
+        const char* p = strDate.c_str();
+        const size_t size = strDate.size();
+        int year, month, day, hour, minute, second;
+        if(size < 14
+           || !ParseDigits(p, 4, year) || !ParseDigits(p + 4, 2, month) || !ParseDigits(p + 6, 2, day)
+           || !ParseDigits(p + 8, 2, hour) || !ParseDigits(p + 10, 2, minute) || !ParseDigits(p + 12, 2, second))
+            return false;
+        if(month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+            return false;
+        
+        long offset_of_date = 0;
+        if(size > 14) {
+            int hours, minutes;
+            if(size != 20 || p[14] != ' ' || (p[15] != '+' && p[15] != '-')
+               || !ParseDigits(p + 16, 2, hours) || !ParseDigits(p + 18, 2, minutes))
+                return false;
+            offset_of_date = (hours * 60 * 60) + (minutes * 60);
+            if (p[15] == '-')
+                offset_of_date = -offset_of_date;
+        }
+        
+        utcTime = DaysFromCivil(year, month, day) * 24 * 60 * 60 + hour * 60 * 60 + minute * 60 + second - offset_of_date;
+        return true;
+    }
+    
+    long ParseDateTimeWithMktime(const std::string& strDate, bool iDateFormat, long localOffset)
+    {
+        struct tm timeinfo;
+        memset(&timeinfo, 0, sizeof(tm));
+        char sign = '+';
+        int hours = 0;
+        int minutes = 0;
+        
+        if (iDateFormat)
+            sscanf(strDate.c_str(), "%04d%02d%02d%02d%02d%02d %c%02d%02d", &timeinfo.tm_year, &timeinfo.tm_mon, &timeinfo.tm_mday, &timeinfo.tm_hour, &timeinfo.tm_min, &timeinfo.tm_sec, &sign, &hours, &minutes);
+        else
+            sscanf(strDate.c_str(), "%02d.%02d.%04d%02d:%02d:%02d", &timeinfo.tm_mday, &timeinfo.tm_mon, &timeinfo.tm_year, &timeinfo.tm_hour, &timeinfo.tm_min, &timeinfo.tm_sec);
+        
+        timeinfo.tm_mon  -= 1;
+        timeinfo.tm_year -= 1900;
+        timeinfo.tm_isdst = -1;
+        
+        long offset_of_date = (hours * 60 * 60) + (minutes * 60);
+        if (sign == '-')
+        {
+            offset_of_date = -offset_of_date;
+        }
+        
+        return mktime(&timeinfo) - offset_of_date - localOffset;
+    }
+    
+    long LocalTimeOffset()
+    {
+        std::time_t current_time;
+        std::time(&current_time);
+        long offset = 0;
+#ifndef TARGET_WINDOWS
+        offset = -std::localtime(&current_time)->tm_gmtoff;
+#else
+        _get_timezone(&offset);
+#endif // TARGET_WINDOWS
+
+        return offset;
+    }
+}
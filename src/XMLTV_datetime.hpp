@@ -0,0 +1,47 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *   Copyright (C) 2013-2015 Anton Fedchin
+ *   http://github.com/afedchin/xbmc-addon-iptvsimple/
+ *
+ *   Copyright (C) 2011 Pulse-Eight
+ *   http://www.pulse-eight.com/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef XMLTV_datetime_hpp
+#define XMLTV_datetime_hpp
+
+#include <string>
+
+namespace XMLTV {
+
+    // Parses "YYYYMMDDhhmmss +zzzz" (time zone is optional) to UTC time
+    // without time zone database lookups.
+    // Returns false when string does not strictly match the format.
+    bool ParseXmltvDateTime(const std::string& strDate, long& utcTime);
+    // sscanf/mktime based parser of XMLTV or "DD.MM.YYYYhh:mm:ss" (iDateFormat is false) date.
+    // The result is corrected by localOffset, see LocalTimeOffset().
+    long ParseDateTimeWithMktime(const std::string& strDate, bool iDateFormat, long localOffset);
+    // Current offset of UTC from local time in seconds
+    long LocalTimeOffset();
+}
+
+#endif /* XMLTV_datetime_hpp */
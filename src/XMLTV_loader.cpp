@@ -30,54 +30,493 @@
 #include "p8-platform/os.h"
 #include "XMLTV_loader.hpp"
 #include "zlib.h"
-#include "rapidxml/rapidxml.hpp"
 #include <ctime>
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
 #include <functional>
+#include <memory>
+#include <vector>
+#include <list>
+#include <thread>
+#include "p8-platform/threads/threads.h"
+#include "p8-platform/util/buffer.h"
 #include "globals.hpp"
 
 using namespace std;
 using namespace XMLTV;
-using namespace rapidxml;
 using namespace Globals;
 using namespace ADDON;
 
 namespace XMLTV {
     
     static const std::string c_CacheFolder = "special://temp/pvr-puzzle-tv/XmlTvCache/";
+    static const unsigned int c_ReadChunkSize = 64 * 1024;
+    static const unsigned int c_EpgChunkSize = 1024 * 1024;
+    static const unsigned int c_MaxEpgWorkers = 8;
     
-    struct XmlDocumentAndData {
-        xml_document<> doc;
-        template<int Flags>
-        void parse(const char *text){
-            data = text;
-            doc.parse<Flags>(&data[0]);
+    class XmlParseException : public std::exception
+    {
+    public:
+        XmlParseException(const char* r = "") : reason(r) {}
+        const char* what() const noexcept {return reason.c_str();}
+        const std::string reason;
+    };
+    
+    // Sequential source of raw document bytes.
+    class IByteSource
+    {
+    public:
+        // Returns amount of bytes read. 0 means end of data.
+        virtual unsigned int Read(char* buffer, unsigned int size) = 0;
+        // True when data ended due to an error (e.g. corrupted archive)
+        virtual bool IsFailed() const { return false;}
+        virtual ~IByteSource() {}
+    };
+    
+    class FileSource : public IByteSource
+    {
+    public:
+        FileSource(const std::string& path)
+        : m_handle(XBMC->OpenFile(path.c_str(), 0))
+        {}
+        ~FileSource() {
+            if(m_handle)
+                XBMC->CloseFile(m_handle);
+        }
+        bool IsOpened() const { return nullptr != m_handle;}
+        unsigned int Read(char* buffer, unsigned int size) {
+            if(nullptr == m_handle)
+                return 0;
+            auto bytesRead = XBMC->ReadFile(m_handle, buffer, size);
+            return bytesRead > 0 ? bytesRead : 0;
         }
     private:
-        string data;
+        void* m_handle;
     };
     
-    template<class Ch>
-    inline bool GetNodeValue(const xml_node<Ch> * pRootNode, const char* strTag, string& strStringValue)
+    // Non-owning view of in-memory data
+    class MemorySource : public IByteSource
     {
-        xml_node<Ch> *pChildNode = pRootNode->first_node(strTag);
-        if (pChildNode == NULL)
+    public:
+        MemorySource(const char* data, size_t size)
+        : m_data(data)
+        , m_size(size)
+        , m_pos(0)
+        {}
+        unsigned int Read(char* buffer, unsigned int size) {
+            size = std::min<size_t>(size, m_size - m_pos);
+            memcpy(buffer, m_data + m_pos, size);
+            m_pos += size;
+            return size;
+        }
+    private:
+        const char* m_data;
+        const size_t m_size;
+        size_t m_pos;
+    };
+    
+    // Inflates gzip stream on the fly.
+    // Compressed data is pulled from underlying source with fixed size window,
+    // so memory usage doesn't depend on data size.
+    class InflateSource : public IByteSource
+    {
+    public:
+        // Takes ownership of compressed data source
+        InflateSource(IByteSource* compressed)
+        : m_compressed(compressed)
+        , m_window(c_InflateWindowSize)
+        , m_isInitialized(false)
+        , m_isDone(false)
+        , m_isFailed(false)
         {
+            memset(&m_stream, 0, sizeof(m_stream));
+            m_stream.zalloc = Z_NULL;
+            m_stream.zfree = Z_NULL;
+            m_isInitialized = Z_OK == inflateInit2(&m_stream, (16+MAX_WBITS));
+            m_isFailed = !m_isInitialized;
+            m_isDone = m_isFailed;
+        }
+        ~InflateSource() {
+            if(m_isInitialized)
+                inflateEnd(&m_stream);
+        }
+        // True when whole gzip stream has been inflated
+        bool IsCompleted() const { return m_isDone && !m_isFailed;}
+        bool IsFailed() const { return m_isFailed;}
+        
+        unsigned int Read(char* buffer, unsigned int size) {
+            if(m_isDone)
+                return 0;
+            
+            m_stream.next_out = (Bytef *) buffer;
+            m_stream.avail_out = size;
+            while(m_stream.avail_out > 0) {
+                if(0 == m_stream.avail_in) {
+                    unsigned int bytesRead = m_compressed->Read(&m_window[0], m_window.size());
+                    if(0 == bytesRead) {
+                        LogError("XMLTV Loader: unexpected end of compressed data.");
+                        m_isFailed = m_isDone = true;
+                        break;
+                    }
+                    m_stream.next_in = (Bytef *) &m_window[0];
+                    m_stream.avail_in = bytesRead;
+                }
+                
+                int err = inflate(&m_stream, Z_NO_FLUSH);
+                if (err == Z_STREAM_END) {
+                    m_isDone = true;
+                    break;
+                }
+                if (err != Z_OK && err != Z_BUF_ERROR) {
+                    LogError("XMLTV Loader: inflate failed (%d).", err);
+                    m_isFailed = m_isDone = true;
+                    break;
+                }
+            }
+            return size - m_stream.avail_out;
+        }
+    private:
+        static const unsigned int c_InflateWindowSize = 16 * 1024;
+        
+        std::unique_ptr<IByteSource> m_compressed;
+        std::vector<char> m_window;
+        z_stream m_stream;
+        bool m_isInitialized;
+        bool m_isDone;
+        bool m_isFailed;
+    };
+    
+    // Minimal non-validating pull parser.
+    // Holds in memory only not yet consumed part of the document,
+    // i.e. memory usage is bounded by the largest tag/text node, not by document size.
+    class XmlPullParser
+    {
+    public:
+        typedef enum {
+            k_StartElement,
+            k_EndElement,
+            k_Text,
+            k_EndOfDocument
+        } Event;
+        
+        XmlPullParser(IByteSource& source)
+        : m_source(source)
+        , m_pos(0)
+        , m_isEof(false)
+        , m_hasPendingEnd(false)
+        {}
+        
+        Event Next();
+        const std::string& Name() const {return m_name;}
+        const std::string& Text() const {return m_text;}
+        bool GetAttribute(const char* name, std::string& value) const;
+        
+        // Access to raw data ahead of parser (signature checks etc.)
+        // Returns nullptr when document is shorter then requested size.
+        const char* Peek(size_t size) { return EnsureData(size) ? m_buffer.data() + m_pos : nullptr; }
+        void Skip(size_t size) { if(EnsureData(size)) m_pos += size; else m_pos = m_buffer.size(); }
+        // Moves to out at least minSize bytes of raw data (when available)
+        // extended up to the end of following delimiter.
+        // Returns false at the end of document.
+        bool ReadRaw(size_t minSize, const char* delimiter, std::string& out);
+        
+    private:
+        typedef std::vector<std::pair<std::string, std::string> > Attributes;
+        
+        bool ReadMore();
+        bool EnsureData(size_t size);
+        bool StartsWith(const char* tag);
+        size_t Find(const char* delimiter, size_t from);
+        size_t FindTagEnd();
+        void SkipPast(const char* delimiter);
+        void ParseStartTag(size_t tagEnd);
+        static void DecodeEntities(const char* begin, const char* end, std::string& out);
+        
+        IByteSource& m_source;
+        std::string m_buffer;
+        size_t m_pos;
+        bool m_isEof;
+        bool m_hasPendingEnd;
+        std::string m_name;
+        std::string m_text;
+        Attributes m_attributes;
+    };
+    
+    bool XmlPullParser::ReadMore()
+    {
+        if(m_isEof)
             return false;
+        const size_t oldSize = m_buffer.size();
+        m_buffer.resize(oldSize + c_ReadChunkSize);
+        unsigned int bytesRead = m_source.Read(&m_buffer[oldSize], c_ReadChunkSize);
+        m_buffer.resize(oldSize + bytesRead);
+        m_isEof = bytesRead == 0;
+        return !m_isEof;
+    }
+    
+    bool XmlPullParser::EnsureData(size_t size)
+    {
+        while(m_buffer.size() - m_pos < size) {
+            if(!ReadMore())
+                return false;
         }
-        strStringValue = pChildNode->value();
         return true;
     }
     
-    template<class Ch>
-    inline bool GetAttributeValue(const xml_node<Ch> * pNode, const char* strAttributeName, string& strStringValue)
+    bool XmlPullParser::StartsWith(const char* tag)
     {
-        xml_attribute<Ch> *pAttribute = pNode->first_attribute(strAttributeName);
-        if (pAttribute == NULL)
-        {
-            return false;
+        const size_t len = strlen(tag);
+        return EnsureData(len) && 0 == m_buffer.compare(m_pos, len, tag);
+    }
+    
+    size_t XmlPullParser::Find(const char* delimiter, size_t from)
+    {
+        const size_t len = strlen(delimiter);
+        while(true) {
+            size_t pos = m_buffer.find(delimiter, from);
+            if(string::npos != pos)
+                return pos;
+            // Delimiter may be split between chunks.
+            if(m_buffer.size() >= from + len)
+                from = m_buffer.size() - len + 1;
+            if(!ReadMore())
+                return string::npos;
+        }
+    }
+    
+    size_t XmlPullParser::FindTagEnd()
+    {
+        // '>' is allowed inside of quoted attribute value
+        char quote = 0;
+        size_t i = m_pos + 1;
+        do {
+            const size_t size = m_buffer.size();
+            for(; i < size; ++i) {
+                const char c = m_buffer[i];
+                if(quote) {
+                    if(c == quote)
+                        quote = 0;
+                } else if(c == '"' || c == '\'') {
+                    quote = c;
+                } else if(c == '>') {
+                    return i;
+                }
+            }
+        } while(ReadMore());
+        return string::npos;
+    }
+    
+    void XmlPullParser::SkipPast(const char* delimiter)
+    {
+        size_t end = Find(delimiter, m_pos);
+        if(string::npos == end)
+            throw XmlParseException("unexpected end of data");
+        m_pos = end + strlen(delimiter);
+    }
+    
+    static inline bool IsXmlSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+    
+    void XmlPullParser::ParseStartTag(size_t tagEnd)
+    {
+        const char* p = m_buffer.data() + m_pos + 1;
+        const char* end = m_buffer.data() + tagEnd;
+        m_hasPendingEnd = end[-1] == '/';
+        if(m_hasPendingEnd)
+            --end;
+        
+        const char* nameStart = p;
+        while(p < end && !IsXmlSpace(*p))
+            ++p;
+        if(p == nameStart)
+            throw XmlParseException("element name expected");
+        m_name.assign(nameStart, p);
+        
+        m_attributes.clear();
+        while(true) {
+            while(p < end && IsXmlSpace(*p))
+                ++p;
+            if(p >= end)
+                break;
+            const char* attrStart = p;
+            while(p < end && *p != '=' && !IsXmlSpace(*p))
+                ++p;
+            const char* attrEnd = p;
+            while(p < end && IsXmlSpace(*p))
+                ++p;
+            if(p >= end || *p != '=')
+                throw XmlParseException("expected '=' after attribute name");
+            ++p;
+            while(p < end && IsXmlSpace(*p))
+                ++p;
+            if(p >= end || (*p != '"' && *p != '\''))
+                throw XmlParseException("expected ' or \"");
+            const char quote = *p++;
+            const char* valueStart = p;
+            while(p < end && *p != quote)
+                ++p;
+            if(p >= end)
+                throw XmlParseException("expected ' or \"");
+            m_attributes.push_back(Attributes::value_type(string(attrStart, attrEnd), string()));
+            DecodeEntities(valueStart, p, m_attributes.back().second);
+            ++p;
+        }
+    }
+    
+    static void AppendUtf8(std::string& out, unsigned long code)
+    {
+        if (code < 0x80) {
+            out += (char) code;
+        } else if (code < 0x800) {
+            out += (char) (0xC0 | (code >> 6));
+            out += (char) (0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += (char) (0xE0 | (code >> 12));
+            out += (char) (0x80 | ((code >> 6) & 0x3F));
+            out += (char) (0x80 | (code & 0x3F));
+        } else if (code < 0x110000) {
+            out += (char) (0xF0 | (code >> 18));
+            out += (char) (0x80 | ((code >> 12) & 0x3F));
+            out += (char) (0x80 | ((code >> 6) & 0x3F));
+            out += (char) (0x80 | (code & 0x3F));
+        }
+    }
+    
+    void XmlPullParser::DecodeEntities(const char* begin, const char* end, std::string& out)
+    {
+        const char* p = begin;
+        while(p < end) {
+            const char* amp = std::find(p, end, '&');
+            out.append(p, amp);
+            if(amp == end)
+                break;
+            // Longest supported entity is &#x10FFFF;
+            const char* semicolon = std::find(amp, std::min(end, amp + 10), ';');
+            p = semicolon + 1;
+            const char* entity = amp + 1;
+            const size_t len = semicolon - entity;
+            if(semicolon == end || *semicolon != ';') {
+                out += '&';
+                p = amp + 1;
+            } else if(len == 2 && 0 == strncmp(entity, "lt", 2)) {
+                out += '<';
+            } else if(len == 2 && 0 == strncmp(entity, "gt", 2)) {
+                out += '>';
+            } else if(len == 3 && 0 == strncmp(entity, "amp", 3)) {
+                out += '&';
+            } else if(len == 4 && 0 == strncmp(entity, "quot", 4)) {
+                out += '"';
+            } else if(len == 4 && 0 == strncmp(entity, "apos", 4)) {
+                out += '\'';
+            } else if(len > 1 && entity[0] == '#') {
+                const bool isHex = entity[1] == 'x' || entity[1] == 'X';
+                AppendUtf8(out, strtoul(entity + (isHex ? 2 : 1), nullptr, isHex ? 16 : 10));
+            } else {
+                // Unknown entity, leave as is
+                out.append(amp, p);
+            }
+        }
+    }
+    
+    bool XmlPullParser::ReadRaw(size_t minSize, const char* delimiter, std::string& out)
+    {
+        EnsureData(minSize);
+        size_t end = m_buffer.size();
+        if(m_buffer.size() - m_pos >= minSize) {
+            // Delimiter may cross minSize boundary
+            const size_t len = strlen(delimiter);
+            size_t found = Find(delimiter, m_pos + minSize - std::min(minSize, len - 1));
+            end = (string::npos == found) ? m_buffer.size() : found + len;
+        }
+        out.assign(m_buffer, m_pos, end - m_pos);
+        m_buffer.erase(0, end);
+        m_pos = 0;
+        return !out.empty();
+    }
+    
+    bool XmlPullParser::GetAttribute(const char* name, std::string& value) const
+    {
+        for (const auto& attr : m_attributes) {
+            if(attr.first == name) {
+                value = attr.second;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    XmlPullParser::Event XmlPullParser::Next()
+    {
+        // <element/> is reported as start + end pair
+        if(m_hasPendingEnd) {
+            m_hasPendingEnd = false;
+            return k_EndElement;
+        }
+        // Drop consumed data
+        if(m_pos >= c_ReadChunkSize) {
+            m_buffer.erase(0, m_pos);
+            m_pos = 0;
+        }
+        
+        while(true) {
+            if(!EnsureData(1))
+                return k_EndOfDocument;
+            
+            if(m_buffer[m_pos] != '<') {
+                size_t end = Find("<", m_pos);
+                if(string::npos == end)
+                    end = m_buffer.size();
+                m_text.clear();
+                DecodeEntities(m_buffer.data() + m_pos, m_buffer.data() + end, m_text);
+                m_pos = end;
+                return k_Text;
+            }
+            if(StartsWith("<?")) {
+                SkipPast("?>");
+            } else if(StartsWith("<!--")) {
+                SkipPast("-->");
+            } else if(StartsWith("<![CDATA[")) {
+                const size_t start = m_pos + 9;
+                size_t end = Find("]]>", start);
+                if(string::npos == end)
+                    throw XmlParseException("unexpected end of data in CDATA section");
+                m_text.assign(m_buffer, start, end - start);
+                m_pos = end + 3;
+                return k_Text;
+            } else if(StartsWith("<!")) {
+                // DOCTYPE, possibly with internal subset
+                size_t end = FindTagEnd();
+                size_t subset = m_buffer.find('[', m_pos);
+                if(string::npos != end && subset < end) {
+                    end = Find("]", subset);
+                    if(string::npos != end)
+                        end = Find(">", end);
+                }
+                if(string::npos == end)
+                    throw XmlParseException("unexpected end of data in DOCTYPE");
+                m_pos = end + 1;
+            } else if(StartsWith("</")) {
+                size_t end = Find(">", m_pos);
+                if(string::npos == end)
+                    throw XmlParseException("unexpected end of data in end tag");
+                size_t nameEnd = end;
+                while(nameEnd > m_pos + 2 && IsXmlSpace(m_buffer[nameEnd - 1]))
+                    --nameEnd;
+                m_name.assign(m_buffer, m_pos + 2, nameEnd - m_pos - 2);
+                m_pos = end + 1;
+                return k_EndElement;
+            } else {
+                size_t end = FindTagEnd();
+                if(string::npos == end)
+                    throw XmlParseException("unexpected end of data in start tag");
+                ParseStartTag(end);
+                m_pos = end + 1;
+                return k_StartElement;
+            }
         }
-        strStringValue = pAttribute->value();
-        return true;
     }
     
     static int GetFileContents(const string& url, string &strContent)
@@ -89,9 +528,9 @@ namespace XMLTV {
         void* fileHandle = XBMC->OpenFile(url.c_str(), 0);
         if (fileHandle)
         {
-            char buffer[1024];
-            while (int bytesRead = XBMC->ReadFile(fileHandle, buffer, 1024))
-                strContent.append(buffer, bytesRead);
+            std::vector<char> buffer(c_ReadChunkSize);
+            while (int bytesRead = XBMC->ReadFile(fileHandle, &buffer[0], buffer.size()))
+                strContent.append(&buffer[0], bytesRead);
             XBMC->CloseFile(fileHandle);
             XBMC->Log(LOG_DEBUG, "XMLTV Loader: file reading done.");
 
@@ -109,82 +548,244 @@ namespace XMLTV {
         return c_CacheFolder + std::to_string(std::hash<std::string>{}(original));
     }
     
-    static bool ShouldreloadCahcedFile(const std::string &filePath, const std::string& strCachedPath)
+#pragma mark - Cache validation
+    
+    // HTTP validators of cached copy, stored along with cached file.
+    struct CacheInfo
     {
-        bool bNeedReload = false;
-        
+        CacheInfo() : isEpgParsed(false) {}
+        std::string etag;
+        std::string lastModified;
+        // Whether EPG entries of cached copy were reported by ParseEpg()
+        bool isEpgParsed;
+    };
+    
+    static const char* const c_EtagKey = "ETag: ";
+    static const char* const c_LastModifiedKey = "Last-Modified: ";
+    static const char* const c_EpgParsedKey = "EPG-Parsed: ";
+    
+    static std::string GetCacheInfoPathFor(const std::string& cachedPath)
+    {
+        return cachedPath + ".info";
+    }
+    
+    static bool LoadCacheInfo(const std::string& cachedPath, CacheInfo& info)
+    {
+        info = CacheInfo();
+        string content;
+        if(0 == GetFileContents(GetCacheInfoPathFor(cachedPath), content))
+            return false;
         
-        XBMC->Log(LOG_DEBUG, "XMLTV Loader: open cached file %s." , filePath.c_str());
+        auto getValue = [&content](const char* key) {
+            const string prefix = string("\n") + key;
+            size_t pos = ("\n" + content).find(prefix);
+            if(string::npos == pos)
+                return string();
+            pos += prefix.size() - 1;
+            return content.substr(pos, content.find('\n', pos) - pos);
+        };
+        info.etag = getValue(c_EtagKey);
+        info.lastModified = getValue(c_LastModifiedKey);
+        info.isEpgParsed = getValue(c_EpgParsedKey) == "1";
+        return true;
+    }
+    
+    static bool SaveCacheInfo(const std::string& cachedPath, const CacheInfo& info)
+    {
+        const string content = string(c_EtagKey) + info.etag + "\n"
+            + c_LastModifiedKey + info.lastModified + "\n"
+            + c_EpgParsedKey + (info.isEpgParsed ? "1" : "0") + "\n";
         
-        // check cached file is exists
-        if (XBMC->FileExists(strCachedPath.c_str(), false))
-        {
-            struct __stat64 statCached;
-            struct __stat64 statOrig;
-            
-            XBMC->StatFile(strCachedPath.c_str(), &statCached);
-            XBMC->StatFile(filePath.c_str(), &statOrig);
-            
-            //bNeedReload = statCached.st_mtime < statOrig.st_mtime || statOrig.st_mtime == 0;
-            // Modification time is not provided by some servers.
-            // It should be safe to compare file sizes.
-            bNeedReload = statOrig.st_size == 0 ||  statOrig.st_size != statCached.st_size;
-            XBMC->Log(LOG_DEBUG, "XMLTV Loader: cached file exists. Reload?  %s." , bNeedReload ? "Yes" : "No");
-            
+        void* fileHandle = XBMC->OpenFileForWrite(GetCacheInfoPathFor(cachedPath).c_str(), true);
+        if(!fileHandle)
+            return false;
+        const ssize_t bytesToWrite = content.size();
+        bool succeeded = bytesToWrite == XBMC->WriteFile(fileHandle, content.c_str(), bytesToWrite);
+        XBMC->CloseFile(fileHandle);
+        return succeeded;
+    }
+    
+    static void DeleteCachedFile(const std::string& cachedPath)
+    {
+        XBMC->DeleteFile(cachedPath.c_str());
+        XBMC->DeleteFile(GetCacheInfoPathFor(cachedPath).c_str());
+    }
+    
+    static std::string GetResponseHeader(void* fileHandle, const char* name)
+    {
+        string value;
+        char* header = XBMC->GetFilePropertyValue(fileHandle, XFILE::FILE_PROPERTY_RESPONSE_HEADER, name);
+        if(header) {
+            value = header;
+            XBMC->FreeString(header);
         }
-        else
-            bNeedReload = true;
-        return bNeedReload;
+        return value;
     }
     
-    static bool ReloadCachedFile(const std::string &filePath, const std::string& strCachedPath, std::string &strContents)
+    // Status code of HTTP response, -1 when unknown
+    static int GetResponseStatus(void* fileHandle)
     {
-        bool succeeded = false;
+        int status = -1;
+        char* protocol = XBMC->GetFilePropertyValue(fileHandle, XFILE::FILE_PROPERTY_RESPONSE_PROTOCOL, "");
+        if(protocol) {
+            // Status line, e.g. "HTTP/1.1 304 Not Modified" or "HTTP/2 304"
+            if(0 == strncmp(protocol, "HTTP/", 5)) {
+                const char* code = strchr(protocol, ' ');
+                if(code) {
+                    while(' ' == *code)
+                        ++code;
+                    char* end = nullptr;
+                    const long value = strtol(code, &end, 10);
+                    if(end == code + 3 && (*end == ' ' || *end == '\0') && value >= 100 && value <= 599)
+                        status = value;
+                }
+            }
+            XBMC->FreeString(protocol);
+        }
+        return status;
+    }
+    
+    // Size based check for servers without ETag/Last-Modified support
+    static bool IsSizeChanged(const std::string &filePath, const std::string& strCachedPath)
+    {
+        struct __stat64 statCached;
+        struct __stat64 statOrig;
         
-        GetFileContents(filePath, strContents);
+        XBMC->StatFile(strCachedPath.c_str(), &statCached);
+        XBMC->StatFile(filePath.c_str(), &statOrig);
         
-        // write to cache
-        if (strContents.length() > 0)
-        {
-            void* fileHandle = XBMC->OpenFileForWrite(strCachedPath.c_str(), true);
-            if(!fileHandle) {
-                XBMC->CreateDirectory(c_CacheFolder.c_str());
-                fileHandle = XBMC->OpenFileForWrite(strCachedPath.c_str(), true);
+        // Modification time is not provided by some servers.
+        // It should be safe to compare file sizes.
+        return statOrig.st_size == 0 ||  statOrig.st_size != statCached.st_size;
+    }
+    
+    // Copies content of opened file to the path. Returns amount of copied bytes or -1 on error.
+    static int64_t CopyToFile(void* sourceHandle, const std::string& path)
+    {
+        void* fileHandle = XBMC->OpenFileForWrite(path.c_str(), true);
+        if(!fileHandle) {
+            XBMC->CreateDirectory(c_CacheFolder.c_str());
+            fileHandle = XBMC->OpenFileForWrite(path.c_str(), true);
+        }
+        if (!fileHandle)
+            return -1;
+        
+        bool succeeded = true;
+        int64_t totalBytes = 0;
+        std::vector<char> buffer(c_ReadChunkSize);
+        while (succeeded) {
+            ssize_t bytesRead = XBMC->ReadFile(sourceHandle, &buffer[0], buffer.size());
+            if(bytesRead < 0) {
+                XBMC->Log(LOG_ERROR, "XMLTV Loader: read error after %lld bytes.", totalBytes);
+                succeeded = false;
             }
-            if (fileHandle)
-            {
-                auto bytesToWrite = strContents.length();
-                succeeded = bytesToWrite == XBMC->WriteFile(fileHandle, strContents.c_str(), bytesToWrite);
-                XBMC->CloseFile(fileHandle);
+            if(bytesRead <= 0)
+                break;
+            succeeded = bytesRead == XBMC->WriteFile(fileHandle, &buffer[0], bytesRead);
+            totalBytes += bytesRead;
+        }
+        XBMC->CloseFile(fileHandle);
+        return succeeded ? totalBytes : -1;
+    }
+    
+    // Downloads response body to temporary file first.
+    // Cached copy is replaced only by complete download.
+    static bool DownloadToFile(void* sourceHandle, const std::string& strCachedPath)
+    {
+        const std::string tempPath = strCachedPath + ".download";
+        const int64_t totalBytes = CopyToFile(sourceHandle, tempPath);
+        XBMC->Log(LOG_DEBUG, "XMLTV Loader: %lld bytes downloaded.", totalBytes);
+        
+        bool succeeded = totalBytes > 0;
+        // Content-Length is size of encoded body, when server compresses transfer
+        const std::string contentLength = GetResponseHeader(sourceHandle, "Content-Length");
+        const std::string contentEncoding = GetResponseHeader(sourceHandle, "Content-Encoding");
+        if(succeeded && !contentLength.empty() && (contentEncoding.empty() || contentEncoding == "identity")) {
+            const long long expectedBytes = strtoll(contentLength.c_str(), nullptr, 10);
+            if(expectedBytes != totalBytes) {
+                XBMC->Log(LOG_ERROR, "XMLTV Loader: truncated download, %lld of %lld bytes.", totalBytes, expectedBytes);
+                succeeded = false;
             }
         }
+        // Addon API has no rename, copy verified file over the cached one
+        if(succeeded) {
+            void* tempHandle = XBMC->OpenFile(tempPath.c_str(), 0);
+            succeeded = nullptr != tempHandle && CopyToFile(tempHandle, strCachedPath) == totalBytes;
+            if(tempHandle)
+                XBMC->CloseFile(tempHandle);
+            // Partially overwritten copy is not valid anymore
+            if(!succeeded)
+                DeleteCachedFile(strCachedPath);
+        }
+        XBMC->DeleteFile(tempPath.c_str());
         return succeeded;
     }
     
-    int GetCachedFileContents(const std::string &filePath, std::string &strContents)
+    // Revalidates cached copy of the file with conditional GET request
+    // and downloads the file when it was changed.
+    // Returns false when no valid cached copy is available.
+    static bool RefreshCachedFile(const std::string &filePath, const std::string& strCachedPath, CacheInfo& info)
     {
-        std::string strCachedPath =  GetCachedPathFor(filePath);
-        bool bNeedReload =  ShouldreloadCahcedFile(filePath, strCachedPath);
+        XBMC->Log(LOG_DEBUG, "XMLTV Loader: open cached file %s." , filePath.c_str());
+
+        const bool isCached = XBMC->FileExists(strCachedPath.c_str(), false) && LoadCacheInfo(strCachedPath, info);
+        const bool hasValidators = !info.etag.empty() || !info.lastModified.empty();
+        if(isCached && !hasValidators && !IsSizeChanged(filePath, strCachedPath)) {
+            XBMC->Log(LOG_DEBUG, "XMLTV Loader: cached file has the same size.");
+            return true;
+        }
         
-        if (bNeedReload)
-        {
-            ReloadCachedFile(filePath, strCachedPath, strContents);
-            return strContents.length();
+        void* fileHandle = XBMC->CURLCreate(filePath.c_str());
+        if(!fileHandle)
+            return false;
+        if(isCached) {
+            if(!info.etag.empty())
+                XBMC->CURLAddOption(fileHandle, XFILE::CURL_OPTION_HEADER, "If-None-Match", info.etag.c_str());
+            if(!info.lastModified.empty())
+                XBMC->CURLAddOption(fileHandle, XFILE::CURL_OPTION_HEADER, "If-Modified-Since", info.lastModified.c_str());
         }
         
+        bool succeeded = false;
+        if(XBMC->CURLOpen(fileHandle, XFILE::READ_NO_CACHE)) {
+            if(isCached && 304 == GetResponseStatus(fileHandle)) {
+                XBMC->Log(LOG_DEBUG, "XMLTV Loader: cached file is not modified.");
+                succeeded = true;
+            } else {
+                CacheInfo newInfo;
+                newInfo.etag = GetResponseHeader(fileHandle, "ETag");
+                newInfo.lastModified = GetResponseHeader(fileHandle, "Last-Modified");
+                if(DownloadToFile(fileHandle, strCachedPath)) {
+                    info = newInfo;
+                    succeeded = SaveCacheInfo(strCachedPath, info);
+                    if(!succeeded)
+                        DeleteCachedFile(strCachedPath);
+                } else if(isCached && XBMC->FileExists(strCachedPath.c_str(), false)) {
+                    XBMC->Log(LOG_NOTICE, "XMLTV Loader: failed to download %s. Cached copy is used.", filePath.c_str());
+                    succeeded = true;
+                }
+            }
+        } else if(isCached) {
+            XBMC->Log(LOG_NOTICE, "XMLTV Loader: failed to revalidate %s. Cached copy is used.", filePath.c_str());
+            succeeded = true;
+        }
+        XBMC->CloseFile(fileHandle);
+        return succeeded;
+    }
+    
+    int GetCachedFileContents(const std::string &filePath, std::string &strContents)
+    {
+        strContents.clear();
+        std::string strCachedPath = GetCachedFilePath(filePath);
+        if(strCachedPath.empty())
+            return 0;
         return GetFileContents(strCachedPath, strContents);
     }
 
     std::string GetCachedFilePath(const std::string &filePath)
     {
         std::string strCachedPath =  GetCachedPathFor(filePath);
-        bool bNeedReload =  ShouldreloadCahcedFile(filePath, strCachedPath);
-        
-        if (!bNeedReload)
-            return strCachedPath;
-
-        std::string strContents;
-        if(ReloadCachedFile(filePath, strCachedPath, strContents))
+        CacheInfo info;
+        if(RefreshCachedFile(filePath, strCachedPath, info))
             return strCachedPath;
         
         return std::string();
@@ -192,119 +793,30 @@ namespace XMLTV {
     
     static int ParseDateTime(std::string& strDate, bool iDateFormat = true)
     {
-        static  long offset = LocalTimeOffset();
-
-        struct tm timeinfo;
-        memset(&timeinfo, 0, sizeof(tm));
-        char sign = '+';
-        int hours = 0;
-        int minutes = 0;
-        
-        if (iDateFormat)
-            sscanf(strDate.c_str(), "%04d%02d%02d%02d%02d%02d %c%02d%02d", &timeinfo.tm_year, &timeinfo.tm_mon, &timeinfo.tm_mday, &timeinfo.tm_hour, &timeinfo.tm_min, &timeinfo.tm_sec, &sign, &hours, &minutes);
-        else
-            sscanf(strDate.c_str(), "%02d.%02d.%04d%02d:%02d:%02d", &timeinfo.tm_mday, &timeinfo.tm_mon, &timeinfo.tm_year, &timeinfo.tm_hour, &timeinfo.tm_min, &timeinfo.tm_sec);
+        long utcTime;
+        if(iDateFormat && ParseXmltvDateTime(strDate, utcTime))
+            return utcTime;
         
-        timeinfo.tm_mon  -= 1;
-        timeinfo.tm_year -= 1900;
-        timeinfo.tm_isdst = -1;
-        
-        long offset_of_date = (hours * 60 * 60) + (minutes * 60);
-        if (sign == '-')
-        {
-            offset_of_date = -offset_of_date;
-        }
-        
-        return mktime(&timeinfo) - offset_of_date - offset;
-    }
-    
-    long LocalTimeOffset()
-    {
-        std::time_t current_time;
-        std::time(&current_time);
-        long offset = 0;
-#ifndef TARGET_WINDOWS
-        offset = -std::localtime(&current_time)->tm_gmtoff;
-#else
-        _get_timezone(&offset);
-#endif // TARGET_WINDOWS
-
-        return offset;
+        static  long offset = LocalTimeOffset();
+        return ParseDateTimeWithMktime(strDate, iDateFormat, offset);
     }
     
-    /*
-     * This method uses zlib to decompress a gzipped file in memory.
-     * Author: Andrew Lim Chong Liang
-     * http://windrealm.org
-     */
     bool GzipInflate( const string& compressedBytes, string& uncompressedBytes ) {
         
-#define HANDLE_CALL_ZLIB(status) {   \
-if(status != Z_OK) {        \
-free(uncomp);             \
-return false;             \
-}                           \
-}
+        uncompressedBytes.clear() ;
         
         if ( compressedBytes.size() == 0 )
-        {
-            uncompressedBytes = compressedBytes ;
             return true ;
-        }
-        
-        uncompressedBytes.clear() ;
-        
-        unsigned full_length = compressedBytes.size() ;
-        unsigned half_length = compressedBytes.size() / 2;
         
-        unsigned uncompLength = full_length ;
-        char* uncomp = (char*) calloc( sizeof(char), uncompLength );
+        InflateSource inflater(new MemorySource(compressedBytes.data(), compressedBytes.size()));
+        // Rough estimation of compression ratio to reduce reallocations
+        uncompressedBytes.reserve(compressedBytes.size() * 4);
         
-        z_stream strm;
-        strm.next_in = (Bytef *) compressedBytes.c_str();
-        strm.avail_in = compressedBytes.size() ;
-        strm.total_out = 0;
-        strm.zalloc = Z_NULL;
-        strm.zfree = Z_NULL;
+        std::vector<char> window(c_ReadChunkSize);
+        while (unsigned int bytesRead = inflater.Read(&window[0], window.size()))
+            uncompressedBytes.append(&window[0], bytesRead);
         
-        bool done = false ;
-        
-        HANDLE_CALL_ZLIB(inflateInit2(&strm, (16+MAX_WBITS)));
-        
-        while (!done)
-        {
-            // If our output buffer is too small
-            if (strm.total_out >= uncompLength )
-            {
-                // Increase size of output buffer
-                uncomp = (char *) realloc(uncomp, uncompLength + half_length);
-                if (uncomp == NULL)
-                    return false;
-                uncompLength += half_length ;
-            }
-            
-            strm.next_out = (Bytef *) (uncomp + strm.total_out);
-            strm.avail_out = uncompLength - strm.total_out;
-            
-            // Inflate another chunk.
-            int err = inflate (&strm, Z_SYNC_FLUSH);
-            if (err == Z_STREAM_END)
-                done = true;
-            else if (err != Z_OK)
-            {
-                break;
-            }
-        }
-        
-        HANDLE_CALL_ZLIB(inflateEnd (&strm));
-        
-        for ( size_t i=0; i<strm.total_out; ++i )
-        {
-            uncompressedBytes += uncomp[ i ];
-        }
-        
-        free( uncomp );
-        return true ;
+        return inflater.IsCompleted();
     }
    
     bool IsDataCompressed(const std::string& data)
@@ -312,129 +824,462 @@ return false;             \
         return (data[0] == '\x1F' && data[1] == '\x8B' && data[2] == '\x08');
     }
     
-   bool CreateDocument(const std::string& url,  XmlDocumentAndData& xmlDoc)
+    static PvrClient::ChannelId PatchChannelId(const std::string& strId)
+    {
+        int id = std::hash<std::string>{}(strId);
+        // Although Kodi defines unique broadcast ID as unsigned int for addons
+        // internal DB serialisation accepts only signed positive IDs
+        return id < 0 ? -id : id;
+    }
+    
+    // Opens cached copy of the file. Gzip packed file is inflated on the fly.
+    // Cached copy is revalidated unless it was just refreshed by the caller.
+    static IByteSource* OpenCachedSource(const std::string& url, bool isCacheRefreshed = false)
+    {
+        std::string cachedPath = isCacheRefreshed ? GetCachedPathFor(url) : GetCachedFilePath(url);
+        if(cachedPath.empty())
+            return nullptr;
+        
+        char signature[3] = {0};
+        {
+            FileSource file(cachedPath);
+            if(!file.IsOpened() || file.Read(signature, sizeof(signature)) != sizeof(signature))
+                return nullptr;
+        }
+        
+        FileSource* file = new FileSource(cachedPath);
+        if (IsDataCompressed(string(signature, sizeof(signature))))
+            return new InflateSource(file);
+        return file;
+    }
+    
+    static IByteSource* OpenDocumentSource(const std::string& url, bool isCacheRefreshed)
     {
         if (url.empty())
         {
             XBMC->Log(LOG_NOTICE, "EPG file path is not configured. EPG not loaded.");
-            return false;
+            return nullptr;
         }
         
-        string data;
-        string decompressed;
-        
-        if (GetCachedFileContents(url, data) == 0)
-        {
+        IByteSource* source = OpenCachedSource(url, isCacheRefreshed);
+        if(nullptr == source)
             XBMC->Log(LOG_ERROR, "Unable to load EPG file '%s':  file is missing or empty.", url.c_str());
-            return false;
-        }
+        return source;
+    }
+    
+    int GetInflatedCachedFileContents(const std::string &filePath, std::string &strContents)
+    {
+        strContents.clear();
         
-        char * buffer;
-        // gzip packed
-        if (IsDataCompressed(data))
-        {
-            if (!GzipInflate(data, decompressed))
-            {
-                XBMC->Log(LOG_ERROR, "Invalid EPG file '%s': unable to decompress file.", url.c_str());
-                return false;
-            }
-            buffer = &(decompressed[0]);
-        }
-        else
-            buffer = &(data[0]);
+        std::unique_ptr<IByteSource> source(OpenCachedSource(filePath));
+        if(!source)
+            return 0;
         
+        std::vector<char> window(c_ReadChunkSize);
+        while (unsigned int bytesRead = source->Read(&window[0], window.size()))
+            strContents.append(&window[0], bytesRead);
+        
+        if(source->IsFailed()) {
+            XBMC->Log(LOG_ERROR, "XMLTV Loader: unable to decompress file %s.", filePath.c_str());
+            strContents.clear();
+        }
+        return strContents.length();
+    }
+    
+    static bool SkipPreamble(XmlPullParser& parser, const std::string& url)
+    {
         // xml should starts with '<?xml'
-        if (buffer[0] != '\x3C' || buffer[1] != '\x3F' || buffer[2] != '\x78' ||
-            buffer[3] != '\x6D' || buffer[4] != '\x6C')
+        const char* buffer = parser.Peek(5);
+        if(buffer && 0 != strncmp(buffer, "<?xml", 5))
         {
             // check for BOM
             if (buffer[0] != '\xEF' || buffer[1] != '\xBB' || buffer[2] != '\xBF')
             {
+                const bool isMarkup = buffer[0] == '<';
                 // check for tar archive
-                if (strcmp(buffer + 0x101, "ustar") || strcmp(buffer + 0x101, "GNUtar"))
-                    buffer += 0x200; // RECORDSIZE = 512
-                else
+                buffer = parser.Peek(0x200);
+                if (buffer && (0 == strncmp(buffer + 0x101, "ustar", 5) || 0 == strncmp(buffer + 0x101, "GNUtar", 6)))
+                    parser.Skip(0x200); // RECORDSIZE = 512
+                else if(!isMarkup)
                 {
                     XBMC->Log(LOG_ERROR, "Invalid EPG file '%s': unable to parse file.", url.c_str());
                     return false;
                 }
             }
         }
+        return true;
+    }
+    
+    // Streams XMLTV document and reports <channel> and/or <programme> elements
+    // as soon as element is complete. Empty callback skips related elements.
+    static bool ParseDocument(const std::string& url, const ChannelCallback& onChannelFound, const EpgEntryCallback& onEpgEntryFound, bool isCacheRefreshed = false)
+    {
+        std::unique_ptr<IByteSource> source(OpenDocumentSource(url, isCacheRefreshed));
+        if(!source)
+            return false;
+        
+        XmlPullParser parser(*source);
+        if(!SkipPreamble(parser, url))
+            return false;
+        
+        typedef enum {
+            k_OtherElement,
+            k_ChannelElement,
+            k_ProgrammeElement
+        } ElementType;
+        
+        ElementType element = k_OtherElement;
+        bool isElementValid = false;
+        int depth = 0;
+        bool isRootFound = false;
+        bool isRootClosed = false;
+        // Text of current <display-name>, <title> or <desc> goes there
+        std::string* textTarget = nullptr;
+        
+        EpgChannel channel;
+        bool hasChannelName = false;
+        bool hasChannelIcon = false;
+        
+        EpgEntry entry;
+        bool hasTitle = false;
+        bool hasPlot = false;
+        
+        string strId, strStart, strStop;
         
         try
         {
-            xmlDoc.parse<0>(buffer);
+            XmlPullParser::Event event;
+            while((event = parser.Next()) != XmlPullParser::k_EndOfDocument)
+            {
+                if(XmlPullParser::k_Text == event) {
+                    if(textTarget && 3 == depth)
+                        textTarget->append(parser.Text());
+                    continue;
+                }
+                
+                if(XmlPullParser::k_EndElement == event) {
+                    if(3 == depth) {
+                        textTarget = nullptr;
+                    } else if(2 == depth && isElementValid) {
+                        if(k_ChannelElement == element) {
+                            if(hasChannelName)
+                                onChannelFound(channel);
+                            else
+                                XBMC->Log(LOG_DEBUG, "XMLTV Loader: no channel display name found.");
+                        } else if(k_ProgrammeElement == element) {
+                            try {
+                                onEpgEntryFound(entry);
+                            } catch (...) {
+                                LogError("Bad XML EPG entry.");
+                            }
+                        }
+                        element = k_OtherElement;
+                    }
+                    if(--depth < 0)
+                        throw XmlParseException("unexpected end tag");
+                    isRootClosed = 0 == depth;
+                    continue;
+                }
+                
+                // Start element
+                const string& name = parser.Name();
+                ++depth;
+                if(1 == depth) {
+                    if(isRootFound || name != "tv")
+                        break;
+                    isRootFound = true;
+                } else if(2 == depth) {
+                    element = k_OtherElement;
+                    isElementValid = false;
+                    if(onChannelFound && name == "channel") {
+                        element = k_ChannelElement;
+                        isElementValid = parser.GetAttribute("id", strId);
+                        if(!isElementValid) {
+                            XBMC->Log(LOG_DEBUG, "XMLTV Loader: no channel ID found.");
+                            continue;
+                        }
+                        channel.id = PatchChannelId(strId);
+                        channel.strName.clear();
+                        channel.strIcon.clear();
+                        hasChannelName = false;
+                        hasChannelIcon = false;
+                    } else if(onEpgEntryFound && name == "programme") {
+                        element = k_ProgrammeElement;
+                        isElementValid = parser.GetAttribute("channel", strId)
+                            && parser.GetAttribute("start", strStart)
+                            && parser.GetAttribute("stop", strStop);
+                        if(!isElementValid)
+                            continue;
+                        entry.iChannelId = PatchChannelId(strId);
+                        entry.startTime = ParseDateTime(strStart);
+                        entry.endTime = ParseDateTime(strStop);
+                        entry.strTitle.clear();
+                        entry.strPlot.clear();
+                        hasTitle = false;
+                        hasPlot = false;
+                    }
+                } else if(3 == depth && isElementValid) {
+                    if(k_ChannelElement == element) {
+                        if(!hasChannelName && name == "display-name") {
+                            hasChannelName = true;
+                            textTarget = &channel.strName;
+                        } else if(!hasChannelIcon && name == "icon") {
+                            hasChannelIcon = true;
+                            parser.GetAttribute("src", channel.strIcon);
+                        }
+                    } else if(k_ProgrammeElement == element) {
+                        if(!hasTitle && name == "title") {
+                            hasTitle = true;
+                            textTarget = &entry.strTitle;
+                        } else if(!hasPlot && name == "desc") {
+                            hasPlot = true;
+                            textTarget = &entry.strPlot;
+                        }
+                    }
+                }
+            }
+        }
+        catch(XmlParseException& ex)
+        {
+            XBMC->Log(LOG_ERROR, "Unable parse EPG XML: %s", ex.what());
+            return false;
+        }
+        
+        if(source->IsFailed())
+        {
+            XBMC->Log(LOG_ERROR, "Invalid EPG file '%s': unable to decompress file.", url.c_str());
+            return false;
+        }
+        if (!isRootFound)
+        {
+            XBMC->Log(LOG_ERROR, "Invalid EPG XML: no <tv> tag found");
+            return false;
         }
-        catch(parse_error p)
+        if (!isRootClosed)
         {
-            XBMC->Log(LOG_ERROR, "Unable parse EPG XML: %s", p.what());
+            XBMC->Log(LOG_ERROR, "Unable parse EPG XML: unexpected end of data");
             return false;
         }
         return true;
-
     }
     
-    static PvrClient::ChannelId PatchChannelId(const std::string& strId)
+#pragma mark - Parallel EPG parsing
+    
+    // Part of XMLTV document cut on </programme> boundary
+    struct EpgChunk
     {
-        int id = std::hash<std::string>{}(strId);
-        // Although Kodi defines unique broadcast ID as unsigned int for addons
-        // internal DB serialisation accepts only signed positive IDs
-        return id < 0 ? -id : id;
-    }
+        EpgChunk()
+        : isRootStarted(false)
+        , isRootClosed(false)
+        {}
+        std::string data;
+        std::vector<EpgEntry> entries;
+        bool isRootStarted;
+        bool isRootClosed;
+        std::string error;
+        P8PLATFORM::CEvent done;
+    };
     
-    bool ParseChannels(const std::string& url,  const ChannelCallback& onChannelFound)
+    // Collects <programme> elements of document fragment.
+    // Elements outside of <programme> are ignored, so fragment may start or end
+    // in the middle of <tv> (but not in the middle of <programme>).
+    static void ParseProgrammes(EpgChunk& chunk)
     {
-
-        XmlDocumentAndData xmlDoc;
-        
-        XBMC->Log(LOG_DEBUG, "XMLTV Loader: open document from %s." , url.c_str());
-
+        MemorySource source(chunk.data.data(), chunk.data.size());
+        XmlPullParser parser(source);
         
-        if(!CreateDocument(url, xmlDoc))
-           return false;
+        bool isInProgramme = false;
+        bool isProgrammeValid = false;
+        int childDepth = 0;
+        std::string* textTarget = nullptr;
+        bool hasTitle = false;
+        bool hasPlot = false;
+        EpgEntry entry;
+        string strId, strStart, strStop;
         
-        XBMC->Log(LOG_DEBUG, "XMLTV Loader: start document parsing.");
-
-        xml_node<> *pRootElement = xmlDoc.doc.first_node("tv");
-        if (!pRootElement)
+        XmlPullParser::Event event;
+        while((event = parser.Next()) != XmlPullParser::k_EndOfDocument)
         {
-            XBMC->Log(LOG_ERROR, "Invalid EPG XML: no <tv> tag found");
+            if(XmlPullParser::k_Text == event) {
+                if(textTarget)
+                    textTarget->append(parser.Text());
+            } else if(XmlPullParser::k_StartElement == event) {
+                const string& name = parser.Name();
+                if(!isInProgramme) {
+                    if(name == "programme") {
+                        isInProgramme = true;
+                        childDepth = 0;
+                        isProgrammeValid = parser.GetAttribute("channel", strId)
+                            && parser.GetAttribute("start", strStart)
+                            && parser.GetAttribute("stop", strStop);
+                        if(!isProgrammeValid)
+                            continue;
+                        entry.iChannelId = PatchChannelId(strId);
+                        entry.startTime = ParseDateTime(strStart);
+                        entry.endTime = ParseDateTime(strStop);
+                        entry.strTitle.clear();
+                        entry.strPlot.clear();
+                        hasTitle = false;
+                        hasPlot = false;
+                    } else if(name == "tv") {
+                        chunk.isRootStarted = true;
+                    }
+                } else if(1 == ++childDepth && isProgrammeValid) {
+                    if(!hasTitle && name == "title") {
+                        hasTitle = true;
+                        textTarget = &entry.strTitle;
+                    } else if(!hasPlot && name == "desc") {
+                        hasPlot = true;
+                        textTarget = &entry.strPlot;
+                    }
+                }
+            } else if(isInProgramme) {
+                if(0 == childDepth) {
+                    isInProgramme = false;
+                    if(isProgrammeValid)
+                        chunk.entries.push_back(entry);
+                } else {
+                    --childDepth;
+                    textTarget = nullptr;
+                }
+            } else if(parser.Name() == "tv") {
+                chunk.isRootClosed = true;
+            }
+        }
+        if(isInProgramme)
+            throw XmlParseException("unexpected end of data in programme element");
+    }
+    
+    class EpgWorker : public P8PLATFORM::CThread
+    {
+    public:
+        typedef P8PLATFORM::SyncedBuffer<EpgChunk*> Queue;
+        
+        EpgWorker(Queue& queue) : m_queue(queue) {}
+        void* Process() {
+            EpgChunk* chunk = nullptr;
+            while(!IsStopped()) {
+                if(!m_queue.Pop(chunk, 1000))
+                    continue;
+                // nullptr is a stop signal
+                if(nullptr == chunk)
+                    break;
+                try {
+                    ParseProgrammes(*chunk);
+                } catch (XmlParseException& ex) {
+                    chunk->error = ex.what();
+                } catch (...) {
+                    chunk->error = "unknown error";
+                }
+                chunk->data.clear();
+                chunk->done.Signal();
+            }
+            return nullptr;
+        }
+    private:
+        Queue& m_queue;
+    };
+    
+    // Document is cut on chunks by calling thread,
+    // chunks are parsed concurrently by worker threads
+    // and parsed EPG entries reported back to the caller in document order.
+    static bool ParseEpgConcurrently(const std::string& url,  const EpgEntryCallback& onEpgEntryFound, unsigned int workersCount, bool isCacheRefreshed)
+    {
+        std::unique_ptr<IByteSource> source(OpenDocumentSource(url, isCacheRefreshed));
+        if(!source)
+            return false;
+        
+        XmlPullParser parser(*source);
+        if(!SkipPreamble(parser, url))
             return false;
+        
+        const size_t maxChunksInProgress = 2 * workersCount;
+        EpgWorker::Queue queue(maxChunksInProgress + workersCount);
+        std::vector<EpgWorker*> workers;
+        for(unsigned int i = 0; i < workersCount; ++i) {
+            workers.push_back(new EpgWorker(queue));
+            workers.back()->CreateThread();
         }
         
-        xml_node<> *pChannelNode = NULL;
-        for(pChannelNode = pRootElement->first_node("channel"); pChannelNode; pChannelNode = pChannelNode->next_sibling("channel"))
-        {
-            //XBMC->Log(LOG_DEBUG, "XMLTV Loader: found channel node.");
-
-            EpgChannel channel;
-            std::string strId;
-            if(!GetAttributeValue(pChannelNode, "id", strId)){
-                XBMC->Log(LOG_DEBUG, "XMLTV Loader: no channel ID found.");
-                continue;
+        std::list<EpgChunk*> chunks;
+        bool isRootStarted = false;
+        bool isRootClosed = false;
+        bool isEndOfDocument = false;
+        std::string error;
+        
+        while(!chunks.empty() || !isEndOfDocument) {
+            // Feed workers
+            while(!isEndOfDocument && error.empty() && chunks.size() < maxChunksInProgress) {
+                EpgChunk* chunk = new EpgChunk();
+                isEndOfDocument = !parser.ReadRaw(c_EpgChunkSize, "</programme>", chunk->data);
+                if(isEndOfDocument) {
+                    delete chunk;
+                    break;
+                }
+                chunks.push_back(chunk);
+                queue.Push(chunk);
             }
+            if(chunks.empty())
+                break;
             
-            channel.id = PatchChannelId(strId);
-            
-            if(!GetNodeValue(pChannelNode, "display-name", channel.strName)){
-                XBMC->Log(LOG_DEBUG, "XMLTV Loader: no channel display name found.");
-                continue;
+            // Report oldest chunk
+            EpgChunk* chunk = chunks.front();
+            chunks.pop_front();
+            chunk->done.Wait();
+            // Entries parsed before an error are reported, like in sequential mode
+            if(error.empty()) {
+                isRootStarted |= chunk->isRootStarted;
+                isRootClosed |= chunk->isRootClosed;
+                for (const auto& entry : chunk->entries) {
+                    try {
+                        onEpgEntryFound(entry);
+                    } catch (...) {
+                        LogError("Bad XML EPG entry.");
+                    }
+                }
+                error = chunk->error;
             }
-            
-            //XBMC->Log(LOG_DEBUG, "XMLTV Loader: found channel %s.", channel.strName.c_str());
-
-            xml_node<> *pIconNode = pChannelNode->first_node("icon");
-            if (pIconNode == NULL)
-                channel.strIcon = "";
-            else if (!GetAttributeValue(pIconNode, "src", channel.strIcon))
-                channel.strIcon = "";
-            
-            //XBMC->Log(LOG_DEBUG, "XMLTV Loader: populating channel");
-
-            onChannelFound(channel);
+            delete chunk;
         }
         
-        xmlDoc.doc.clear();
+        for (size_t i = 0; i < workers.size(); ++i)
+            queue.Push(nullptr);
+        for (auto worker : workers) {
+            worker->StopThread();
+            delete worker;
+        }
+        
+        if(!error.empty())
+        {
+            XBMC->Log(LOG_ERROR, "Unable parse EPG XML: %s", error.c_str());
+            return false;
+        }
+        if(source->IsFailed())
+        {
+            XBMC->Log(LOG_ERROR, "Invalid EPG file '%s': unable to decompress file.", url.c_str());
+            return false;
+        }
+        if (!isRootStarted)
+        {
+            XBMC->Log(LOG_ERROR, "Invalid EPG XML: no <tv> tag found");
+            return false;
+        }
+        if (!isRootClosed)
+        {
+            XBMC->Log(LOG_ERROR, "Unable parse EPG XML: unexpected end of data");
+            return false;
+        }
+        return true;
+    }
+    
+#pragma mark - API
+    
+    bool ParseChannels(const std::string& url,  const ChannelCallback& onChannelFound)
+    {
+        XBMC->Log(LOG_DEBUG, "XMLTV Loader: open document from %s." , url.c_str());
+        
+        if(!ParseDocument(url, onChannelFound, nullptr))
+            return false;
         
         XBMC->Log(LOG_NOTICE, "XMLTV: channels Loaded.");
         
@@ -442,56 +1287,49 @@ return false;             \
     }
 
     
-    bool ParseEpg(const std::string& url,  const EpgEntryCallback& onEpgEntryFound)
+    static bool ParseEpg(const std::string& url,  const EpgEntryCallback& onEpgEntryFound, bool isCacheRefreshed)
     {
-        XmlDocumentAndData xmlDoc;
-        
-        if(!CreateDocument(url, xmlDoc))
-           return false;
-           
-        xml_node<> *pRootElement = xmlDoc.doc.first_node("tv");
-        if (!pRootElement)
-        {
-            XBMC->Log(LOG_ERROR, "Invalid EPG XML: no <tv> tag found");
+        const unsigned int workersCount = std::min(std::thread::hardware_concurrency(), c_MaxEpgWorkers);
+        bool succeeded = (workersCount > 1)
+            ? ParseEpgConcurrently(url, onEpgEntryFound, workersCount, isCacheRefreshed)
+            : ParseDocument(url, nullptr, onEpgEntryFound, isCacheRefreshed);
+        if(!succeeded)
             return false;
-        }
         
-        xml_node<> *pChannelNode = NULL;
-        for(pChannelNode = pRootElement->first_node("programme"); pChannelNode; pChannelNode = pChannelNode->next_sibling("programme"))
-        {
-            try {
-                string strId;
-                if (!GetAttributeValue(pChannelNode, "channel", strId))
-                    continue;
-                
-                string strStart, strStop;
-                if ( !GetAttributeValue(pChannelNode, "start", strStart)
-                    || !GetAttributeValue(pChannelNode, "stop", strStop))
-                    continue;
-                
-                int iTmpStart = ParseDateTime(strStart);
-                int iTmpEnd = ParseDateTime(strStop);
-                
-                EpgEntry entry;
-                entry.iChannelId = PatchChannelId(strId);
-                entry.startTime = iTmpStart;
-                entry.endTime = iTmpEnd;
-                
-                GetNodeValue(pChannelNode, "title", entry.strTitle);
-                GetNodeValue(pChannelNode, "desc", entry.strPlot);
-                
-                onEpgEntryFound(entry);
-
-            } catch (...) {
-                LogError("Bad XML EPG entry.");
-            }
+        // Remember that current cached copy was parsed
+        const std::string cachedPath = GetCachedPathFor(url);
+        CacheInfo info;
+        if(LoadCacheInfo(cachedPath, info) && !info.isEpgParsed) {
+            info.isEpgParsed = true;
+            SaveCacheInfo(cachedPath, info);
         }
         
-        xmlDoc.doc.clear();
-        
         XBMC->Log(LOG_NOTICE, "XMLTV: EPG loaded.");
         
         return true;
     }
     
+    bool ParseEpg(const std::string& url,  const EpgEntryCallback& onEpgEntryFound)
+    {
+        return ParseEpg(url, onEpgEntryFound, false);
+    }
+    
+    bool ParseEpgIfModified(const std::string& url,  const EpgEntryCallback& onEpgEntryFound)
+    {
+        if(url.empty())
+            return ParseEpg(url, onEpgEntryFound, false);
+        
+        CacheInfo info;
+        if(!RefreshCachedFile(url, GetCachedPathFor(url), info)) {
+            XBMC->Log(LOG_ERROR, "Unable to load EPG file '%s':  file is missing or empty.", url.c_str());
+            return false;
+        }
+        if(info.isEpgParsed) {
+            XBMC->Log(LOG_NOTICE, "XMLTV: EPG is not modified. Loading skipped.");
+            return false;
+        }
+        // Parse just refreshed copy, no second revalidation request
+        return ParseEpg(url, onEpgEntryFound, true);
+    }
+    
 }
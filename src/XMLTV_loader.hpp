@@ -32,6 +32,7 @@
 #include <string>
 #include <functional>
 #include "pvr_client_types.h"
+#include "XMLTV_datetime.hpp"
 
 namespace XMLTV {
   
@@ -56,11 +57,16 @@ namespace XMLTV {
 
     bool ParseChannels(const std::string& url,  const ChannelCallback& onChannelFound);
     bool ParseEpg(const std::string& url,  const EpgEntryCallback& onEpgEntryFound);
+    // Same as ParseEpg(), but parsing is skipped when the document
+    // was not modified since last successful ParseEpg() call.
+    // Returns true only when EPG entries were reported.
+    bool ParseEpgIfModified(const std::string& url,  const EpgEntryCallback& onEpgEntryFound);
    
-    long LocalTimeOffset();
     bool IsDataCompressed(const std::string& data);
     bool GzipInflate( const std::string& compressedBytes, std::string& uncompressedBytes);
     int GetCachedFileContents(const std::string &filePath, std::string &strContents);
+    // Same as GetCachedFileContents(), but gzip packed file is inflated on the fly
+    int GetInflatedCachedFileContents(const std::string &filePath, std::string &strContents);
     std::string GetCachedFilePath(const std::string &filePath);
 }
 
@@ -81,6 +81,7 @@ public:
     virtual long long SeekRecordedStream(long long iPosition, int iWhence /* = SEEK_SET */) = 0;
     virtual long long PositionRecordedStream(void) = 0;
     virtual long long LengthRecordedStream(void) = 0;
+    virtual PVR_ERROR GetStreamTimes(PVR_STREAM_TIMES* times) = 0;
     virtual PVR_ERROR IsEPGTagRecordable(const EPG_TAG* tag, bool* bIsRecordable) = 0;
 
     virtual PVR_ERROR CallMenuHook(const PVR_MENUHOOK &menuhook, const PVR_MENUHOOK_DATA &item) = 0;
@@ -21,6 +21,7 @@
  */
 
 #include <algorithm>
+#include <limits>
 #include <rapidjson/error/en.h>
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
@@ -28,10 +29,12 @@
 #include "p8-platform/util/StringUtils.h"
 #include "p8-platform/threads/mutex.h"
 #include "p8-platform/util/util.h"
+#include "p8-platform/util/timeutils.h"
 
 #include "client_core_base.hpp"
 #include "globals.hpp"
 #include "HttpEngine.hpp"
+#include "TraceRecorder.hpp"
 #include "helpers.h"
 
 
@@ -43,6 +46,9 @@ namespace PvrClient{
     using namespace Globals;
     
     static const char* c_EpgCacheDirPath = "special://temp/pvr-puzzle-tv";
+    static const char* c_ApiTraceFile = "api_trace.json";
+    // Version 2: "k" is the hashed broadcast ID (see MakeBroadcastId)
+    static const int c_EpgCacheVersion = 2;
     
     template< typename ContainerT, typename PredicateT >
     void erase_if( ContainerT& items, const PredicateT& predicate ) {
@@ -131,6 +137,7 @@ namespace PvrClient{
     , m_groupList(m_mutableGroupList)
     , m_channelList(m_mutableChannelList)
     , m_lastEpgRequestEndTime(0)
+    , m_archiveHash(0)
     , m_rpcPort(8080)
     {
         if(nullptr == m_didRecordingsUpadate) {
@@ -183,6 +190,8 @@ namespace PvrClient{
         }
         P8PLATFORM::CLockObject lock(m_epgAccessMutex);
         m_epgEntries.clear();
+        m_channelEpgIndex.clear();
+        m_epgCoverage.clear();
     };
     
 #pragma mark - Channels & Groups
@@ -222,6 +231,79 @@ namespace PvrClient{
     }
     
 #pragma mark - EPG
+    const time_t ClientCoreBase::c_UnlimitedArchiveDepth = std::numeric_limits<time_t>::max();
+    // Gaps between EPG entries shorter than this are not missing EPG
+    static const time_t c_EpgCoverageGap = 60 * 60;
+    // Requested but missing EPG may be requested again after
+    static const uint32_t c_RequestedEpgExpiration = 12 * 60 * 60 * 1000;
+    
+    void TimeIntervals::Add(time_t start, time_t end, time_t mergeGap)
+    {
+        if(end <= start)
+            return;
+        auto it = m_intervals.upper_bound(start);
+        if(it != m_intervals.begin()) {
+            auto prev = it;
+            if((--prev)->second + mergeGap >= start)
+                it = prev;
+        }
+        while(it != m_intervals.end() && it->first <= end + mergeGap) {
+            start = std::min(start, it->first);
+            end = std::max(end, it->second);
+            it = m_intervals.erase(it);
+        }
+        m_intervals.emplace_hint(it, start, end);
+    }
+    
+    void TimeIntervals::GetMissing(time_t start, time_t end, Windows& missing) const
+    {
+        auto it = m_intervals.upper_bound(start);
+        if(it != m_intervals.begin())
+            --it;
+        for(; it != m_intervals.end() && it->first < end && start < end; ++it) {
+            if(it->second <= start)
+                continue;
+            if(it->first > start)
+                missing.push_back(std::make_pair(start, it->first));
+            start = std::max(start, it->second);
+        }
+        if(start < end)
+            missing.push_back(std::make_pair(start, end));
+    }
+    
+    void RequestedWindows::Add(time_t start, time_t end, int64_t expiresAtMs)
+    {
+        if(end <= start)
+            return;
+        for(auto& window : m_windows) {
+            if(window.start == start && window.end == end) {
+                window.expiresAtMs = expiresAtMs;
+                return;
+            }
+        }
+        Window window = {start, end, expiresAtMs};
+        m_windows.push_back(window);
+    }
+    
+    void RequestedWindows::Remove(time_t start, time_t end)
+    {
+        m_windows.erase(std::remove_if(m_windows.begin(), m_windows.end(), [start, end](const Window& window) {
+            return window.start < end && start < window.end;
+        }), m_windows.end());
+    }
+    
+    void RequestedWindows::GetMissing(time_t start, time_t end, int64_t nowMs, TimeIntervals::Windows& missing)
+    {
+        m_windows.erase(std::remove_if(m_windows.begin(), m_windows.end(), [nowMs](const Window& window) {
+            return window.expiresAtMs <= nowMs;
+        }), m_windows.end());
+        // Few windows are requested at once
+        TimeIntervals requested;
+        for(const auto& window : m_windows)
+            requested.Add(window.start, window.end);
+        requested.GetMissing(start, end, missing);
+    }
+    
     string ClientCoreBase::MakeEpgCachePath(const char* cacheFile)
     {
         return string(c_EpgCacheDirPath) + "/" + cacheFile;
@@ -252,34 +334,57 @@ namespace PvrClient{
         return true;
     }
     
-    void ClientCoreBase::LoadEpgCache(const char* cacheFile)
+    bool ClientCoreBase::LoadEpgCache(const char* cacheFile)
     {
         string cacheFilePath = MakeEpgCachePath(cacheFile);
         
         string ss;
         if(!ReadFileContent(cacheFilePath.c_str(), ss))
-            return;
+            return false;
         
+        bool isLoaded = false;
         try {
             ParseJson(ss, [&] (Document& jsonRoot) {
                 
+                // Older caches keep start time as "k". Their IDs are recalculated.
+                const bool isHashedId = jsonRoot.HasMember("version") && jsonRoot["version"].GetInt() == c_EpgCacheVersion;
                 const Value& v = jsonRoot["m_epgEntries"];
+                EpgEntryBatch batch;
+                batch.reserve(v.Size());
                 Value::ConstValueIterator it = v.Begin();
                 for(; it != v.End(); ++it)
                 {
-                    EpgEntryList::key_type k = (*it)["k"].GetInt64();
                     EpgEntryList::mapped_type e;
                     e.Deserialize((*it)["v"]);
                     m_lastEpgRequestEndTime = std::max(m_lastEpgRequestEndTime, e.EndTime);
-                    AddEpgEntry(k,e);
+                    const UniqueBroadcastIdType hashedId = MakeBroadcastId(e.ChannelId, e.StartTime);
+                    UniqueBroadcastIdType id = hashedId;
+                    if(isHashedId) {
+                        id = (*it)["k"].GetUint();
+                        // Restore collision table, so fresh EPG gets the same IDs
+                        if(id != hashedId) {
+                            P8PLATFORM::CLockObject lock(m_epgAccessMutex);
+                            m_broadcastIdCollisions[std::make_pair(e.ChannelId, e.StartTime)] = id;
+                        }
+                    }
+                    batch.push_back(EpgEntryBatch::value_type(id, e));
                 }
+                isLoaded = AddEpgEntries(batch) > 0;
             });
+            // Recordings of cached EPG are available before the first EPG update
+            if(isLoaded)
+                UpdateArchiveDepths();
             
         } catch (...) {
             LogError(" >>>>  FAILED load EPG cache <<<<<");
             m_epgEntries.clear();
+            m_broadcastIdCollisions.clear();
+            m_channelEpgIndex.clear();
+            m_epgCoverage.clear();
             m_lastEpgRequestEndTime = 0;
+            isLoaded = false;
         }
+        return isLoaded;
     }
     
     void ClientCoreBase::SaveEpgCache(const char* cacheFile, unsigned int daysToPreserve)
@@ -297,11 +402,19 @@ namespace PvrClient{
                      {
                          return i.second.StartTime < oldest;
                      });
+            erase_if(m_broadcastIdCollisions,  [oldest] (const decltype(m_broadcastIdCollisions)::value_type& i)
+                     {
+                         return i.first.second < oldest;
+                     });
+            for(auto& channel : m_channelEpgIndex)
+                channel.second.erase(channel.second.begin(), channel.second.lower_bound(oldest));
             
             Writer<StringBuffer> writer(s);
             
             writer.StartObject();               // Between StartObject()/EndObject(),
             
+            writer.Key("version");
+            writer.Int(c_EpgCacheVersion);
             writer.Key("m_epgEntries");
             writer.StartArray();                // Between StartArray()/EndArray(),
             for_each(m_epgEntries.begin(), m_epgEntries.end(),[&](const EpgEntryList::value_type& i) {
@@ -327,34 +440,129 @@ namespace PvrClient{
         
     }
     
-    UniqueBroadcastIdType ClientCoreBase::AddEpgEntry(UniqueBroadcastIdType id, EpgEntry& entry)
+    UniqueBroadcastIdType ClientCoreBase::MakeBroadcastId(ChannelId channelId, time_t startTime)
+    {
+        // 64-bit mix (splitmix64 finalizer) of channel and start time
+        uint64_t h = (uint64_t(channelId) << 32) ^ uint64_t(uint32_t(startTime));
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+        h ^= h >> 31;
+        // Fold to positive 31-bit ID. Zero is reserved.
+        UniqueBroadcastIdType id = UniqueBroadcastIdType((h ^ (h >> 32)) & 0x7FFFFFFF);
+        return id == 0 ? 1 : id;
+    }
+    
+    static bool IsSameBroadcast(const EpgEntry& e1, const EpgEntry& e2)
+    {
+        return e1.ChannelId == e2.ChannelId && e1.StartTime == e2.StartTime;
+    }
+    
+    EpgEntryList::iterator ClientCoreBase::FindEpgEntrySlot(UniqueBroadcastIdType& id, const EpgEntry& entry)
+    {
+        auto it = m_epgEntries.lower_bound(id);
+        if(it != m_epgEntries.end() && it->first == id && IsSameBroadcast(it->second, entry))
+            return it;
+        
+        // Rare case: hash collision. Use ID from the side table,
+        // also when the colliding broadcast is already gone from the store.
+        const auto key = std::make_pair(entry.ChannelId, entry.StartTime);
+        if(!m_broadcastIdCollisions.empty()) {
+            auto known = m_broadcastIdCollisions.find(key);
+            if(known != m_broadcastIdCollisions.end() && known->second != id) {
+                id = known->second;
+                it = m_epgEntries.lower_bound(id);
+            }
+        }
+        if(it == m_epgEntries.end() || it->first != id || IsSameBroadcast(it->second, entry))
+            return it;
+        
+        // Find free ID for a new colliding broadcast
+        // (or when the side table ID is occupied meanwhile).
+        while(it != m_epgEntries.end() && it->first == id && !IsSameBroadcast(it->second, entry)) {
+            id = (id + 1) & 0x7FFFFFFF;
+            if(id == 0)
+                id = 1;
+            it = m_epgEntries.lower_bound(id);
+        }
+        m_broadcastIdCollisions[key] = id;
+        return it;
+    }
+    
+    UniqueBroadcastIdType ClientCoreBase::AddEpgEntry(EpgEntry& entry)
     {
         // Do not add EPG for unknown channels
         if(m_mutableChannelList.count(entry.ChannelId) != 1)
             return c_UniqueBroadcastIdUnknown;
         
-        UpdateHasArchive(entry);
-        
+        UniqueBroadcastIdType id = MakeBroadcastId(entry.ChannelId, entry.StartTime);
         P8PLATFORM::CLockObject lock(m_epgAccessMutex);
-        while(m_epgEntries.count(id) != 0) {
-            // Check duplicates.
-            if(m_epgEntries[id].ChannelId == entry.ChannelId)
-                return false;
-            ++id;
-        }
-        m_epgEntries[id] =  entry;
+        auto it = FindEpgEntrySlot(id, entry);
+        // Check duplicates.
+        if(it != m_epgEntries.end() && it->first == id)
+            return c_UniqueBroadcastIdUnknown;
+        m_epgEntries.emplace_hint(it, id, entry);
+        m_channelEpgIndex[entry.ChannelId][entry.StartTime] = id;
+        m_epgCoverage[entry.ChannelId].Add(entry.StartTime, entry.EndTime, c_EpgCoverageGap);
         return id;
     }
     
+    unsigned int ClientCoreBase::AddEpgEntries(EpgEntryBatch& batch)
+    {
+        // Do not add EPG for unknown channels
+        auto end = std::remove_if(batch.begin(), batch.end(), [this](const EpgEntryBatch::value_type& i) {
+            return m_mutableChannelList.count(i.second.ChannelId) != 1;
+        });
+        batch.erase(end, batch.end());
+        
+        // Sorted batch makes store lookups local.
+        // Keep original order of entries with same ID to resolve collisions like AddEpgEntry() does
+        std::stable_sort(batch.begin(), batch.end(), [](const EpgEntryBatch::value_type& a, const EpgEntryBatch::value_type& b) {
+            return a.first < b.first;
+        });
+        
+        unsigned int added = 0;
+        {
+            P8PLATFORM::CLockObject lock(m_epgAccessMutex);
+            for(auto& i : batch) {
+                UniqueBroadcastIdType id = i.first;
+                auto it = FindEpgEntrySlot(id, i.second);
+                // Check duplicates.
+                if(it != m_epgEntries.end() && it->first == id)
+                    continue;
+                auto newEntry = m_epgEntries.emplace_hint(it, id, std::move(i.second));
+                m_channelEpgIndex[newEntry->second.ChannelId][newEntry->second.StartTime] = id;
+                m_epgCoverage[newEntry->second.ChannelId].Add(newEntry->second.StartTime, newEntry->second.EndTime, c_EpgCoverageGap);
+                ++added;
+            }
+        }
+        batch.clear();
+        return added;
+    }
+    
+    void ClientCoreBase::AddEpgEntry(EpgEntry& entry, EpgEntryBatch& batch)
+    {
+        static const size_t c_EpgBatchSize = 10000;
+        
+        batch.push_back(EpgEntryBatch::value_type(MakeBroadcastId(entry.ChannelId, entry.StartTime), entry));
+        if(batch.size() >= c_EpgBatchSize)
+            AddEpgEntries(batch);
+    }
+    
     void ClientCoreBase::UpdateEpgEntry(UniqueBroadcastIdType id, const EpgEntry& entry)
     {
         EPG_TAG tag = { 0 };
         {
             P8PLATFORM::CLockObject lock(m_epgAccessMutex);
-            auto & oldEntry = m_epgEntries[id];
-            bool hasArchive = oldEntry.HasArchive;
-            oldEntry =  entry;
-            oldEntry.HasArchive = hasArchive;
+            auto oldEntry = m_epgEntries.find(id);
+            if(oldEntry != m_epgEntries.end()) {
+                // Remove outdated index of the entry
+                if(oldEntry->second.ChannelId != entry.ChannelId || oldEntry->second.StartTime != entry.StartTime)
+                    m_channelEpgIndex[oldEntry->second.ChannelId].erase(oldEntry->second.StartTime);
+                oldEntry->second = entry;
+            } else {
+                m_epgEntries[id] = entry;
+            }
+            m_channelEpgIndex[entry.ChannelId][entry.StartTime] = id;
             
             // Update EPG tag
             tag.iUniqueBroadcastId = id;
@@ -367,10 +575,25 @@ namespace PvrClient{
     bool ClientCoreBase::GetEpgEntry(UniqueBroadcastIdType i,  EpgEntry& entry)
     {
         P8PLATFORM::CLockObject lock(m_epgAccessMutex);
-        bool result = m_epgEntries.count(i) > 0;
-        if(result)
-            entry = m_epgEntries[i];
-        return result;
+        auto it = m_epgEntries.find(i);
+        if(it == m_epgEntries.end())
+            return false;
+        entry = it->second;
+        return true;
+    }
+    
+    bool ClientCoreBase::GetLastEpgEntry(ChannelId channelId, UniqueBroadcastIdType& id, EpgEntry& entry)
+    {
+        P8PLATFORM::CLockObject lock(m_epgAccessMutex);
+        auto index = m_channelEpgIndex.find(channelId);
+        if(index == m_channelEpgIndex.end() || index->second.empty())
+            return false;
+        auto it = m_epgEntries.find(index->second.rbegin()->second);
+        if(it == m_epgEntries.end())
+            return false;
+        id = it->first;
+        entry = it->second;
+        return true;
     }
     
     void ClientCoreBase::ForEachEpg(const EpgEntryAction& action) const
@@ -382,49 +605,133 @@ namespace PvrClient{
         }
     }
     
+    void ClientCoreBase::ForEachArchiveEntry(const EpgEntryAction& action) const
+    {
+        // Longest programme to look back for when archive is defined by end time
+        static const time_t c_MaxProgrammeDuration = 24 * 60 * 60;
+        
+        const time_t now = time(nullptr);
+        P8PLATFORM::CLockObject lock(m_epgAccessMutex);
+        for(const auto& channel : m_channelEpgIndex) {
+            auto depth = m_archiveDepths.find(channel.first);
+            if(depth == m_archiveDepths.end() || depth->second <= 0)
+                continue;
+            const time_t from = depth->second >= now ? 0 : now - depth->second;
+            const ChannelEpgIndex& index = channel.second;
+            // Range of start times, then filter by archive time.
+            auto it = index.lower_bound(m_addCurrentEpgToArchive || from < c_MaxProgrammeDuration ? from : from - c_MaxProgrammeDuration);
+            const auto end = index.lower_bound(now);
+            for(; it != end; ++it) {
+                const auto found = m_epgEntries.find(it->second);
+                if(found == m_epgEntries.end())
+                    continue;
+                const auto& entry = *found;
+                const time_t epgTime = m_addCurrentEpgToArchive ? entry.second.StartTime : entry.second.EndTime;
+                if(epgTime < from || epgTime >= now)
+                    continue;
+                if(!action(entry))
+                    return;
+            }
+        }
+    }
+    
     void ClientCoreBase::GetEpg(ChannelId channelId, time_t startTime, time_t endTime, EpgEntryList& epgEntries)
     {
-        time_t lastEndTime = startTime;
-        IClientCore::EpgEntryAction action = [&lastEndTime, &epgEntries, channelId, startTime, endTime] (const EpgEntryList::value_type& i)
         {
-            auto entryStartTime = i.second.StartTime;
-            if (i.second.ChannelId == channelId  &&
-                entryStartTime >= startTime &&
-                entryStartTime < endTime)
-            {
-                lastEndTime = i.second.EndTime;
-                epgEntries.insert(i);
+            P8PLATFORM::CLockObject lock(m_epgAccessMutex);
+            auto index = m_channelEpgIndex.find(channelId);
+            if(index != m_channelEpgIndex.end()) {
+                auto it = index->second.lower_bound(startTime);
+                const auto end = index->second.lower_bound(endTime);
+                for(; it != end; ++it) {
+                    const auto found = m_epgEntries.find(it->second);
+                    if(found != m_epgEntries.end())
+                        epgEntries.insert(*found);
+                }
             }
-            return true;
-        };
-        ForEachEpg(action);
+        }
         
-        if(lastEndTime < endTime) {
+        TimeIntervals::Windows missing;
+        GetMissingEpg(channelId, startTime, endTime, missing);
+        if(!missing.empty()) {
             
-            LogDebug("GetEPG(%d): last for channel (or start) %s -> requested by Kodi %s",
-                     channelId, time_t_to_string(lastEndTime).c_str(), time_t_to_string(endTime).c_str());
+            LogDebug("GetEPG(%d): missing %d window(s) from %s to %s",
+                     channelId, (int)missing.size(), time_t_to_string(missing.front().first).c_str(), time_t_to_string(missing.back().second).c_str());
             
-           // auto epgRequestStart = max(lastEndTime, m_lastEpgRequestEndTime);
-            
-     //       if(endTime > epgRequestStart) {
-                // First EPG loading may be long. Delay recordings update for 90 sec
-                m_recordingsUpdateDelay.Init(90 * 1000);
-                _UpdateEpgForAllChannels(/*epgRequestStart*/lastEndTime, endTime);
-
-                //LogDebug("GetEPG(): m_lastEpgRequestEndTime (after) = %s", time_t_to_string(m_lastEpgRequestEndTime).c_str());
-//            }
+            // First EPG loading may be long. Delay recordings update for 90 sec
+            m_recordingsUpdateDelay.Init(90 * 1000);
+            if(CanUpdateEpgForChannel()) {
+                // Request missing windows of this channel only
+                for(const auto& window : missing) {
+                    SetEpgRequested(channelId, window.first, window.second);
+                    UpdateEpgForChannel(channelId, window.first, window.second);
+                }
+            } else {
+                _UpdateEpgForAllChannels(missing.front().first, missing.back().second);
+            }
         }
         m_recordingsUpdateDelay.Init(5 * 1000);
         //ScheduleRecordingsUpdate();
     }
-    void ClientCoreBase::_UpdateEpgForAllChannels(time_t startTime, time_t endTime)
+    
+    void ClientCoreBase::GetMissingEpg(ChannelId channelId, time_t startTime, time_t endTime, TimeIntervals::Windows& missing)
+    {
+        TimeIntervals::Windows notLoaded;
+        {
+            P8PLATFORM::CLockObject lock(m_epgAccessMutex);
+            auto coverage = m_epgCoverage.find(channelId);
+            if(coverage != m_epgCoverage.end())
+                coverage->second.GetMissing(startTime, endTime, notLoaded);
+            else if(startTime < endTime)
+                notLoaded.push_back(std::make_pair(startTime, endTime));
+        }
+        
+        P8PLATFORM::CLockObject lock(m_epgRequestsMutex);
+        const int64_t now = P8PLATFORM::GetTimeMs();
+        auto requested = m_requestedChannelEpg.find(channelId);
+        for(const auto& window : notLoaded) {
+            TimeIntervals::Windows notRequested;
+            m_requestedEpg.GetMissing(window.first, window.second, now, notRequested);
+            for(const auto& w : notRequested) {
+                if(requested != m_requestedChannelEpg.end())
+                    requested->second.GetMissing(w.first, w.second, now, missing);
+                else
+                    missing.push_back(w);
+            }
+        }
+    }
+    
+    void ClientCoreBase::SetEpgRequested(ChannelId channelId, time_t startTime, time_t endTime)
+    {
+        P8PLATFORM::CLockObject lock(m_epgRequestsMutex);
+        const int64_t expiresAt = P8PLATFORM::GetTimeMs() + c_RequestedEpgExpiration;
+        if(UnknownChannelId == channelId)
+            m_requestedEpg.Add(startTime, endTime, expiresAt);
+        else
+            m_requestedChannelEpg[channelId].Add(startTime, endTime, expiresAt);
+    }
+    
+    void ClientCoreBase::OnEpgRequestFailed(ChannelId channelId, time_t startTime, time_t endTime)
+    {
+        P8PLATFORM::CLockObject lock(m_epgRequestsMutex);
+        if(UnknownChannelId != channelId) {
+            auto requested = m_requestedChannelEpg.find(channelId);
+            if(requested != m_requestedChannelEpg.end())
+                requested->second.Remove(startTime, endTime);
+        }
+        // Channel request may be a part of all channels update.
+        // Loaded channels are excluded by EPG coverage anyway.
+        m_requestedEpg.Remove(startTime, endTime);
+    }
+    
+    bool ClientCoreBase::_UpdateEpgForAllChannels(time_t startTime, time_t endTime)
     {
         if(/*endTime <= m_lastEpgRequestEndTime || */endTime <= startTime)
-            return;
+            return false;
         
         if(m_epgUpdateInterval.IsSet() && m_epgUpdateInterval.TimeLeft() > 0){
             LogDebug("Can update EPG after %d sec",  m_epgUpdateInterval.TimeLeft()/1000);
-            return;
+            return false;
         }
         
 //        startTime = std::max(startTime, m_lastEpgRequestEndTime);
@@ -438,7 +745,14 @@ namespace PvrClient{
             }
         }
         
-        UpdateEpgForAllChannels(startTime, endTime);
+        SetEpgRequested(UnknownChannelId, startTime, endTime);
+        try {
+            UpdateEpgForAllChannels(startTime, endTime);
+        } catch (...) {
+            OnEpgRequestFailed(UnknownChannelId, startTime, endTime);
+            throw;
+        }
+        return true;
     }
     
 #pragma  mark - Recordings
@@ -459,22 +773,33 @@ namespace PvrClient{
     void ClientCoreBase::OnEpgUpdateDone()
     {
         LogNotice("Archive thread iteraton started");
-        // Localize EPG lock
-        {
-            P8PLATFORM::CLockObject lock(m_epgAccessMutex);
-            LogDebug("Archive thread: EPG size %d", m_epgEntries.size());
-            int recCounter = 0;
-            for(auto& i : m_epgEntries) {
-                UpdateHasArchive(i.second);
-                if(i.second.HasArchive)
-                    ++recCounter;
-            }
-            LogDebug("Archive thread: Recordings size %d", recCounter);
-        }
-        if(m_didRecordingsUpadate)
+        UpdateArchiveDepths();
+        int recCounter = 0;
+        uint64_t archiveHash = c_HashInitialValue;
+        ForEachArchiveEntry([&recCounter, &archiveHash] (const EpgEntryList::value_type& i) {
+            ++recCounter;
+            archiveHash = hash_combine(hash_combine(archiveHash, i.first), i.second.EndTime);
+            return true;
+        });
+        LogDebug("Archive thread: Recordings size %d", recCounter);
+        const bool isArchiveChanged = archiveHash != m_archiveHash;
+        m_archiveHash = archiveHash;
+        if(m_didRecordingsUpadate && isArchiveChanged)
             m_didRecordingsUpadate();
+        // Latest API request timings, open in chrome://tracing
+        Tracing::TraceRecorder::Shared().Dump(string(c_EpgCacheDirPath) + "/" + c_ApiTraceFile);
         LogNotice("Archive thread iteraton done");
     }
+    
+    void ClientCoreBase::UpdateArchiveDepths()
+    {
+        P8PLATFORM::CLockObject lock(m_epgAccessMutex);
+        LogDebug("Archive thread: EPG size %d", m_epgEntries.size());
+        m_archiveDepths.clear();
+        for(const auto& channel : m_channelList)
+            m_archiveDepths[channel.first] = GetArchiveDepth(channel.first);
+    }
+    
     void ClientCoreBase::ReloadRecordings()
     {
         OnEpgUpdateDone();
@@ -484,22 +809,27 @@ namespace PvrClient{
     void ClientCoreBase::ParseJson(const std::string& response, std::function<void(Document&)> parser)
     {
         Document jsonRoot;
-        jsonRoot.Parse(response.c_str());
-        if(jsonRoot.HasParseError()) {
-            
-            ParseErrorCode error = jsonRoot.GetParseError();
-            auto strError = string("Rapid JSON parse error: ");
-            strError += GetParseError_En(error);
-            strError += " (" ;
-            strError += n_to_string(error);
-            strError += ").";
-            LogError(strError.c_str());
-            throw JsonParserException(strError);
+        {
+            Tracing::ScopedSpan span("json", "api");
+            jsonRoot.Parse(response.c_str());
         }
+        if(jsonRoot.HasParseError())
+            ThrowJsonParserError(jsonRoot.GetParseError());
         parser(jsonRoot);
         return;
     }
     
+    void ClientCoreBase::ThrowJsonParserError(ParseErrorCode error)
+    {
+        auto strError = string("Rapid JSON parse error: ");
+        strError += GetParseError_En(error);
+        strError += " (" ;
+        strError += n_to_string(error);
+        strError += ").";
+        LogError(strError.c_str());
+        throw JsonParserException(strError);
+    }
+    
     void ClientCoreBase::CallRpcAsync(const std::string & data,
                                       std::function<void(rapidjson::Document&)>  parser,
                                       ActionQueue::TCompletion completion)
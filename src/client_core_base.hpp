@@ -25,14 +25,59 @@
 
 #include "pvr_client_types.h"
 #include <rapidjson/document.h>
+#include <rapidjson/reader.h>
 #include "ActionQueueTypes.hpp"
 #include <functional>
+#include <vector>
 #include "globals.hpp"
 
 class HttpEngine;
 
 namespace PvrClient {
     
+    // API response parser which receives response body as is,
+    // e.g. streaming (SAX) parser of huge JSON responses.
+    struct RawResponseParser
+    {
+        typedef std::function<void(const std::string&)> TParse;
+        RawResponseParser(const TParse& p) : parse(p) {}
+        TParse parse;
+    };
+    
+    // Set of non-overlapping [start, end) time intervals
+    class TimeIntervals
+    {
+    public:
+        typedef std::vector<std::pair<time_t, time_t> > Windows;
+        // Intervals closer than mergeGap are merged
+        void Add(time_t start, time_t end, time_t mergeGap = 0);
+        // Appends parts of [start, end) not covered by the set
+        void GetMissing(time_t start, time_t end, Windows& missing) const;
+        void Clear() {m_intervals.clear();}
+    private:
+        std::map<time_t, time_t> m_intervals;
+    };
+    
+    // Recently requested time windows. Every window expires separately.
+    class RequestedWindows
+    {
+    public:
+        void Add(time_t start, time_t end, int64_t expiresAtMs);
+        // Removes windows overlapping [start, end)
+        void Remove(time_t start, time_t end);
+        // Drops windows expired before nowMs, then
+        // appends parts of [start, end) not requested
+        void GetMissing(time_t start, time_t end, int64_t nowMs, TimeIntervals::Windows& missing);
+    private:
+        struct Window
+        {
+            time_t start;
+            time_t end;
+            int64_t expiresAtMs;
+        };
+        std::vector<Window> m_windows;
+    };
+    
     class ClientPhase;
     class ClientCoreBase :  public IClientCore
     {
@@ -50,7 +95,10 @@ namespace PvrClient {
         void ReloadRecordings();
         
         bool GetEpgEntry(UniqueBroadcastIdType i,  EpgEntry& enrty);
+        // Latest (by start time) EPG entry of the channel
+        bool GetLastEpgEntry(ChannelId channelId, UniqueBroadcastIdType& id, EpgEntry& entry);
         void ForEachEpg(const EpgEntryAction& action) const;
+        void ForEachArchiveEntry(const EpgEntryAction& action) const;
         void GetEpg(ChannelId channelId, time_t startTime, time_t endTime, EpgEntryList& epgEntries);
         
         void SetRpcPort(int port) {m_rpcPort = port;}
@@ -71,9 +119,22 @@ namespace PvrClient {
 
         static std::string MakeEpgCachePath(const char* cacheFile);
         void ClearEpgCache(const char* cacheFile);
-        void LoadEpgCache(const char* cacheFile);
+        // Returns true when EPG entries were loaded from the cache
+        bool LoadEpgCache(const char* cacheFile);
         void SaveEpgCache(const char* cacheFile, unsigned int daysToPreserve = 7);
-        UniqueBroadcastIdType AddEpgEntry(UniqueBroadcastIdType id, EpgEntry& entry);
+        // Deterministic broadcast ID of (channel, start time) pair.
+        // Positive 31-bit value, since Kodi DB stores IDs as signed int.
+        static UniqueBroadcastIdType MakeBroadcastId(ChannelId channelId, time_t startTime);
+        // Returns ID of added entry or c_UniqueBroadcastIdUnknown
+        // for unknown channel or duplicate (same channel and start time).
+        UniqueBroadcastIdType AddEpgEntry(EpgEntry& entry);
+        typedef std::vector<std::pair<UniqueBroadcastIdType, EpgEntry> > EpgEntryBatch;
+        // Adds EPG entries to the store under single lock.
+        // Entries of unknown channels and duplicates are skipped.
+        // The batch is consumed. Returns amount of added entries.
+        unsigned int AddEpgEntries(EpgEntryBatch& batch);
+        // Appends entry to the batch. Full batch is flushed to the store.
+        void AddEpgEntry(EpgEntry& entry, EpgEntryBatch& batch);
         void UpdateEpgEntry(UniqueBroadcastIdType id, const EpgEntry& entry);
 
         // Channel & group lists
@@ -83,11 +144,33 @@ namespace PvrClient {
         
 
         void ParseJson(const std::string& response, std::function<void(rapidjson::Document&)> parser);
+        // Streaming (SAX) parsing of JSON response without building DOM.
+        // THandler should implement rapidjson Handler concept.
+        template <typename THandler>
+        static void ParseJsonSax(const std::string& response, THandler& handler)
+        {
+            rapidjson::Reader reader;
+            rapidjson::StringStream stream(response.c_str());
+            rapidjson::ParseResult result = reader.Parse(stream, handler);
+            if(result.IsError())
+                ThrowJsonParserError(result.Code());
+        }
+        static void ThrowJsonParserError(rapidjson::ParseErrorCode error);
         
         
         // Required methods to implement for derived classes
         virtual void Init(bool clearEpgCache) = 0;
-        virtual void UpdateHasArchive(PvrClient::EpgEntry& entry) = 0;
+        // Archive depth of the channel in seconds, 0 when channel has no archive.
+        virtual time_t GetArchiveDepth(ChannelId channelId) const = 0;
+        static const time_t c_UnlimitedArchiveDepth;
+        // Providers able to request EPG of single channel for a time window
+        // should return true and implement UpdateEpgForChannel().
+        // Otherwise missing EPG is requested by UpdateEpgForAllChannels().
+        virtual bool CanUpdateEpgForChannel() const {return false;}
+        virtual void UpdateEpgForChannel(ChannelId, time_t, time_t) {}
+        // Failed EPG request of the window may be repeated on next GetEpg().
+        // UnknownChannelId is for requests of all channels.
+        void OnEpgRequestFailed(ChannelId channelId, time_t startTime, time_t endTime);
         // Do not call directly, only through RebuildChannelAndGroupList()
         virtual void BuildChannelAndGroupList() = 0;
 
@@ -101,8 +184,19 @@ namespace PvrClient {
         
         // Recordings
         void OnEpgUpdateDone();
+        // Archive depth of every channel for ForEachArchiveEntry()
+        void UpdateArchiveDepths();
         void ScheduleRecordingsUpdate();
-        void _UpdateEpgForAllChannels(time_t startTime, time_t endTime);
+        // Returns false when update is postponed
+        bool _UpdateEpgForAllChannels(time_t startTime, time_t endTime);
+        // Parts of the window neither loaded nor requested recently
+        void GetMissingEpg(ChannelId channelId, time_t startTime, time_t endTime, TimeIntervals::Windows& missing);
+        // UnknownChannelId marks the window requested for all channels
+        void SetEpgRequested(ChannelId channelId, time_t startTime, time_t endTime);
+        // Should be called under m_epgAccessMutex lock.
+        // Returns lower bound of entry's ID in the store. Points to the same
+        // broadcast for duplicates. ID is changed when another broadcast owns it.
+        EpgEntryList::iterator FindEpgEntrySlot(UniqueBroadcastIdType& id, const EpgEntry& entry);
 
 
         PvrClient::ChannelList m_mutableChannelList;
@@ -110,11 +204,29 @@ namespace PvrClient {
         
         PvrClient::EpgEntryList m_epgEntries;
         mutable P8PLATFORM::CMutex m_epgAccessMutex;
+        // IDs of broadcasts which hash collides with another broadcast.
+        // Persisted with the EPG cache as stored entry IDs.
+        std::map<std::pair<ChannelId, time_t>, UniqueBroadcastIdType> m_broadcastIdCollisions;
+        // EPG IDs per channel ordered by start time
+        typedef std::map<time_t, UniqueBroadcastIdType> ChannelEpgIndex;
+        std::map<ChannelId, ChannelEpgIndex> m_channelEpgIndex;
+        // Archive depth per channel. Updated on each archive iteration.
+        std::map<ChannelId, time_t> m_archiveDepths;
+        // Time covered by loaded EPG entries per channel
+        std::map<ChannelId, TimeIntervals> m_epgCoverage;
+        
+        // Requested EPG windows per channel and for all channels.
+        // Expire to retry EPG which was missing on server.
+        std::map<ChannelId, RequestedWindows> m_requestedChannelEpg;
+        RequestedWindows m_requestedEpg;
+        P8PLATFORM::CMutex m_epgRequestsMutex;
         
         RecordingsDelegate m_didRecordingsUpadate;
         std::map<IClientCore::Phase, ClientPhase*> m_phases;
         time_t m_lastEpgRequestEndTime;
         P8PLATFORM::CTimeout m_recordingsUpdateDelay;
+        // Recordings are updated only when archive content changes
+        uint64_t m_archiveHash;
 
         int m_rpcPort;
 
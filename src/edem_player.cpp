@@ -81,12 +81,13 @@ namespace EdemEngine
     void Core::Init(bool clearEpgCache)
     {
         RebuildChannelAndGroupList();
+        bool isEpgCacheLoaded = false;
         if(clearEpgCache) {
             ClearEpgCache(c_EpgCacheFile);
         } else {
-            LoadEpgCache(c_EpgCacheFile);
+            isEpgCacheLoaded = LoadEpgCache(c_EpgCacheFile);
         }
-        LoadEpg();
+        LoadEpg(isEpgCacheLoaded);
     }
     
     
@@ -170,26 +171,21 @@ namespace EdemEngine
         return  url;
     }
         
-    UniqueBroadcastIdType Core::AddEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry)
+    void Core::AddEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry, EpgEntryBatch& batch)
     {
-        UniqueBroadcastIdType id = xmlEpgEntry.startTime;
-        
         EpgEntry epgEntry;
         epgEntry.ChannelId = xmlEpgEntry.iChannelId;
         epgEntry.Title = xmlEpgEntry.strTitle;
         epgEntry.Description = xmlEpgEntry.strPlot;
         epgEntry.StartTime = xmlEpgEntry.startTime;
         epgEntry.EndTime = xmlEpgEntry.endTime;
-        return ClientCoreBase::AddEpgEntry(id, epgEntry);
+        ClientCoreBase::AddEpgEntry(epgEntry, batch);
     }
     
-    void Core::UpdateHasArchive(PvrClient::EpgEntry& entry)
+    time_t Core::GetArchiveDepth(PvrClient::ChannelId channelId) const
     {
-        time_t now = time(nullptr);
         const time_t archivePeriod = 3 * 24 * 60 * 60; //3 days in secs
-        time_t epgTime = m_addCurrentEpgToArchive ? entry.StartTime : entry.EndTime;
-        auto when = now - epgTime;
-        entry.HasArchive = when > 0 && when < archivePeriod;
+        return archivePeriod;
     }
    
     void Core::UpdateEpgForAllChannels(time_t startTime, time_t endTime)
@@ -208,12 +204,18 @@ namespace EdemEngine
             auto pThis = this;
  
             set<ChannelId> channelsToUpdate;
-            EpgEntryCallback onEpgEntry = [pThis, &channelsToUpdate,  startTime] (const XMLTV::EpgEntry& newEntry) {
-                if(c_UniqueBroadcastIdUnknown != pThis->AddEpgEntry(newEntry) && newEntry.startTime >= startTime)
+            EpgEntryBatch batch;
+            EpgEntryCallback onEpgEntry = [pThis, &channelsToUpdate, &batch, startTime] (const XMLTV::EpgEntry& newEntry) {
+                pThis->AddEpgEntry(newEntry, batch);
+                if(newEntry.startTime >= startTime)
                     channelsToUpdate.insert(newEntry.iChannelId);
             };
             
-            XMLTV::ParseEpg(m_epgUrl, onEpgEntry);
+            // EPG store already contains entries of unmodified document
+            bool isParsed = XMLTV::ParseEpgIfModified(m_epgUrl, onEpgEntry);
+            AddEpgEntries(batch);
+            if(!isParsed)
+                return;
             
 //            for (auto channel : channelsToUpdate) {
 //                PVR->TriggerEpgUpdate(channel);
@@ -223,18 +225,27 @@ namespace EdemEngine
 //        } catch (ServerErrorException& ex) {
 //            m_addonHelper->QueueNotification(QUEUE_ERROR, m_addonHelper->GetLocalizedString(32002), ex.reason.c_str() );
         } catch (...) {
+            OnEpgRequestFailed(UnknownChannelId, startTime, endTime);
             LogError(" >>>>  FAILED receive EPG <<<<<");
         }
     }
     
-    void Core::LoadEpg()
+    void Core::LoadEpg(bool isEpgCacheLoaded)
     {
         using namespace XMLTV;
         auto pThis = this;
 
-        EpgEntryCallback onEpgEntry = [pThis] (const XMLTV::EpgEntry& newEntry) {pThis->AddEpgEntry(newEntry);};
+        EpgEntryBatch batch;
+        EpgEntryCallback onEpgEntry = [pThis, &batch] (const XMLTV::EpgEntry& newEntry) {pThis->AddEpgEntry(newEntry, batch);};
         
-        XMLTV::ParseEpg(m_epgUrl, onEpgEntry);
+        // Skip parsing of unmodified document when EPG cache is loaded already
+        bool isParsed = isEpgCacheLoaded
+            ? XMLTV::ParseEpgIfModified(m_epgUrl, onEpgEntry)
+            : XMLTV::ParseEpg(m_epgUrl, onEpgEntry);
+        AddEpgEntries(batch);
+        // Keep EPG cache in sync with parsed document
+        if(isParsed)
+            SaveEpgCache(c_EpgCacheFile);
     }
     
     string Core::GetUrl(ChannelId channelId)
@@ -87,12 +87,12 @@ namespace EdemEngine
         std::string GetUrl(PvrClient::ChannelId channelId);
     protected:
         virtual void Init(bool clearEpgCache);
-        virtual void UpdateHasArchive(PvrClient::EpgEntry& entry);
+        virtual time_t GetArchiveDepth(PvrClient::ChannelId channelId) const;
         virtual void BuildChannelAndGroupList();
 
     private:
-        void LoadEpg();
-        PvrClient::UniqueBroadcastIdType AddEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry);
+        void LoadEpg(bool isEpgCacheLoaded);
+        void AddEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry, EpgEntryBatch& batch);
 
         void Cleanup();
 
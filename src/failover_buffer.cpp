@@ -0,0 +1,471 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#if (defined(_WIN32) || defined(__WIN32__))
+#include <windows.h>
+#ifdef GetObject
+#undef GetObject
+#endif
+#endif
+
+#include <algorithm>
+#include <string.h>
+#include "failover_buffer.h"
+#include "ActionQueue.hpp"
+#include "globals.hpp"
+
+namespace Buffers
+{
+    using namespace P8PLATFORM;
+    using namespace Globals;
+
+    // Amount of candidates connected simultaneously on open
+    static const size_t c_RaceWidth = 3;
+    // Source is stalled when silent longer than twice the longest
+    // recent gap between data portions (e.g. HLS segment interval)
+    static const uint64_t c_MinStallTimeoutUs = 1000 * 1000;
+    static const uint64_t c_GapWindowUs = 30 * 1000 * 1000;
+    static const uint64_t c_ConnectTimeoutUs = 10 * 1000 * 1000;
+    // Delay between reconnections when no standby is available
+    static const uint32_t c_RetryDelayMs = 1000;
+    static const uint32_t c_IdleWaitMs = 100;
+    static const size_t c_ReadChunkSize = 32 * 1024;
+    static const size_t c_QueueLimit = 1024 * 1024;
+    // Standby keeps only the most recent data, about a second of HD stream
+    static const size_t c_StandbyQueueLimit = 256 * 1024;
+    static const uint8_t c_TsSyncByte = 0x47;
+    static const size_t c_TsPacketSize = 188;
+    // Sync bytes of consecutive packets required to detect TS stream
+    static const size_t c_SyncPackets = 3;
+    static const int c_StopWaitMs = 5000;
+    static const int c_StopAttempts = 3;
+
+#pragma mark - Source
+
+    // Single stream candidate. Pulls data into own queue from background thread.
+    // Queue starts at TS packet boundary and is read by whole packets,
+    // so sources are spliced at packet boundary on failover.
+    class FailoverBuffer::Source : public CThread
+    {
+    public:
+        Source(const std::string& url, const BufferFactory& factory, const std::shared_ptr<CEvent>& dataEvent, bool isActive)
+        : m_url(url)
+        , m_factory(factory)
+        , m_dataEvent(dataEvent)
+        , m_buffer(nullptr)
+        , m_isActive(isActive)
+        , m_hasFailed(false)
+        , m_hasData(false)
+        , m_startTime(monotonic_time_us())
+        , m_firstDataTime(0)
+        , m_lastDataTime(m_startTime)
+        , m_maxGapUs(0)
+        , m_prevMaxGapUs(0)
+        , m_gapWindowStart(m_startTime)
+        , m_head(0)
+        , m_packetSize(0)
+        {
+            CreateThread();
+        }
+
+        // Runs in background (see DestroyAsync).
+        // Worker may be blocked in network read of m_buffer,
+        // neither the buffer nor the source is freed before it exits.
+        ~Source()
+        {
+            int stopCounter = 1;
+            while(!StopThread(c_StopWaitMs)) {
+                if(stopCounter++ == c_StopAttempts)
+                    LogError("FailoverBuffer: can't stop source %s in %d ms, still waiting.", m_url.c_str(), c_StopAttempts * c_StopWaitMs);
+                else
+                    LogNotice("FailoverBuffer: can't stop source %s in %d ms", m_url.c_str(), c_StopWaitMs);
+            }
+            if(m_buffer)
+                delete m_buffer;
+        }
+
+        const std::string& Url() const {return m_url;}
+        bool HasFailed() const {return m_hasFailed;}
+        bool HasData() const {return m_hasData;}
+        // Delay of the first data since connection, max value when no data yet
+        uint64_t TimeToFirstData() const
+        {
+            CLockObject lock(m_mutex);
+            return m_hasData ? m_firstDataTime - m_startTime : UINT64_MAX;
+        }
+
+        // Standby keeps draining its input into a bounded queue,
+        // promoted one continues from the oldest queued packet.
+        void SetActive(bool isActive)
+        {
+            CLockObject lock(m_mutex);
+            m_isActive = isActive;
+            if(!isActive)
+                DropOldest(c_StandbyQueueLimit);
+            m_spaceEvent.Signal();
+        }
+
+        size_t Read(unsigned char* buffer, size_t bufferSize)
+        {
+            CLockObject lock(m_mutex);
+            if(0 == m_packetSize)
+                return 0;
+            size_t bytesRead = std::min(bufferSize, m_data.size() - m_head);
+            // Incomplete packet waits for the rest
+            if(bufferSize >= m_packetSize)
+                bytesRead -= bytesRead % m_packetSize;
+            if(0 == bytesRead)
+                return 0;
+            memcpy(buffer, &m_data[m_head], bytesRead);
+            m_head += bytesRead;
+            Compact();
+            m_spaceEvent.Signal();
+            return bytesRead;
+        }
+
+        bool IsStalled() const
+        {
+            CLockObject lock(m_mutex);
+            if(m_packetSize > 0 && m_data.size() - m_head >= m_packetSize)
+                return false;
+            const uint64_t now = monotonic_time_us();
+            // Connection time is not limited by data gaps
+            if(!m_hasData)
+                return now - m_startTime > c_ConnectTimeoutUs;
+            const uint64_t timeout = std::max(c_MinStallTimeoutUs, 2 * std::max(m_maxGapUs, m_prevMaxGapUs));
+            return now - m_lastDataTime > timeout;
+        }
+
+    private:
+        bool Open()
+        {
+            if(m_buffer) {
+                delete m_buffer;
+                m_buffer = nullptr;
+            }
+            try {
+                m_buffer = m_factory(m_url);
+            } catch (std::exception& ex) {
+                LogError("FailoverBuffer: failed to open %s. Error: %s", m_url.c_str(), ex.what());
+            }
+            if(nullptr == m_buffer) {
+                m_hasFailed = true;
+                m_dataEvent->Signal();
+                return false;
+            }
+            return true;
+        }
+
+        void* Process()
+        {
+            if(!Open())
+                return NULL;
+            std::vector<unsigned char> chunk(c_ReadChunkSize);
+            while(!IsStopped()) {
+                if(m_isActive && QueueSize() >= c_QueueLimit) {
+                    m_spaceEvent.Wait(c_IdleWaitMs);
+                    // Waiting for the reader is not a gap of the source
+                    CLockObject lock(m_mutex);
+                    m_lastDataTime = monotonic_time_us();
+                    continue;
+                }
+                ssize_t bytesRead = m_buffer->Read(&chunk[0], chunk.size(), c_IdleWaitMs);
+                if(bytesRead < 0) {
+                    LogError("FailoverBuffer: source %s failed.", m_url.c_str());
+                    m_hasFailed = true;
+                    m_dataEvent->Signal();
+                    break;
+                }
+                if(0 == bytesRead)
+                    continue;
+                {
+                    CLockObject lock(m_mutex);
+                    const uint64_t now = monotonic_time_us();
+                    if(m_hasData)
+                        m_maxGapUs = std::max(m_maxGapUs, now - m_lastDataTime);
+                    if(now - m_gapWindowStart > c_GapWindowUs) {
+                        m_prevMaxGapUs = m_maxGapUs;
+                        m_maxGapUs = 0;
+                        m_gapWindowStart = now;
+                    }
+                    m_lastDataTime = now;
+                    m_data.insert(m_data.end(), chunk.begin(), chunk.begin() + bytesRead);
+                    if(0 == m_packetSize)
+                        DetectPacketSize();
+                    if(!m_isActive)
+                        DropOldest(c_StandbyQueueLimit);
+                    if(!m_hasData)
+                        m_firstDataTime = now;
+                    m_hasData = true;
+                }
+                m_dataEvent->Signal();
+            }
+            return NULL;
+        }
+
+        size_t QueueSize() const
+        {
+            CLockObject lock(m_mutex);
+            return m_data.size() - m_head;
+        }
+
+        // Aligns queue head to the first TS packet.
+        // Stream without TS sync is passed as is.
+        void DetectPacketSize()
+        {
+            const size_t syncSpan = (c_SyncPackets - 1) * c_TsPacketSize;
+            if(m_data.size() - m_head <= syncSpan + c_TsPacketSize)
+                return;
+            for (size_t pos = m_head; pos < m_head + c_TsPacketSize; ++pos) {
+                bool isSynced = true;
+                for(size_t i = 0; i < c_SyncPackets && isSynced; ++i)
+                    isSynced = m_data[pos + i * c_TsPacketSize] == c_TsSyncByte;
+                if(isSynced) {
+                    m_head = pos;
+                    m_packetSize = c_TsPacketSize;
+                    return;
+                }
+            }
+            LogNotice("FailoverBuffer: %s is not TS stream, failover splices it at any byte.", m_url.c_str());
+            m_packetSize = 1;
+        }
+
+        // Drops the oldest data over the limit by whole packets
+        void DropOldest(size_t limit)
+        {
+            const size_t size = m_data.size() - m_head;
+            if(0 == m_packetSize || size <= limit)
+                return;
+            size_t drop = (size - limit + m_packetSize - 1) / m_packetSize * m_packetSize;
+            // Resync after corrupted input
+            if(m_packetSize == c_TsPacketSize) {
+                while(m_head + drop < m_data.size() && m_data[m_head + drop] != c_TsSyncByte)
+                    ++drop;
+            }
+            m_head += std::min(drop, size);
+            Compact();
+        }
+
+        void Compact()
+        {
+            if(m_head == m_data.size()) {
+                m_data.clear();
+                m_head = 0;
+            } else if(m_head >= c_QueueLimit) {
+                m_data.erase(m_data.begin(), m_data.begin() + m_head);
+                m_head = 0;
+            }
+        }
+
+        const std::string m_url;
+        const BufferFactory m_factory;
+        const std::shared_ptr<CEvent> m_dataEvent;
+        InputBuffer* m_buffer;
+        mutable CMutex m_mutex;
+        CEvent m_spaceEvent;
+        std::atomic<bool> m_isActive;
+        std::atomic<bool> m_hasFailed;
+        std::atomic<bool> m_hasData;
+        uint64_t m_startTime;
+        uint64_t m_firstDataTime;
+        uint64_t m_lastDataTime;
+        uint64_t m_maxGapUs;
+        uint64_t m_prevMaxGapUs;
+        uint64_t m_gapWindowStart;
+        std::vector<unsigned char> m_data;
+        size_t m_head;
+        // TS packet size, 1 for other streams and 0 until detected
+        size_t m_packetSize;
+    };
+
+#pragma mark - FailoverBuffer
+
+    FailoverBuffer::FailoverBuffer(const std::vector<std::string>& urls, const BufferFactory& factory, StreamMetricsPtr metrics)
+    : m_urls(urls)
+    , m_nextUrl(0)
+    , m_factory(factory)
+    , m_metrics(metrics ? metrics : std::make_shared<StreamMetrics>())
+    , m_dataEvent(std::make_shared<CEvent>())
+    , m_active(nullptr)
+    , m_standby(nullptr)
+    , m_isFailoverRequested(false)
+    {
+        if(m_urls.empty())
+            throw InputBufferException("FailoverBuffer: no stream URL.");
+        Race();
+    }
+
+    FailoverBuffer::~FailoverBuffer()
+    {
+        DestroyAsync(m_active);
+        DestroyAsync(m_standby);
+    }
+
+    void FailoverBuffer::DestroyAsync(Source* source)
+    {
+        if(nullptr == source)
+            return;
+        ActionQueue::CThreadPool::Shared().PerformAsync([source] {
+            delete source;
+        }, [](const ActionQueue::ActionResult& s) {});
+    }
+
+    FailoverBuffer::Source* FailoverBuffer::StartSource(bool isActive)
+    {
+        const std::string& url = m_urls[m_nextUrl];
+        m_nextUrl = (m_nextUrl + 1) % m_urls.size();
+        LogDebug("FailoverBuffer: connecting to %s (%s).", url.c_str(), isActive ? "active" : "standby");
+        return new Source(url, m_factory, m_dataEvent, isActive);
+    }
+
+    void FailoverBuffer::Race()
+    {
+        const uint64_t raceStart = monotonic_time_us();
+        std::vector<Source*> racers;
+        const size_t width = std::min(c_RaceWidth, m_urls.size());
+        while(racers.size() < width)
+            racers.push_back(StartSource(true));
+
+        Source* winner = nullptr;
+        CTimeout timeout(c_commonTimeoutMs);
+        while(nullptr == winner && timeout.TimeLeft() > 0) {
+            bool hasPending = false;
+            for (auto racer : racers) {
+                if(racer->HasData()) {
+                    winner = racer;
+                    break;
+                }
+                hasPending |= !racer->HasFailed();
+            }
+            if(nullptr != winner)
+                break;
+            // All racers failed, try remaining candidates
+            if(!hasPending) {
+                if(racers.size() >= m_urls.size())
+                    break;
+                racers.push_back(StartSource(true));
+            }
+            m_dataEvent->Wait(c_IdleWaitMs);
+        }
+
+        // The fastest of the rest becomes the standby,
+        // the first still connecting one when no other racer has data yet
+        Source* standby = nullptr;
+        if(nullptr != winner) {
+            for (auto racer : racers) {
+                if(racer == winner || racer->HasFailed())
+                    continue;
+                if(nullptr == standby || racer->TimeToFirstData() < standby->TimeToFirstData())
+                    standby = racer;
+            }
+        }
+        for (auto racer : racers) {
+            if(racer == winner)
+                continue;
+            if(racer == standby) {
+                m_standby = racer;
+                m_standby->SetActive(false);
+                continue;
+            }
+            DestroyAsync(racer);
+        }
+        if(nullptr == winner)
+            throw InputBufferException("FailoverBuffer: no stream source delivered data.");
+
+        m_active = winner;
+        LogInfo("FailoverBuffer: %s won the race of %d sources in %llu ms.", m_active->Url().c_str(),
+                (int) racers.size(), (unsigned long long) (monotonic_time_us() - raceStart) / 1000);
+        StartStandby();
+    }
+
+    void FailoverBuffer::StartStandby()
+    {
+        if(nullptr != m_standby || m_urls.size() < 2)
+            return;
+        if(m_urls[m_nextUrl] == m_active->Url())
+            m_nextUrl = (m_nextUrl + 1) % m_urls.size();
+        m_standby = StartSource(false);
+    }
+
+    bool FailoverBuffer::Failover()
+    {
+        Source* next = nullptr;
+        if(nullptr != m_standby && !m_standby->HasFailed()) {
+            next = m_standby;
+            next->SetActive(true);
+        } else {
+            if(m_retryDelay.TimeLeft() > 0)
+                return false;
+            DestroyAsync(m_standby);
+            next = StartSource(true);
+            m_retryDelay.Init(c_RetryDelayMs);
+        }
+        m_standby = nullptr;
+        LogNotice("FailoverBuffer: %s %s, switching to %s.", m_active->Url().c_str(),
+                  m_active->HasFailed() ? "failed" : "is slow", next->Url().c_str());
+        DestroyAsync(m_active);
+        m_active = next;
+        StreamMetrics::Add(m_metrics->failovers);
+        StartStandby();
+        return true;
+    }
+
+    ssize_t FailoverBuffer::Read(unsigned char *buffer, size_t bufferSize, uint32_t timeoutMs)
+    {
+        if(nullptr == m_active)
+            return -1;
+        CTimeout timeout(timeoutMs);
+        while(true) {
+            const size_t bytesRead = m_active->Read(buffer, bufferSize);
+            if(bytesRead > 0)
+                return bytesRead;
+            if(m_isFailoverRequested.exchange(false) || m_active->HasFailed() || m_active->IsStalled())
+                Failover();
+            if(nullptr != m_standby && m_standby->HasFailed()) {
+                DestroyAsync(m_standby);
+                m_standby = nullptr;
+                StartStandby();
+            }
+            const uint32_t timeLeft = timeout.TimeLeft();
+            if(0 == timeLeft)
+                break;
+            m_dataEvent->Wait(std::min(timeLeft, c_IdleWaitMs));
+        }
+        return 0;
+    }
+
+    bool FailoverBuffer::SwitchStream(const std::string &newUrl)
+    {
+        DestroyAsync(m_standby);
+        DestroyAsync(m_active);
+        m_standby = m_active = nullptr;
+        m_urls = std::vector<std::string>(1, newUrl);
+        m_nextUrl = 0;
+        try {
+            Race();
+        } catch (const InputBufferException& ex) {
+            LogError("FailoverBuffer: failed to switch stream. Error: %s", ex.what());
+            return false;
+        }
+        return true;
+    }
+}
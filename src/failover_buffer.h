@@ -0,0 +1,82 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef failover_buffer_h
+#define failover_buffer_h
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include "p8-platform/threads/threads.h"
+#include "input_buffer.h"
+#include "stream_metrics.h"
+
+namespace Buffers
+{
+    // Live input over alternative URLs of the same stream.
+    // On open first candidates are raced and the first one delivering data wins.
+    // Next candidate is kept connected as a warm standby draining into
+    // a bounded queue. It replaces the active source at TS packet boundary
+    // when that stalls or fails. Single URL is reconnected.
+    class FailoverBuffer : public InputBuffer
+    {
+    public:
+        typedef std::function<InputBuffer*(const std::string& url)> BufferFactory;
+
+        // Throws InputBufferException when no candidate delivered data.
+        FailoverBuffer(const std::vector<std::string>& urls, const BufferFactory& factory, StreamMetricsPtr metrics);
+        ~FailoverBuffer();
+
+        int64_t GetLength() const {return -1;}
+        int64_t GetPosition() const {return -1;}
+        int64_t Seek(int64_t iPosition, int iWhence) {return -1;}
+        ssize_t Read(unsigned char *buffer, size_t bufferSize, uint32_t timeoutMs);
+        // Restarts with the URL as the only candidate
+        bool SwitchStream(const std::string &newUrl);
+        // Source is replaced on next read
+        bool RequestFailover() {m_isFailoverRequested = true; return true;}
+
+    private:
+        class Source;
+
+        void Race();
+        bool Failover();
+        void StartStandby();
+        Source* StartSource(bool isActive);
+        // Sources may block on network, delete them in background
+        static void DestroyAsync(Source* source);
+
+        std::vector<std::string> m_urls;
+        size_t m_nextUrl;
+        const BufferFactory m_factory;
+        const StreamMetricsPtr m_metrics;
+        std::shared_ptr<P8PLATFORM::CEvent> m_dataEvent;
+        Source* m_active;
+        Source* m_standby;
+        P8PLATFORM::CTimeout m_retryDelay;
+        std::atomic<bool> m_isFailoverRequested;
+    };
+}
+
+#endif /* failover_buffer_h */
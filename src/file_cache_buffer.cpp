@@ -362,8 +362,8 @@ namespace Buffers
                 iPosition = m_begin;
             }
             iWhence = SEEK_SET;
-            LogDebug("TimeshiftBuffer::Seek. Calculated pos %lld", iPosition);
-            LogDebug("TimeshiftBuffer::Seek. Begin %lld Length %lld", m_begin, m_length);
+            LOG_DEBUG("TimeshiftBuffer::Seek. Calculated pos %lld", iPosition);
+            LOG_DEBUG("TimeshiftBuffer::Seek. Begin %lld Length %lld", m_begin, m_length);
 
             idx = GetChunkIndexFor(iPosition);
             if(idx >= m_ReadChunks.size()) {
@@ -375,8 +375,8 @@ namespace Buffers
         auto inPos = GetPositionInChunkFor(iPosition);
         auto pos =  chunk->m_reader.Seek(inPos, iWhence);
         m_position = iPosition -  (inPos - pos);
-        LogDebug("TimeshiftBuffer::Seek: chunk idx %lld, pos in chunk %lld, actual pos %lld", idx, inPos, pos);
-        LogDebug("TimeshiftBuffer::Seek: result pos %lld", m_position);
+        LOG_DEBUG("TimeshiftBuffer::Seek: chunk idx %lld, pos in chunk %lld, actual pos %lld", idx, inPos, pos);
+        LOG_DEBUG("TimeshiftBuffer::Seek: result pos %lld", m_position);
         return iPosition;
         
     }
@@ -437,7 +437,7 @@ namespace Buffers
                 // Chunk is NOT full, but has no more data.
                 // Break to let the player to request another time
                 // or let the user to stop playing.
-                    LogDebug("FileCacheBuffer: nothing to read from chunk. Chunk pos=%lld, lenght=%lld", chunk->m_reader.Position(), chunk->m_reader.Length());
+                    LOG_DEBUG_RATE_LIMITED(1000, "FileCacheBuffer: nothing to read from chunk. Chunk pos=%lld, lenght=%lld", chunk->m_reader.Position(), chunk->m_reader.Length());
                     break;
             }
         }
@@ -535,7 +535,7 @@ namespace Buffers
         }
         ChunkFilePtr newChunk = new CAddonFile(UniqueFilename(m_bufferDir).c_str(), m_autoDelete);
         m_ChunkFileSwarm.push_back(ChunkFileSwarm::value_type(newChunk));
-        LogDebug(">>> TimeshiftBuffer: new current chunk (for write):  %s", + newChunk->Path().c_str());
+        LOG_DEBUG(">>> TimeshiftBuffer: new current chunk (for write):  %s", + newChunk->Path().c_str());
         return newChunk;
     }
     
@@ -24,6 +24,7 @@
 #include "globals.hpp"
 #include "p8-platform/util/util.h"
 #include "p8-platform/util/StringUtils.h"
+#include <chrono>
 
 namespace Globals
 {
@@ -33,6 +34,7 @@ namespace Globals
     ADDON::CHelper_libXBMC_addon* const& XBMC(__xbmc);
 
     static ADDON::addon_log_t  __debugLogLevel = ADDON::LOG_DEBUG;
+    static std::atomic<bool> __isDebugLogEnabled(false);
     void Cleanup();
     
     bool CreateWithHandle(void* hdl)
@@ -67,7 +69,6 @@ namespace Globals
     
 # define PrintToLog(loglevel) \
 std::string strData; \
-strData.reserve(16384); \
 va_list va; \
 va_start(va, format); \
 strData = StringUtils::FormatV(format,va); \
@@ -92,5 +93,26 @@ XBMC->Log(loglevel, strData.c_str()); \
         PrintToLog(__debugLogLevel);
     }
     
+    bool IsDebugLogEnabled()
+    {
+        return __isDebugLogEnabled.load(std::memory_order_relaxed);
+    }
+    
+    void SetDebugLogEnabled(bool enabled)
+    {
+        __isDebugLogEnabled = enabled;
+    }
+    
+    bool IsLogIntervalPassed(std::atomic<int64_t>& lastTime, unsigned int intervalMs)
+    {
+        using namespace std::chrono;
+        const int64_t now = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+        int64_t last = lastTime.load(std::memory_order_relaxed);
+        if(last != INT64_MIN && now - last < intervalMs)
+            return false;
+        // Only one of concurrent callers wins the interval
+        return lastTime.compare_exchange_strong(last, now, std::memory_order_relaxed);
+    }
+    
 
 }
@@ -26,6 +26,8 @@
 #include "kodi/libXBMC_pvr.h"
 #include "kodi/libXBMC_addon.h"
 #include "addon.h"
+#include <atomic>
+#include <stdint.h>
 
 namespace Globals {
 
@@ -37,5 +39,35 @@ namespace Globals {
     void LogNotice(const char *format, ... );
     void LogDebug(const char *format, ... );
 
+    // Hot path debug messages are formatted only when enabled in addon settings.
+    // Kodi does not expose its own log level to addons.
+    bool IsDebugLogEnabled();
+    void SetDebugLogEnabled(bool enabled);
+    // Returns true when at least intervalMs passed since the last accepted call
+    // for the call site represented by lastTime.
+    bool IsLogIntervalPassed(std::atomic<int64_t>& lastTime, unsigned int intervalMs);
+
 }
+
+// Arguments are not evaluated when debug log is disabled.
+#define LOG_DEBUG(...) \
+do { if(Globals::IsDebugLogEnabled()) Globals::LogDebug(__VA_ARGS__); } while(0)
+
+// Per segment/chunk messages. Compiled out from release (NDEBUG) builds.
+#ifdef NDEBUG
+#define LOG_TRACE(...) do {} while(0)
+#else
+#define LOG_TRACE(...) LOG_DEBUG(__VA_ARGS__)
+#endif
+
+// Repeating messages are logged at most once per intervalMs from the call site.
+#define LOG_RATE_LIMITED(intervalMs, logFunc, ...) \
+do { \
+    static std::atomic<int64_t> __lastLogTime(INT64_MIN); \
+    if(Globals::IsLogIntervalPassed(__lastLogTime, intervalMs)) logFunc(__VA_ARGS__); \
+} while(0)
+
+#define LOG_DEBUG_RATE_LIMITED(intervalMs, ...) \
+do { if(Globals::IsDebugLogEnabled()) LOG_RATE_LIMITED(intervalMs, Globals::LogDebug, __VA_ARGS__); } while(0)
+
 #endif /* __globals_hpp__ */
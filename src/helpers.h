@@ -33,6 +33,7 @@
 #include <cctype>
 #include <ctime>
 #include <algorithm>
+#include <chrono>
 
 
 template <class T>
@@ -43,6 +44,22 @@ std::string n_to_string_hex(uint64_t n);
 std:: string time_t_to_string(const time_t& time);
 //int strtoi(const std::string &str);
 
+// FNV-1a hash, e.g. to detect changes of lists
+const uint64_t c_HashInitialValue = 14695981039346656037ULL;
+inline uint64_t hash_combine(uint64_t hash, uint64_t value) {
+    for(int i = 0; i < 8; ++i, value >>= 8) {
+        hash ^= value & 0xFF;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Microseconds since arbitrary point, for interval measurements
+inline uint64_t monotonic_time_us() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
 // trim from start (in place)
 inline void ltrim(std::string &s) {
     s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](char ch) {
@@ -53,6 +53,9 @@ namespace Buffers {
         virtual ssize_t Read(unsigned char *buffer, size_t bufferSize, uint32_t timeoutMs) = 0;
         virtual int64_t Seek(int64_t iPosition, int iWhence) = 0;
         virtual bool SwitchStream(const std::string &newUrl) = 0;
+        // Asks to replace the source of the stream without interrupting reader.
+        // May be called from any thread. Returns false when not supported.
+        virtual bool RequestFailover() {return false;}
     protected:
         const int c_commonTimeoutMs = 10000; // 10 sec
     };
@@ -127,7 +127,7 @@ namespace Buffers
         unsigned int idx = -1;
         ChunkPtr chunk = NULL;
         {
-            LogDebug("MemoryCacheBuffer::Seek. >>> Requested pos %lld", iPosition);
+            LOG_DEBUG("MemoryCacheBuffer::Seek. >>> Requested pos %lld", iPosition);
             
             CLockObject lock(m_SyncAccess);
             
@@ -144,8 +144,8 @@ namespace Buffers
                 iPosition = m_begin;
             }
             iWhence = SEEK_SET;
-            LogDebug("MemoryCacheBuffer::Seek. Calculated pos %lld", iPosition);
-            LogDebug("MemoryCacheBuffer::Seek. Begin %lld Length %lld", m_begin, m_length);
+            LOG_DEBUG("MemoryCacheBuffer::Seek. Calculated pos %lld", iPosition);
+            LOG_DEBUG("MemoryCacheBuffer::Seek. Begin %lld Length %lld", m_begin, m_length);
             
             idx = GetChunkIndexFor(iPosition);
             if(idx >= m_ReadChunks.size()) {
@@ -157,9 +157,9 @@ namespace Buffers
             auto inPos = GetPositionInChunkFor(iPosition);
             auto pos =  chunk->Seek(inPos);
             m_position = iPosition -  (inPos - pos);
-            LogDebug("MemoryCacheBuffer::Seek. Chunk idx %d, pos in chunk %lld, actual pos %lld", idx, inPos, pos);
+            LOG_DEBUG("MemoryCacheBuffer::Seek. Chunk idx %d, pos in chunk %lld, actual pos %lld", idx, inPos, pos);
         }
-        LogDebug("MemoryCacheBuffer::Seek. <<< Result pos %lld", m_position);
+        LOG_DEBUG("MemoryCacheBuffer::Seek. <<< Result pos %lld", m_position);
         return m_position;
         
     }
@@ -216,7 +216,7 @@ namespace Buffers
                 // Chunk is NOT full, but has no more data.
                 // Break to let the player to request another time
                 // or let the user to stop playing.
-                LogDebug("MemoryCacheBuffer: nothing to read from chunk. Chunk pos=%lld, lenght=%lld", chunk->ReadPos(), chunk->WritePos());
+                LOG_DEBUG_RATE_LIMITED(1000, "MemoryCacheBuffer: nothing to read from chunk. Chunk pos=%lld, lenght=%lld", chunk->ReadPos(), chunk->WritePos());
                 break;
             }
         }
@@ -75,6 +75,7 @@ namespace OttEngine
     Core::Core(const std::string &baseUrl, const std::string &key)
     : m_baseUrl(baseUrl)
     , m_key(key)
+    , m_pendingEpgRequests(0)
     {
         m_baseUrl = "http://" + m_baseUrl ;
     }
@@ -257,24 +258,75 @@ namespace OttEngine
         if(interval > 0)
             m_epgUpdateInterval.Init(interval*1000);
 
+        // Requests are performed concurrently.
+        // EPG cache is saved when the last one is done.
+        // The batch itself is counted as pending until all requests are queued,
+        // so early completions do not save partial EPG.
+        {
+            P8PLATFORM::CLockObject lock(m_epgRequestsMutex);
+            ++m_pendingEpgRequests;
+        }
         for (const auto& ch : m_channelList) {
             GetEpgForChannel(ch.second.Id, startTime, endTime);
         }
-        //SaveEpgCache(c_EpgCacheFile);
+        ReleasePendingEpgRequest();
+    }
+    
+    void Core::ReleasePendingEpgRequest()
+    {
+        bool isLast = false;
+        {
+            P8PLATFORM::CLockObject lock(m_epgRequestsMutex);
+            isLast = 0 == --m_pendingEpgRequests;
+        }
+        if(isLast)
+            SaveEpgCache(c_EpgCacheFile);
     }
 
+    void Core::UpdateEpgForChannel(ChannelId channelId, time_t startTime, time_t endTime)
+    {
+        GetEpgForChannel(channelId, startTime, endTime);
+    }
+    
     void Core::GetEpgForChannel(ChannelId channelId, time_t startTime, time_t endTime)
     {
+        {
+            P8PLATFORM::CLockObject lock(m_epgRequestsMutex);
+            // Server responds with whole channel's EPG.
+            // Request in flight with same or earlier start time covers this one.
+            auto inFlight = m_epgRequests.equal_range(channelId);
+            for(auto it = inFlight.first; it != inFlight.second; ++it) {
+                if(it->second <= startTime) {
+                    LogDebug("OTT: EPG request for channel %d is in flight already.", channelId);
+                    return;
+                }
+            }
+            m_epgRequests.insert(make_pair(channelId, startTime));
+            ++m_pendingEpgRequests;
+        }
+        // Removes request from in-flight list.
+        // EPG cache is saved after the last pending request.
+        auto onRequestDone = [this, channelId, startTime] {
+            {
+                P8PLATFORM::CLockObject lock(m_epgRequestsMutex);
+                auto inFlight = m_epgRequests.equal_range(channelId);
+                for(auto it = inFlight.first; it != inFlight.second; ++it) {
+                    if(it->second == startTime) {
+                        m_epgRequests.erase(it);
+                        break;
+                    }
+                }
+            }
+            ReleasePendingEpgRequest();
+        };
         try {
             string call = string("channel/") + n_to_string(channelId);
             ApiFunctionData apiParams(call.c_str());
             bool* shouldUpdate = new bool(false);
             
-            unsigned int epgActivityCounter = ++m_epgActivityCounter;
-            
-            //CallApiFunction(apiParams,  [this, startTime, shouldUpdate] (Document& jsonRoot)
             CallApiAsync(apiParams,  [this, startTime, shouldUpdate] (Document& jsonRoot)
                          {
+                             EpgEntryBatch batch;
                              for (auto& m : jsonRoot.GetObject()) {
                                  if(std::stol(m.name.GetString()) < startTime) {
                                      continue;
@@ -286,44 +338,41 @@ namespace OttEngine
                                  epgEntry.Description = m.value["descr"].GetString();
                                  epgEntry.StartTime = m.value["time"].GetInt() ;
                                  epgEntry.EndTime = m.value["time_to"].GetInt();
-                                 UniqueBroadcastIdType id = epgEntry.StartTime;
-                                 AddEpgEntry(id, epgEntry);
+                                 AddEpgEntry(epgEntry, batch);
                                  
                              }
+                             AddEpgEntries(batch);
                          },
-                         [this, shouldUpdate, channelId, epgActivityCounter](const ActionQueue::ActionResult& s)
+                         [this, shouldUpdate, channelId, startTime, endTime, onRequestDone](const ActionQueue::ActionResult& s)
                          {
                              if(s.exception == NULL && *shouldUpdate){
                                  PVR->TriggerEpgUpdate(channelId);
                              }
+                             if(s.status != ActionQueue::kActionCompleted)
+                                 OnEpgRequestFailed(channelId, startTime, endTime);
                              delete shouldUpdate;
-                             if(epgActivityCounter == m_epgActivityCounter){
-//                                 OnEpgUpdateDone();
-                                 SaveEpgCache(c_EpgCacheFile);
-                             }
-                         });
+                             onRequestDone();
+                         }, true);
             
         } catch (ServerErrorException& ex) {
+            OnEpgRequestFailed(channelId, startTime, endTime);
+            onRequestDone();
             char* message  = XBMC->GetLocalizedString(32002);
             XBMC->QueueNotification(QUEUE_ERROR, message, ex.reason.c_str());
             XBMC->FreeString(message);
         } catch (...) {
+            OnEpgRequestFailed(channelId, startTime, endTime);
+            onRequestDone();
             LogError(" >>>>  FAILED receive EPG <<<<<");
         }
     }
     
-    void Core::UpdateHasArchive(PvrClient::EpgEntry& entry)
+    time_t Core::GetArchiveDepth(PvrClient::ChannelId channelId) const
     {
-        auto channel = m_channelList.find(entry.ChannelId);
-        entry.HasArchive = channel != m_channelList.end() &&  channel->second.HasArchive;
-        
-        if(!entry.HasArchive)
-            return;
-        
-        time_t now = time(nullptr);
-        time_t epgTime = m_addCurrentEpgToArchive ? entry.StartTime : entry.EndTime;
-        entry.HasArchive = epgTime < now;
-
+        auto channel = m_channelList.find(channelId);
+        if(channel == m_channelList.end() || !channel->second.HasArchive)
+            return 0;
+        return c_UnlimitedArchiveDepth;
     }
     
     string Core::GetUrl(ChannelId channelId)
@@ -353,7 +402,7 @@ namespace OttEngine
     }
     
     template <typename TParser, typename TCompletion>
-    void Core::CallApiAsync(const ApiFunctionData& data, TParser parser, TCompletion completion)
+    void Core::CallApiAsync(const ApiFunctionData& data, TParser parser, TCompletion completion, bool concurrent)
     {
         
         // Build HTTP request
@@ -388,7 +437,7 @@ namespace OttEngine
         m_httpEngine->CallApiAsync(strRequest, parserWrapper, [=](const ActionQueue::ActionResult& s)
        {
            completion(s);
-       });
+       }, concurrent ? HttpEngine::RequestPriority_Concurrent : HttpEngine::RequestPriority_Low);
     }
 }
 
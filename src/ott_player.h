@@ -31,7 +31,9 @@
 #include <vector>
 #include <functional>
 #include <list>
+#include <map>
 #include <memory>
+#include "p8-platform/threads/mutex.h"
 
 
 namespace OttEngine
@@ -81,7 +83,9 @@ namespace OttEngine
         
     protected:
         virtual void Init(bool clearEpgCache);
-        virtual void UpdateHasArchive(PvrClient::EpgEntry& entry);
+        virtual time_t GetArchiveDepth(PvrClient::ChannelId channelId) const;
+        virtual bool CanUpdateEpgForChannel() const {return true;}
+        virtual void UpdateEpgForChannel(PvrClient::ChannelId channelId, time_t startTime, time_t endTime);
         virtual void BuildChannelAndGroupList();
 
     private:
@@ -89,13 +93,15 @@ namespace OttEngine
         struct ApiFunctionData;
         
         void  GetEpgForChannel(PvrClient::ChannelId channelId,  time_t startTime, time_t endTime);
+        // Saves EPG cache when no EPG request is pending anymore
+        void ReleasePendingEpgRequest();
 
         void Cleanup();
         
         template <typename TParser>
         void CallApiFunction(const ApiFunctionData& data, TParser parser);
         template <typename TParser, typename TCompletion>
-        void CallApiAsync(const ApiFunctionData& data, TParser parser, TCompletion completion);
+        void CallApiAsync(const ApiFunctionData& data, TParser parser, TCompletion completion, bool concurrent = false);
         
         void ParseChannelAndGroup(const std::string& data, unsigned int plistIndex);
         
@@ -103,7 +109,11 @@ namespace OttEngine
         std::string m_epgUrl;
         std::string m_logoUrl;
         std::string m_key;
-        unsigned int m_epgActivityCounter;
+        // Start times of EPG requests in flight per channel
+        std::multimap<PvrClient::ChannelId, time_t> m_epgRequests;
+        // Requests in flight plus running batches of UpdateEpgForAllChannels()
+        unsigned int m_pendingEpgRequests;
+        P8PLATFORM::CMutex m_epgRequestsMutex;
     };
 }
 #endif //_ott_player_h_
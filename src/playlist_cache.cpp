@@ -175,7 +175,7 @@ namespace Buffers {
             retVal = new MutableSegment(info, timeOffaset);
             m_segments[info.index] = std::unique_ptr<MutableSegment>(retVal);
         }
-        LogDebug("PlaylistCache: start LOADING segment %" PRIu64 ".", info.index);
+        LOG_TRACE("PlaylistCache: start LOADING segment %" PRIu64 ".", info.index);
 
         retVal->_isLoading = true;
         return retVal;
@@ -184,7 +184,7 @@ namespace Buffers {
     void PlaylistCache::SegmentReady(MutableSegment* segment) {
         segment->DataReady();
         m_cacheSizeInBytes += segment->Size();
-        LogDebug("PlaylistCache: segment %" PRIu64 " added. Cache size %d bytes", segment->info.index, m_cacheSizeInBytes);
+        LOG_TRACE("PlaylistCache: segment %" PRIu64 " added. Cache size %d bytes", segment->info.index, m_cacheSizeInBytes);
     }
     
     void PlaylistCache::SegmentCanceled(MutableSegment* segment) {
@@ -194,7 +194,7 @@ namespace Buffers {
         } else {
             m_segments.erase(segment->info.index);
         }
-        LogDebug("PlaylistCache: segment %" PRIu64 " canseled. Cache size %d bytes", segment->info.index, m_cacheSizeInBytes);
+        LOG_TRACE("PlaylistCache: segment %" PRIu64 " canseled. Cache size %d bytes", segment->info.index, m_cacheSizeInBytes);
     }
     
     Segment* PlaylistCache::NextSegment(SegmentStatus& status) {
@@ -214,14 +214,14 @@ namespace Buffers {
                 seg->Seek(posInSegment);
                 retVal = seg.get();
                 status = k_SegmentStatus_Ok;
-                LogDebug("PlaylistCache: READING from segment %" PRIu64 ". Position in segment %d.", seg->info.index, posInSegment);
+                LOG_TRACE("PlaylistCache: READING from segment %" PRIu64 ". Position in segment %d.", seg->info.index, posInSegment);
             } else {
                 // Validate that current segmenet is loading
                 if(!seg->IsLoading()){
-                    LogDebug("PlaylistCache: segment %" PRIu64 " found, has been queued.", seg->info.index);
+                    LOG_TRACE("PlaylistCache: segment %" PRIu64 " found, has been queued.", seg->info.index);
                     m_dataToLoad.push_front(seg->info);
                 } else {
-                    LogDebug("PlaylistCache: segment %" PRIu64 " found, loading data...", seg->info.index);
+                    LOG_TRACE("PlaylistCache: segment %" PRIu64 " found, loading data...", seg->info.index);
                 }
                 // Segment is not ready yet
                 status = k_SegmentStatus_Loading;
@@ -234,7 +234,7 @@ namespace Buffers {
             int64_t lastIndex = -1;
             if(m_segments.size())
                 lastIndex = (--m_segments.end())->first;
-            LogDebug("PlaylistCache: wrong current segment index #%" PRIu64 ". Last #%" PRId64 " of %d segments.", m_currentSegmentIndex, lastIndex,  m_segments.size());
+            LOG_DEBUG("PlaylistCache: wrong current segment index #%" PRIu64 ". Last #%" PRId64 " of %d segments.", m_currentSegmentIndex, lastIndex,  m_segments.size());
             status = k_SegmentStatus_EOF;
         } else if(nullptr != m_delegate){
             // Dynamic seekable stream (e.g. Edem)
@@ -243,16 +243,16 @@ namespace Buffers {
             float segmentTimeOffset = m_currentSegmentIndex * m_playlist.TargetDuration();
             if(segmentTimeOffset >= m_delegate->Duration()) {
                 status = k_SegmentStatus_EOF;
-                LogDebug("PlaylistCache: wrong current segment index #%" PRIu64 ". Requested time offset %f. Stream duration %f.", m_currentSegmentIndex, segmentTimeOffset, m_delegate->Duration());
+                LOG_DEBUG("PlaylistCache: wrong current segment index #%" PRIu64 ". Requested time offset %f. Stream duration %f.", m_currentSegmentIndex, segmentTimeOffset, m_delegate->Duration());
             } else {
                 status = k_SegmentStatus_Loading;
-                LogDebug("PlaylistCache: segment with index #%" PRIu64 " should start loading shortly. Requested time offset %f. Stream duration %f.", m_currentSegmentIndex, segmentTimeOffset, m_delegate->Duration());
+                LOG_DEBUG("PlaylistCache: segment with index #%" PRIu64 " should start loading shortly. Requested time offset %f. Stream duration %f.", m_currentSegmentIndex, segmentTimeOffset, m_delegate->Duration());
             }
         }else {
             // Live stream
             // TODO: check whether segment loading now
             status = k_SegmentStatus_Loading;
-            LogDebug("PlaylistCache: segment with index #%" PRIu64 " should start loading shortly. Last known segment #%" PRIu64 ".", m_currentSegmentIndex, m_segments.size() > 0 ? m_segments.rbegin()->first : 0);
+            LOG_DEBUG("PlaylistCache: segment with index #%" PRIu64 " should start loading shortly. Last known segment #%" PRIu64 ".", m_currentSegmentIndex, m_segments.size() > 0 ? m_segments.rbegin()->first : 0);
         }
         
         // Forward to nex segment only if we found current
@@ -319,11 +319,11 @@ namespace Buffers {
                 } else {
                     m_segments.erase(idx);
                 }
-                LogDebug("PlaylistCache: segment %" PRIu64 " removed. Cache size %d bytes", idx, m_cacheSizeInBytes);
+                LOG_TRACE("PlaylistCache: segment %" PRIu64 " removed. Cache size %d bytes", idx, m_cacheSizeInBytes);
             } else if(CanSeek()) {
-                LogDebug("PlaylistCache: cache is full but no segments to free. Current idx %" PRIu64 " Size %d bytes", currentSegment, m_cacheSizeInBytes);
+                LOG_DEBUG_RATE_LIMITED(1000, "PlaylistCache: cache is full but no segments to free. Current idx %" PRIu64 " Size %d bytes", currentSegment, m_cacheSizeInBytes);
             } else {
-                LogDebug("PlaylistCache: cache is full but no segments to free. Current idx %" PRIu64 " %d segments in cache.", currentSegment, m_segments.size());
+                LOG_DEBUG_RATE_LIMITED(1000, "PlaylistCache: cache is full but no segments to free. Current idx %" PRIu64 " %d segments in cache.", currentSegment, m_segments.size());
             }
         }
         return !IsFull();
@@ -387,7 +387,7 @@ namespace Buffers {
         if(m_currentSegmentPositionFactor > 1.0) {
             LogError("PlaylistCache: segment position factor can't be > 1.0. Requested offset %f, segment timestamp %f, duration %f", timeOffset, segmentTime, segmentDuration);
         } else {
-            LogDebug("PlaylistCache:  seek positon ratio %f", m_currentSegmentPositionFactor);
+            LOG_DEBUG("PlaylistCache:  seek positon ratio %f", m_currentSegmentPositionFactor);
         }
         return true;
     }
@@ -438,7 +438,7 @@ namespace Buffers {
             _begin = &_data[0];
         size_t actual = std::min(size, BytesReady());
         if(actual < 0)
-            LogDebug("Segment::Read: error size %d.  Bytes ready: %d", actual, BytesReady());
+            LOG_DEBUG("Segment::Read: error size %d.  Bytes ready: %d", actual, BytesReady());
         memcpy(buffer, _begin, actual);
         _begin += actual;
         return actual;
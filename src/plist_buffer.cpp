@@ -43,9 +43,11 @@ using namespace Globals;
 
 namespace Buffers {
     
-    PlaylistBuffer::PlaylistBuffer(const std::string &playListUrl,  PlaylistBufferDelegate delegate)
+    PlaylistBuffer::PlaylistBuffer(const std::string &playListUrl,  PlaylistBufferDelegate delegate, StreamMetricsPtr metrics)
     : m_delegate(delegate)
     , m_cache(nullptr)
+    , m_metrics(metrics ? metrics : std::make_shared<StreamMetrics>())
+    , m_isOwnMetrics(nullptr == metrics)
     {
         Init(playListUrl);
     }
@@ -53,11 +55,16 @@ namespace Buffers {
     PlaylistBuffer::~PlaylistBuffer()
     {
         StopThread();
+        if(m_isOwnMetrics && StreamMetrics::Get(m_metrics->bytesDownloaded) > 0)
+            m_metrics->Log("PlaylistBuffer");
     }
     
+    
     void PlaylistBuffer::Init(const std::string &playlistUrl)
     {
          StopThread(20000);
+         if(m_isOwnMetrics && StreamMetrics::Get(m_metrics->bytesDownloaded) > 0)
+             m_metrics->Log("PlaylistBuffer");
         {
             CLockObject lock(m_syncAccess);
 
@@ -70,11 +77,13 @@ namespace Buffers {
                 char* message  = XBMC->GetLocalizedString(32024);
                 XBMC->QueueNotification(QUEUE_ERROR, message);
                 XBMC->FreeString(message);
-                throw InputBufferException((std::string("Playlist exception: ") + ex.what()).c_str());
+                throw PlistBufferException((std::string("Playlist exception: ") + ex.what()).c_str());
             }
             m_position = 0;
             m_currentSegment = nullptr;
             m_loadingSegmentIndex = 0;
+            if(m_isOwnMetrics)
+                m_metrics->Reset();
         }
         CreateThread();
     }
@@ -85,16 +94,25 @@ namespace Buffers {
         if(!f)
             throw PlistBufferException("Failed to download playlist media segment.");
         
+        const uint64_t downloadStart = monotonic_time_us();
         unsigned char buffer[8196];
         ssize_t  bytesRead;
         uint64_t segmentIndex = segment->info.index;
         do {
             bytesRead = XBMC->ReadFile(f, buffer, sizeof(buffer));
+            // Negative is a read error, e.g. connection closed before the end of segment.
+            // Received part of segment is still playable.
+            if(bytesRead < 0) {
+                LOG_RATE_LIMITED(1000, LogError, "PlaylistBuffer: segment #%" PRIu64 " is truncated.", segmentIndex);
+                break;
+            }
             segment->Push(buffer, bytesRead);
+            StreamMetrics::Add(m_metrics->bytesDownloaded, bytesRead);
             //        LogDebug(">>> Write: %d", bytesRead);
         }while (bytesRead > 0 && !IsStopped() && m_loadingSegmentIndex == segmentIndex);
         
         XBMC->CloseFile(f);
+        m_metrics->segmentDownloadTime.Add(monotonic_time_us() - downloadStart);
 
         return m_loadingSegmentIndex == segmentIndex && segment->BytesReady() > 0;
     }
@@ -115,6 +133,7 @@ namespace Buffers {
         bool isEof = false;
         try {
             m_cache->ReloadPlaylist();
+            StreamMetrics::Add(m_metrics->playlistReloads);
             while (/*!isEof && */ !IsStopped()) {
 
                 MutableSegment* segment =  nullptr;
@@ -123,7 +142,7 @@ namespace Buffers {
                     segment = m_cache->SegmentToFill();
                     if(nullptr != segment) {
                         m_loadingSegmentIndex = segment->info.index;
-                        LogDebug("PlaylistBuffer: Start fill segment #%" PRIu64 ".", m_loadingSegmentIndex);
+                        LOG_TRACE("PlaylistBuffer: Start fill segment #%" PRIu64 ".", m_loadingSegmentIndex);
                     }
                 }
     
@@ -132,9 +151,9 @@ namespace Buffers {
                     // Load segn=ment data
                     bool segmentReady = FillSegment(segment);
                     if(segmentReady)
-                        LogDebug("PlaylistBuffer: End fill segment #%" PRIu64 ".", m_loadingSegmentIndex);
+                        LOG_TRACE("PlaylistBuffer: End fill segment #%" PRIu64 ".", m_loadingSegmentIndex);
                     else
-                        LogDebug("PlaylistBuffer: FAILED to fill segment. New segmenet to fill #%" PRIu64 ".", m_loadingSegmentIndex);
+                        LOG_DEBUG("PlaylistBuffer: FAILED to fill segment. New segmenet to fill #%" PRIu64 ".", m_loadingSegmentIndex);
 
                     auto duration = segment->Duration();
 //                    LogDebug("PlaylistBuffer: Segment duration: %f", duration);
@@ -146,6 +165,7 @@ namespace Buffers {
                             m_writeEvent.Signal();
                        } else {
                             m_cache->SegmentCanceled(segment);
+                            StreamMetrics::Add(m_metrics->segmentsFailed);
                         }
                     }
                     sleepTime = 1.0;//std::max(duration / 2.0, 1.0);
@@ -163,6 +183,7 @@ namespace Buffers {
                         LogError("PlaylistBuffer: playlist update failed.");
                         break;
                     }
+                    StreamMetrics::Add(m_metrics->playlistReloads);
                 }
                 // No reason to download next segment when cache is full
                 bool chacheIsFull = false;
@@ -180,6 +201,9 @@ namespace Buffers {
             
         } catch (InputBufferException& ex ) {
             LogError("PlaylistBuffer: download thread failed with error: %s", ex.what());
+        } catch (std::exception& ex ) {
+            // E.g. playlist reload failure. Should not terminate the process.
+            LogError("PlaylistBuffer: download thread failed with exception: %s", ex.what());
         }
         
         LogDebug("PlaylistBuffer: write thread is done.");
@@ -216,7 +240,10 @@ namespace Buffers {
                        PlaylistCache::k_SegmentStatus_CacheEmpty == segmentStatus)
                     {
                         if(waitingCounter++ == 0 && IsRunning()){
-                            LogNotice("PlaylistBuffer: waiting for segment loading...");
+                            LOG_RATE_LIMITED(1000, LogNotice, "PlaylistBuffer: waiting for segment loading...");
+                            StreamMetrics::Add(m_metrics->segmentWaits);
+                            if(m_isOwnMetrics && StreamMetrics::Get(m_metrics->bytesDelivered) > 0)
+                                StreamMetrics::Add(m_metrics->readerStalls);
                             // NOTE: timeout is set by Timeshift buffer
                             // Do not change it! May cause long waiting on stopping/exit.
                             //timeoutMs = 5*1000;
@@ -236,7 +263,7 @@ namespace Buffers {
             if(NULL == m_currentSegment)
             {
                 // StopThread();
-                LogNotice("PlaylistBuffer: no segment for read.");
+                LOG_RATE_LIMITED(1000, LogNotice, "PlaylistBuffer: no segment for read.");
                 break;
             }
             size_t bytesToRead = bufferSize - totalBytesRead;
@@ -249,13 +276,19 @@ namespace Buffers {
 
             } while(bytesToRead > 0 && bytesRead > 0);
             if(m_currentSegment->BytesReady() <= 0) {
-                LogDebug("PlaylistBuffer: read all data from segment. Moving next...");
+                LOG_TRACE("PlaylistBuffer: read all data from segment. Moving next...");
                 m_currentSegment = nullptr;
             }
             
 
         }
 
+        // Reader of own metrics is Kodi, otherwise the owning buffer
+        if(m_isOwnMetrics && totalBytesRead > 0) {
+            if(0 == StreamMetrics::Get(m_metrics->bytesDelivered))
+                m_metrics->startupLatencyUs = monotonic_time_us() - StreamMetrics::Get(m_metrics->startTime);
+            StreamMetrics::Add(m_metrics->bytesDelivered, totalBytesRead);
+        }
         return isEof ? -1 : totalBytesRead;
     }
     
@@ -281,10 +314,10 @@ namespace Buffers {
     int64_t PlaylistBuffer::GetPosition() const
     {
         if(!m_cache->CanSeek()) {
-            LogDebug("PlaylistBuffer: Plist archive position -1");
+            LOG_DEBUG("PlaylistBuffer: Plist archive position -1");
             return -1;
         }
-        LogDebug("PlaylistBuffer: Plist archive position %" PRId64 "", m_position);
+        LOG_DEBUG("PlaylistBuffer: Plist archive position %" PRId64 "", m_position);
         return m_position;
     }
     
@@ -293,7 +326,7 @@ namespace Buffers {
         if(!m_cache->CanSeek())
             return -1;
 
-        LogDebug("PlaylistBuffer: Seek requested pos %" PRId64 ", from %d", iPosition, iWhence);
+        LOG_DEBUG("PlaylistBuffer: Seek requested pos %" PRId64 ", from %d", iPosition, iWhence);
 
         // Translate position to offset from start of buffer.
         int64_t length = GetLength();
@@ -305,7 +338,7 @@ namespace Buffers {
             iPosition = length + iPosition;
         }
         if(iPosition < 0 )
-            LogDebug("PlaylistBuffer: Seek can't be pos %" PRId64 "", iPosition);
+            LOG_DEBUG("PlaylistBuffer: Seek can't be pos %" PRId64 "", iPosition);
 
         if(iPosition > length) {
             iPosition = length;
@@ -314,7 +347,7 @@ namespace Buffers {
             iPosition = begin;
         }
         iWhence = SEEK_SET;
-        LogDebug("PlaylistBuffer: Seek calculated pos %" PRId64 "", iPosition);
+        LOG_DEBUG("PlaylistBuffer: Seek calculated pos %" PRId64 "", iPosition);
 
         int64_t seekDelta =  iPosition - m_position;
         if(seekDelta == 0)
@@ -325,7 +358,7 @@ namespace Buffers {
             CLockObject lock(m_syncAccess);
             uint64_t nextSegmentIndex;
             if(!m_cache->PrepareSegmentForPosition(iPosition, &nextSegmentIndex)) {
-                LogDebug("PlaylistBuffer: cache failed to prepare for seek to pos %" PRId64 "", iPosition);
+                LOG_DEBUG("PlaylistBuffer: cache failed to prepare for seek to pos %" PRId64 "", iPosition);
                 return -1;
             }
             m_loadingSegmentIndex = nextSegmentIndex;
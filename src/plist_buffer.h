@@ -31,6 +31,7 @@
 #include "p8-platform/util/buffer.h"
 #include "input_buffer.h"
 #include "plist_buffer_delegate.h"
+#include "stream_metrics.h"
 
 namespace Buffers
 {
@@ -41,7 +42,8 @@ namespace Buffers
     class PlaylistBuffer :  public InputBuffer, public P8PLATFORM::CThread
     {
     public:
-        PlaylistBuffer(const std::string &streamUrl,  PlaylistBufferDelegate delegate);
+        // Creates own metrics when metrics are not shared with an owner
+        PlaylistBuffer(const std::string &streamUrl,  PlaylistBufferDelegate delegate, StreamMetricsPtr metrics = nullptr);
         ~PlaylistBuffer();
         
         int64_t GetLength() const;
@@ -64,6 +66,8 @@ namespace Buffers
         PlaylistCache* m_cache;
         Segment* m_currentSegment;
         uint64_t m_loadingSegmentIndex;
+        const StreamMetricsPtr m_metrics;
+        const bool m_isOwnMetrics;
         
         void *Process();
         void Init(const std::string &playlistUrl);
@@ -242,7 +242,7 @@ string PuzzlePVRClient::GetNextStreamUrl(ChannelId channelId)
 {
     if(m_puzzleTV == nullptr)
         return string();
-    LogError("PuzzlePVRClient:: trying to move to next stream from [%d].", m_currentChannelStreamIdx);
+    LogDebug("PuzzlePVRClient:: next stream after [%d].", m_currentChannelStreamIdx);
    return m_puzzleTV->GetNextStream(channelId, m_currentChannelStreamIdx++);
 }
 
@@ -274,6 +274,7 @@ PVR_ERROR PuzzlePVRClient::SignalStatus(PVR_SIGNAL_STATUS &signalStatus)
 {
     snprintf(signalStatus.strAdapterName, sizeof(signalStatus.strAdapterName), "IPTV Puzzle Server");
     snprintf(signalStatus.strAdapterStatus, sizeof(signalStatus.strAdapterStatus), (m_puzzleTV == NULL) ? "Not connected" :"OK");
+    FillStreamStatus(signalStatus);
     return PVR_ERROR_NO_ERROR;
 }
        
@@ -78,11 +78,14 @@ PuzzleTV::PuzzleTV(ServerVersion serverVersion, const char* serverUrl, uint16_t
 void PuzzleTV::Init(bool clearEpgCache)
 {
     RebuildChannelAndGroupList();
+    bool isEpgCacheLoaded = false;
     if(clearEpgCache)
         ClearEpgCache(c_EpgCacheFile);
     else
-        LoadEpgCache(c_EpgCacheFile);
-    LoadEpg();
+        isEpgCacheLoaded = LoadEpgCache(c_EpgCacheFile);
+    // Keep EPG cache in sync with parsed XMLTV document
+    if(LoadEpg(isEpgCacheLoaded) && m_epgType == c_EpgType_File)
+        SaveEpgCache(c_EpgCacheFile);
     UpdateArhivesAsync();
     
 //        CallRpcAsync("{\"jsonrpc\": \"2.0\", \"method\": \"Files.GetDirectory\", \"params\": {\"directory\": \"plugin://plugin.video.pazl.arhive\"},\"id\": 1}",
@@ -230,34 +233,24 @@ void PuzzleTV::BuildChannelAndGroupList()
 //    return url;
 //}
 
-bool PuzzleTV::AddXmlEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry)
+void PuzzleTV::AddXmlEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry, EpgEntryBatch& batch)
 {
-    unsigned int id = xmlEpgEntry.startTime;
-
     EpgEntry epgEntry;
     epgEntry.ChannelId = m_epgToServerLut[xmlEpgEntry.iChannelId];
     epgEntry.Title = xmlEpgEntry.strTitle;
     epgEntry.Description = xmlEpgEntry.strPlot;
     epgEntry.StartTime = xmlEpgEntry.startTime;
     epgEntry.EndTime = xmlEpgEntry.endTime;
-    return AddEpgEntry(id, epgEntry);
+    AddEpgEntry(epgEntry, batch);
 }
 
-void PuzzleTV::UpdateHasArchive(PvrClient::EpgEntry& entry)
+time_t PuzzleTV::GetArchiveDepth(PvrClient::ChannelId channelId) const
 {
-    auto channel = m_channelList.find(entry.ChannelId);
-    entry.HasArchive = channel != m_channelList.end() &&  channel->second.HasArchive;
-    
-    if(!entry.HasArchive)
-        return;
-
-    time_t now = time(nullptr);
-    time_t epgTime = m_addCurrentEpgToArchive ? entry.StartTime : entry.EndTime;
+    auto channel = m_channelList.find(channelId);
+    if(channel == m_channelList.end() || !channel->second.HasArchive)
+        return 0;
     const time_t archivePeriod = 3 * 24 * 60 * 60; //3 days in secs
-    time_t from = now - archivePeriod;
-    entry.HasArchive = epgTime > from && epgTime < now;
-
-
+    return archivePeriod;
 }
 
 void PuzzleTV::UpdateEpgForAllChannels(time_t startTime, time_t endTime)
@@ -272,11 +265,13 @@ void PuzzleTV::UpdateEpgForAllChannels(time_t startTime, time_t endTime)
         m_epgUpdateInterval.Init(interval*1000);
 
     try {
-        LoadEpg();
-        SaveEpgCache(c_EpgCacheFile);
+        // EPG store is up to date when XMLTV document was not modified
+        if(LoadEpg(true))
+            SaveEpgCache(c_EpgCacheFile);
 //        } catch (ServerErrorException& ex) {
 //            XBMC->QueueNotification(QUEUE_ERROR, XBMC->GetLocalizedString(32002), ex.reason.c_str() );
     } catch (...) {
+        OnEpgRequestFailed(UnknownChannelId, startTime, endTime);
         LogError(" >>>>  FAILED receive EPG <<<<<");
     }
 }
@@ -286,16 +281,120 @@ static bool time_compare (const EpgEntry& first, const EpgEntry& second)
     return first.StartTime < second.StartTime;
 }
 
-void PuzzleTV::LoadEpg()
+// SAX handler of server EPG (/channel/json/id=all).
+// Response is an object of channels (with "title" but without "plot" member),
+// where EPG items are objects with "title", "plot" and "img" members
+// keyed by start time. Every channel is reported as soon as it is parsed,
+// so DOM of whole response is never built.
+class PuzzleEpgSaxHandler : public BaseReaderHandler<UTF8<>, PuzzleEpgSaxHandler>
+{
+public:
+    typedef std::function<void(const char* channelId, list<EpgEntry>& serverEpg)> TChannelCallback;
+    
+    PuzzleEpgSaxHandler(const TChannelCallback& onChannel)
+    : m_onChannel(onChannel)
+    , m_depth(0)
+    , m_isRootObject(false)
+    , m_hasChannelTitle(false)
+    , m_hasChannelPlot(false)
+    , m_hasTitle(false)
+    , m_hasPlot(false)
+    , m_hasImage(false)
+    {}
+    
+    bool IsRootObject() const { return m_isRootObject; }
+    
+    bool StartObject()
+    {
+        if(0 == m_depth) {
+            m_isRootObject = true;
+        } else if(1 == m_depth && m_isRootObject) {
+            // Channel object
+            m_channelKey = m_key;
+            m_hasChannelTitle = m_hasChannelPlot = false;
+            m_serverEpg.clear();
+        } else if(2 == m_depth) {
+            // EPG item
+            m_itemKey = m_key;
+            m_hasTitle = m_hasPlot = m_hasImage = false;
+            m_entry = EpgEntry();
+        }
+        ++m_depth;
+        return true;
+    }
+    bool EndObject(SizeType)
+    {
+        --m_depth;
+        if(1 == m_depth && m_isRootObject) {
+            if(m_hasChannelTitle && !m_hasChannelPlot)
+                m_onChannel(m_channelKey.c_str(), m_serverEpg);
+            m_serverEpg.clear();
+        } else if(2 == m_depth && m_hasTitle && m_hasPlot && m_hasImage) {
+            string s = m_itemKey.substr(0, m_itemKey.find('.'));
+            m_entry.StartTime = (time_t)stoul(s.c_str());
+            m_serverEpg.push_back(m_entry);
+        }
+        return true;
+    }
+    bool StartArray() { ++m_depth; return true; }
+    bool EndArray(SizeType) { --m_depth; return true; }
+    bool Key(const char* str, SizeType length, bool)
+    {
+        m_key.assign(str, length);
+        if(2 == m_depth) {
+            m_hasChannelTitle |= m_key == "title";
+            m_hasChannelPlot |= m_key == "plot";
+        } else if(3 == m_depth) {
+            m_hasImage |= m_key == "img";
+        }
+        return true;
+    }
+    bool String(const char* str, SizeType length, bool)
+    {
+        if(3 == m_depth) {
+            if(m_key == "title") {
+                m_entry.Title.assign(str, length);
+                m_hasTitle = true;
+            } else if(m_key == "plot") {
+                m_entry.Description.assign(str, length);
+                m_hasPlot = true;
+            }
+        }
+        return true;
+    }
+    
+private:
+    const TChannelCallback m_onChannel;
+    int m_depth;
+    bool m_isRootObject;
+    string m_key;
+    string m_channelKey;
+    bool m_hasChannelTitle;
+    bool m_hasChannelPlot;
+    list<EpgEntry> m_serverEpg;
+    string m_itemKey;
+    EpgEntry m_entry;
+    bool m_hasTitle;
+    bool m_hasPlot;
+    bool m_hasImage;
+};
+
+bool PuzzleTV::LoadEpg(bool isEpgCacheLoaded)
 {
     //    using namespace XMLTV;
     auto pThis = this;
     
     if(m_epgType == c_EpgType_File) {
         
-        XMLTV::EpgEntryCallback onEpgEntry = [pThis] (const XMLTV::EpgEntry& newEntry) {pThis->AddXmlEpgEntry(newEntry);};
+        EpgEntryBatch batch;
+        XMLTV::EpgEntryCallback onEpgEntry = [pThis, &batch] (const XMLTV::EpgEntry& newEntry) {pThis->AddXmlEpgEntry(newEntry, batch);};
         
-        XMLTV::ParseEpg(m_epgUrl, onEpgEntry);
+        // Skip parsing of unmodified document when EPG store is filled already
+        bool isParsed = isEpgCacheLoaded
+            ? XMLTV::ParseEpgIfModified(m_epgUrl, onEpgEntry)
+            : XMLTV::ParseEpg(m_epgUrl, onEpgEntry);
+        AddEpgEntries(batch);
+        return isParsed;
     } else if(m_epgType == c_EpgType_Server) {
         
         auto pThis = this;
@@ -304,64 +403,49 @@ void PuzzleTV::LoadEpg()
         
         ApiFunctionData apiParams("/channel/json/id=all", m_epgServerPort);
         try {
-            CallApiFunction(apiParams, [pThis, offset] (Document& jsonRoot) {
-                if(!jsonRoot.IsObject()) {
-                    LogError("PuzzleTV: wrong JSON format of EPG ");
-                    return;
-                }
-                
-                std::for_each(jsonRoot.MemberBegin(), jsonRoot.MemberEnd(), [pThis, offset]  ( Value::ConstMemberIterator::Reference & i) {
-                    // Find channel object
-                    if(i.value.IsObject() && i.value.HasMember("title") && !i.value.HasMember("plot")) {
-                        auto channelIdStr = i.name.GetString();
-                        char* dummy;
-                        ChannelId channelId  = strtoul(channelIdStr, &dummy, 16);
-                        LogDebug("Found channel %s (0x%X)", i.name.GetString(), channelId);
-                        
-                        // Parse EPG items of channel object
-                        auto& epgObj = i.value;
-                        list<EpgEntry> serverEpg;
-                        std::for_each(epgObj.MemberBegin(), epgObj.MemberEnd(), [pThis, offset, channelId, &serverEpg]  ( Value::ConstMemberIterator::Reference & epgItem) {
-                            // Find EPG item
-                            if(epgItem.value.IsObject() && epgItem.value.HasMember("plot")  && epgItem.value.HasMember("img")  && epgItem.value.HasMember("title")) {
-                                EpgEntry epgEntry;
-                                epgEntry.ChannelId = channelId;
-                                string s = epgItem.name.GetString();
-                                s = s.substr(0, s.find('.'));
-                                unsigned long l = stoul(s.c_str());
-                                epgEntry.StartTime = (time_t)l + offset;
-                                epgEntry.Title = epgItem.value["title"].GetString();
-                                epgEntry.Description = epgItem.value["plot"].GetString();
-                                // Causes Kodi crash on reload epg
-//                                epgEntry.IconPath = epgItem.value["img"].GetString();
-                                serverEpg.push_back(epgEntry);
-                            }
-                        });
-                        serverEpg.sort(time_compare);
-                        auto runner = serverEpg.begin();
-                        auto end = serverEpg.end();
-                        if(runner != end){
-                            auto pItem = runner++;
-                            while(runner != end) {
-                                pItem->EndTime = runner->StartTime;
-                                pThis->AddEpgEntry(pItem->StartTime, *pItem);
-                                runner++; pItem++;
-                            }
-                            LogDebug(" Puzzle Server: channel ID=%X has %d EPGs. From %s to %s",
-                                     channelId,
-                                     serverEpg.size(),
-                                     time_t_to_string(serverEpg.front().StartTime).c_str(),
-                                     time_t_to_string(serverEpg.back().StartTime).c_str());
+            // Response may be huge. Parse it with SAX handler channel by channel.
+            RawResponseParser parser([pThis, offset] (const std::string& response) {
+                PuzzleEpgSaxHandler handler([pThis, offset] (const char* channelIdStr, list<EpgEntry>& serverEpg) {
+                    char* dummy;
+                    ChannelId channelId  = strtoul(channelIdStr, &dummy, 16);
+                    LogDebug("Found channel %s (0x%X)", channelIdStr, channelId);
+                    
+                    for(auto& epgEntry : serverEpg) {
+                        epgEntry.ChannelId = channelId;
+                        epgEntry.StartTime += offset;
+                    }
+                    serverEpg.sort(time_compare);
+                    auto runner = serverEpg.begin();
+                    auto end = serverEpg.end();
+                    if(runner != end){
+                        EpgEntryBatch batch;
+                        auto pItem = runner++;
+                        while(runner != end) {
+                            pItem->EndTime = runner->StartTime;
+                            pThis->AddEpgEntry(*pItem, batch);
+                            runner++; pItem++;
                         }
+                        pThis->AddEpgEntries(batch);
+                        LogDebug(" Puzzle Server: channel ID=%X has %d EPGs. From %s to %s",
+                                 channelId,
+                                 serverEpg.size(),
+                                 time_t_to_string(serverEpg.front().StartTime).c_str(),
+                                 time_t_to_string(serverEpg.back().StartTime).c_str());
                     }
                 });
+                pThis->ParseJsonSax(response, handler);
+                if(!handler.IsRootObject())
+                    LogError("PuzzleTV: wrong JSON format of EPG ");
             });
+            CallApiFunction(apiParams, parser);
         } catch (...) {
             LogError("PuzzleTV: exception on lodaing JSON EPG");
         }
     }else {
         LogError("PuzzleTV: unknown EPG source type %d", m_epgType);
+        return false;
     }
+    return true;
 }
 
 bool PuzzleTV::CheckChannelId(ChannelId channelId)
@@ -474,6 +558,30 @@ void PuzzleTV::CallApiFunction(const ApiFunctionData& data, TParser parser)
         }
 }
 
+template <typename TParser>
+void PuzzleTV::ParseApiResponse(const std::string& response, const TParser& parser)
+{
+    ParseJson(response, [&parser] (Document& jsonRoot)
+              {
+                  //if (!jsonRoot.HasMember("error"))
+                  {
+                      parser(jsonRoot);
+                      return;
+                  }
+//                  const Value & errObj = jsonRoot["error"];
+//                  auto err = errObj["message"].GetString();
+//                  auto code = errObj["code"].GetInt();
+//                  LogError("Puzzle TV server responses error:");
+//                  LogError(err);
+//                  throw ServerErrorException(err,code);
+              });
+}
+
+void PuzzleTV::ParseApiResponse(const std::string& response, const RawResponseParser& parser)
+{
+    parser.parse(response);
+}
+
 template <typename TParser, typename TCompletion>
 void PuzzleTV::CallApiAsync(const ApiFunctionData& data, TParser parser, TCompletion completion)
 {
@@ -512,20 +620,7 @@ void PuzzleTV::CallApiAsync(const ApiFunctionData& data, TParser parser, TComple
 //            pos +=  16383;
 //        }
 
-        pThis->ParseJson(response, [&parser] (Document& jsonRoot)
-                  {
-                      //if (!jsonRoot.HasMember("error"))
-                      {
-                          parser(jsonRoot);
-                          return;
-                      }
-//                      const Value & errObj = jsonRoot["error"];
-//                      auto err = errObj["message"].GetString();
-//                      auto code = errObj["code"].GetInt();
-//                      LogError("Puzzle TV server responses error:");
-//                      LogError(err);
-//                      throw ServerErrorException(err,code);
-                  });
+        pThis->ParseApiResponse(response, parser);
     };
 
     m_httpEngine->CallApiAsync(strRequest, parserWrapper,  [completion](const ActionQueue::ActionResult& ss){completion(ss);});
@@ -98,15 +98,16 @@ namespace PuzzleEngine
         void UpdateChannelStreams(PvrClient::ChannelId channelId);
     protected:
         void Init(bool clearEpgCache);
-        virtual void UpdateHasArchive(PvrClient::EpgEntry& entry);
+        virtual time_t GetArchiveDepth(PvrClient::ChannelId channelId) const;
         void BuildChannelAndGroupList();
 
     private:
         typedef std::vector<std::string> StreamerIdsList;
 
         struct ApiFunctionData;
-        bool AddXmlEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry);
-        void LoadEpg();
+        void AddXmlEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry, EpgEntryBatch& batch);
+        // Returns true when EPG store was updated
+        bool LoadEpg(bool isEpgCacheLoaded);
         void UpdateArhivesAsync();
         
         bool CheckChannelId(PvrClient::ChannelId channelId);
@@ -116,6 +117,9 @@ namespace PuzzleEngine
         void CallApiFunction(const ApiFunctionData& data, TParser parser);
         template <typename TParser, typename TCompletion>
         void CallApiAsync(const ApiFunctionData& data, TParser parser, TCompletion completion);
+        template <typename TParser>
+        void ParseApiResponse(const std::string& response, const TParser& parser);
+        void ParseApiResponse(const std::string& response, const PvrClient::RawResponseParser& parser);
 
         const uint16_t m_serverPort;
         const std::string m_serverUri;
@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <algorithm>
 #include <list>
+#include <vector>
 #include "kodi/libXBMC_addon.h"
 #include "kodi/Filesystem.h"
 // Patch for Kodi buggy VFSDirEntry declaration
@@ -60,12 +61,16 @@ struct VFSDirEntry_Patch
 #include "memory_cache_buffer.hpp"
 #include "plist_buffer.h"
 #include "direct_buffer.h"
+#include "failover_buffer.h"
 #include "simple_cyclic_buffer.hpp"
 #include "helpers.h"
 #include "pvr_client_base.h"
 #include "globals.hpp"
 #include "HttpEngine.hpp"
+#include "ActionQueue.hpp"
 #include "client_core_base.hpp"
+#include "stream_metrics.h"
+#include "ts_index.h"
 
 
 using namespace std;
@@ -82,6 +87,12 @@ namespace CurlUtils
 // NOTE: avoid '.' (dot) char in path. Causes to deadlock in Kodi code.
 static const char* s_DefaultCacheDir = "special://temp/pvr-puzzle-tv";
 static const char* s_DefaultRecordingsDir = "special://temp/pvr-puzzle-tv/recordings";
+static const char* c_StreamMetricsFile = "stream_metrics.json";
+static const uint32_t c_MetricsDumpInterval = 10 * 1000; // 10 sec
+static const int c_MaxStreamCandidates = 5;
+// Max share of time recording writers may spend in disk I/O
+static const double c_MaxRecordingsDiskBusy = 0.8;
+static const uint32_t c_RecordIndexRefreshMs = 5 * 1000; // 5 sec
 static std::string s_LocalRecPrefix = "Local";
 static std::string s_RemoteRecPrefix = "On Server";
 
@@ -92,7 +103,8 @@ ADDON_STATUS PVRClientBase::Init(PVR_PROPERTIES* pvrprops)
 {
     m_clientCore = NULL;
     m_inputBuffer = NULL;
-    m_recordBuffer = m_localRecordBuffer = NULL;
+    m_recordBuffer = NULL;
+    m_recordIndexLength = 0;
     
     LogDebug( "User path: %s", pvrprops->strUserPath);
     LogDebug( "Client path: %s", pvrprops->strClientPath);
@@ -137,6 +149,15 @@ ADDON_STATUS PVRClientBase::Init(PVR_PROPERTIES* pvrprops)
     
     m_addCurrentEpgToArchive = true;
     XBMC->GetSetting("archive_for_current_epg_item", &m_addCurrentEpgToArchive);
+    
+    m_maxLocalRecordings = 3;
+    XBMC->GetSetting("max_local_recordings", &m_maxLocalRecordings);
+    m_maxRecordingBandwidth = 0;
+    XBMC->GetSetting("max_recording_bandwidth", &m_maxRecordingBandwidth);
+
+    bool isDebugLogEnabled = false;
+    XBMC->GetSetting("enable_debug_log", &isDebugLogEnabled);
+    SetDebugLogEnabled(isDebugLogEnabled);
 
     long waitForInetTimeout = 0;
     XBMC->GetSetting("wait_for_inet", &waitForInetTimeout);
@@ -186,9 +207,11 @@ ADDON_STATUS PVRClientBase::Init(PVR_PROPERTIES* pvrprops)
     s_RemoteRecPrefix = localizedString;
     XBMC->FreeString(localizedString);
     
-    m_liveChannelId =  m_localRecordChannelId = UnknownChannelId;
+    m_liveChannelId = UnknownChannelId;
     m_lastBytesRead = 1;
+    m_lastIngestedBytes = m_lastIngestedTime = 0;
     m_lastRecordingsAmount = 0;
+    m_lastRecordingsHash = 0;
     
     return ADDON_STATUS_OK;
     
@@ -202,8 +225,13 @@ void PVRClientBase::Cleanup()
 {
     CloseLiveStream();
     CloseRecordedStream();
-    if(m_localRecordBuffer)
-        SAFE_DELETE(m_localRecordBuffer);
+    // Recordings may share ingest
+    std::set<Buffers::TimeshiftBuffer*> ingests;
+    for (auto& recording : m_localRecordings)
+        ingests.insert(recording.second.buffer);
+    m_localRecordings.clear();
+    for (auto ingest : ingests)
+        delete ingest;
 }
 
 void PVRClientBase::OnSystemSleep()
@@ -259,6 +287,18 @@ ADDON_STATUS PVRClientBase::SetSetting(const char *settingName, const void *sett
     {
         m_rpcPort = *(int *)(settingValue);
     }
+    else if (strcmp(settingName, "max_local_recordings") == 0)
+    {
+        m_maxLocalRecordings = *(int *)(settingValue);
+    }
+    else if (strcmp(settingName, "max_recording_bandwidth") == 0)
+    {
+        m_maxRecordingBandwidth = *(int *)(settingValue);
+    }
+    else if (strcmp(settingName, "enable_debug_log") == 0)
+    {
+        SetDebugLogEnabled(*(bool *)(settingValue));
+    }
     else if (strcmp(settingName, "archive_for_current_epg_item") == 0)
     {
         m_addCurrentEpgToArchive = *(bool *)(settingValue);
@@ -500,18 +540,37 @@ PVR_ERROR PVRClientBase::GetEPGForChannel(ADDON_HANDLE handle, const PVR_CHANNEL
 
 #pragma mark - Streams
 
-InputBuffer*  PVRClientBase::BufferForUrl(const std::string& url )
+InputBuffer*  PVRClientBase::BufferForUrl(const std::string& url, const StreamMetricsPtr& metrics)
 {
     InputBuffer* buffer = NULL;
     const std::string m3uExt = ".m3u";
     const std::string m3u8Ext = ".m3u8";
     if( url.find(m3u8Ext) != std::string::npos || url.find(m3uExt) != std::string::npos)
-        buffer = new Buffers::PlaylistBuffer(url, NULL); // No segments cache for live playlist
+        buffer = new Buffers::PlaylistBuffer(url, NULL, metrics); // No segments cache for live playlist
     else
         buffer = new DirectBuffer(url);
     return buffer;
 }
 
+InputBuffer*  PVRClientBase::BufferForUrls(const std::vector<std::string>& urls, const StreamMetricsPtr& metrics)
+{
+    return new Buffers::FailoverBuffer(urls, [metrics](const std::string& url) {
+        return BufferForUrl(url, metrics);
+    }, metrics);
+}
+
+std::vector<std::string> PVRClientBase::GetStreamUrls(ChannelId channelId)
+{
+    std::vector<std::string> urls;
+    std::string url = GetStreamUrl(channelId);
+    for(int i = 0; i < c_MaxStreamCandidates && !url.empty(); ++i) {
+        if(std::find(urls.begin(), urls.end(), url) == urls.end())
+            urls.push_back(url);
+        url = GetNextStreamUrl(channelId);
+    }
+    return urls;
+}
+
 std::string PVRClientBase::GetStreamUrl(ChannelId channel)
 {
     if(NULL == m_clientCore)
@@ -522,20 +581,7 @@ std::string PVRClientBase::GetStreamUrl(ChannelId channel)
 bool PVRClientBase::OpenLiveStream(const PVR_CHANNEL& channel)
 {
     m_lastBytesRead = 1;
-    bool succeeded = OpenLiveStream(channel.iUniqueId, GetStreamUrl(channel.iUniqueId));
-    bool tryToRecover = !succeeded;
-    while(tryToRecover) {
-        string url = GetNextStreamUrl(channel.iUniqueId);
-        if(url.empty()) {// nomore streams
-            LogDebug("No alternative stream found.");
-            break;
-        }
-        succeeded = OpenLiveStream(channel.iUniqueId, url);
-        tryToRecover = !succeeded;
-    }
-    
-    return succeeded;
-
+    return OpenLiveStream(channel.iUniqueId, GetStreamUrls(channel.iUniqueId));
 }
 
 Buffers::ICacheBuffer* PVRClientBase::CreateLiveCache() const {
@@ -551,27 +597,38 @@ Buffers::ICacheBuffer* PVRClientBase::CreateLiveCache() const {
 
 }
 
-bool PVRClientBase::OpenLiveStream(ChannelId channelId, const std::string& url )
+bool PVRClientBase::OpenLiveStream(ChannelId channelId, const std::vector<std::string>& urls)
 {
     
     if(channelId == m_liveChannelId && IsLiveInRecording())
         return true; // Do not change url of local recording stream
 
-    if(channelId == m_localRecordChannelId) {
+    {
         CLockObject lock(m_mutex);
-        m_liveChannelId = m_localRecordChannelId;
-        m_inputBuffer = m_localRecordBuffer;
-        return true;
+        Buffers::TimeshiftBuffer* recordBuffer = FindLocalRecordBuffer(channelId);
+        if(nullptr != recordBuffer) {
+            CloseLiveStream();
+            m_liveChannelId = channelId;
+            m_inputBuffer = recordBuffer;
+            return true;
+        }
     }
 
     m_liveChannelId = UnknownChannelId;
-    if (url.empty())
+    if (urls.empty())
         return false;
     try
     {
-        InputBuffer* buffer = BufferForUrl(url);
+        StreamMetricsPtr metrics = std::make_shared<StreamMetrics>();
+        InputBuffer* buffer = BufferForUrls(urls, metrics);
         CLockObject lock(m_mutex);
-        m_inputBuffer = new Buffers::TimeshiftBuffer(buffer, CreateLiveCache());
+        // Leaving ingest of a recording
+        if(nullptr != m_inputBuffer)
+            CloseLiveStream();
+        m_inputBuffer = new Buffers::TimeshiftBuffer(buffer, CreateLiveCache(), metrics);
+        m_lastIngestedBytes = m_lastIngestedTime = 0;
+        m_ingestWatchdog.Reset();
+        m_metricsDumpTimeout.Init(c_MetricsDumpInterval);
 
     }
     catch (InputBufferException &ex)
@@ -591,8 +648,11 @@ void PVRClientBase::CloseLiveStream()
         LogNotice("PVRClientBase: closing input sream...");
         SAFE_DELETE(m_inputBuffer);
         LogNotice("PVRClientBase: input sream closed.");
-    } else{
+    } else if(m_inputBuffer) {
+        // Recordings continue without live reader
+        Buffers::TimeshiftBuffer* ingest = m_inputBuffer;
         m_inputBuffer = nullptr;
+        PromoteRecordingCache(ingest);
     }
 }
 
@@ -606,19 +666,73 @@ int PVRClientBase::ReadLiveStream(unsigned char* pBuffer, unsigned int iBufferSi
     if (bytesRead != iBufferSize && m_lastBytesRead > 0 && !IsLiveInRecording()) {
         LogError("PVRClientBase:: trying to restart current channel.");
 
-        string url = GetStreamUrl(GetLiveChannelId());
-        if(!url.empty()){
+        std::vector<std::string> urls = GetStreamUrls(GetLiveChannelId());
+        if(!urls.empty()){
+            StreamMetrics::Add(m_inputBuffer->Metrics()->reconnects);
             char* message = XBMC->GetLocalizedString(32000);
             XBMC->QueueNotification(QUEUE_INFO, message);
             XBMC->FreeString(message);
-            SwitchChannel(GetLiveChannelId(), url);
+            SwitchChannel(GetLiveChannelId(), urls);
             bytesRead = m_inputBuffer->Read(pBuffer, iBufferSize, m_channelReloadTimeout * 1000);
         }
    }
     m_lastBytesRead = bytesRead;
+    // Replace slow source before the player drains buffered data
+    if(!IsLiveInRecording() && m_ingestWatchdog.IsStarving(*m_inputBuffer->Metrics())) {
+        LogNotice("PVRClientBase: ingest %.2f MB/s is below stream rate %.2f MB/s, replacing source.",
+                  m_ingestWatchdog.IngestRate(), m_ingestWatchdog.NominalRate());
+        m_inputBuffer->RequestFailover();
+    }
+    if(m_metricsDumpTimeout.TimeLeft() == 0) {
+        DumpStreamMetrics();
+        m_metricsDumpTimeout.Init(c_MetricsDumpInterval);
+    }
     return bytesRead;
 }
 
+void PVRClientBase::DumpStreamMetrics()
+{
+    if(nullptr == m_inputBuffer)
+        return;
+    StreamMetricsPtr metrics = m_inputBuffer->Metrics();
+    const ChannelId channelId = m_liveChannelId;
+    const std::string path = m_cacheDir + "/" + c_StreamMetricsFile;
+    // Do not block Kodi's reading thread with file I/O
+    ActionQueue::CThreadPool::Shared().PerformAsync([metrics, channelId, path] {
+        std::string json = "{\"channelId\":" + n_to_string(channelId) + ",\"metrics\":" + metrics->ToJson() + "}";
+        void* file = XBMC->OpenFileForWrite(path.c_str(), true);
+        if(NULL == file)
+            return;
+        XBMC->WriteFile(file, json.c_str(), json.size());
+        XBMC->CloseFile(file);
+    }, [](const ActionQueue::ActionResult& s) {
+        if(s.status == ActionQueue::kActionFailed)
+            LogError("PVRClientBase: failed to write stream metrics.");
+    });
+}
+
+void PVRClientBase::FillStreamStatus(PVR_SIGNAL_STATUS& signalStatus)
+{
+    CLockObject lock(m_mutex);
+    if(nullptr == m_inputBuffer)
+        return;
+    StreamMetricsPtr metrics = m_inputBuffer->Metrics();
+    const uint64_t now = monotonic_time_us();
+    const uint64_t ingested = StreamMetrics::Get(metrics->bytesIngested);
+    // Current rate since previous status request, session average for the first one
+    double rate = (0 == m_lastIngestedTime || ingested < m_lastIngestedBytes)
+        ? StreamMetrics::Rate(ingested, metrics->SessionTimeUs())
+        : StreamMetrics::Rate(ingested - m_lastIngestedBytes, now - m_lastIngestedTime);
+    m_lastIngestedBytes = ingested;
+    m_lastIngestedTime = now;
+    
+    snprintf(signalStatus.strMuxName, sizeof(signalStatus.strMuxName), "In %.2f MB/s, cache %lld KB, wait p90 %llu ms",
+             rate, (long long) metrics->cacheFill.load() / 1024, (unsigned long long) metrics->readerWait.Percentile(90) / 1000);
+    // Reader stalls and reconnects are reported as uncorrected blocks and errors
+    signalStatus.iUNC = (long) StreamMetrics::Get(metrics->readerStalls);
+    signalStatus.iBER = (long) StreamMetrics::Get(metrics->reconnects);
+}
+
 long long PVRClientBase::SeekLiveStream(long long iPosition, int iWhence)
 {
     CLockObject lock(m_mutex);
@@ -639,19 +753,40 @@ long long PVRClientBase::LengthLiveStream()
 
 bool PVRClientBase::SwitchChannel(const PVR_CHANNEL& channel)
 {
-    return SwitchChannel(channel.iUniqueId, GetStreamUrl(channel.iUniqueId));
+    {
+        // New metrics session for another channel
+        CLockObject lock(m_mutex);
+        if(m_inputBuffer && !IsLiveInRecording()) {
+            StreamMetricsPtr metrics = m_inputBuffer->Metrics();
+            metrics->Log("Live stream");
+            metrics->Reset();
+            m_lastIngestedBytes = m_lastIngestedTime = 0;
+            m_ingestWatchdog.Reset();
+        }
+    }
+    return SwitchChannel(channel.iUniqueId, GetStreamUrls(channel.iUniqueId));
 }
 
-bool PVRClientBase::SwitchChannel(ChannelId channelId, const std::string& url)
+bool PVRClientBase::SwitchChannel(ChannelId channelId, const std::vector<std::string>& urls)
 {
-    if(url.empty())
+    if(urls.empty())
         return false;
     CLockObject lock(m_mutex);
-    if(IsLiveInRecording() || channelId == m_localRecordChannelId)
-        return OpenLiveStream(channelId, url); // Split/join live and recording streams (when nesessry)
+    if(IsLiveInRecording() || nullptr != FindLocalRecordBuffer(channelId))
+        return OpenLiveStream(channelId, urls); // Split/join live and recording streams (when nesessry)
     
+    // Just change live stream
+    try {
+        if(!m_inputBuffer->SwitchInput(BufferForUrls(urls, m_inputBuffer->Metrics())))
+            return false;
+    }
+    catch (InputBufferException &ex)
+    {
+        LogError(  "PVRClientBase: input buffer error in SwitchChannel: %s", ex.what());
+        return false;
+    }
     m_liveChannelId = channelId;
-    return m_inputBuffer->SwitchStream(url); // Just change live stream
+    return true;
 }
 
 void PVRClientBase::SetTimeshiftEnabled(bool enable)
@@ -693,13 +828,14 @@ int PVRClientBase::GetRecordingsAmount(bool deleted)
         return 0;
     
     int size = 0;
-    IClientCore::EpgEntryAction action = [&size](const EpgEntryList::value_type& p)
+    uint64_t hash = c_HashInitialValue;
+    IClientCore::EpgEntryAction action = [&size, &hash](const EpgEntryList::value_type& p)
     {
-        if(p.second.HasArchive)
-            ++size;
+        ++size;
+        hash = hash_combine(hash_combine(hash, p.first), p.second.EndTime);
         return true;
     };
-    m_clientCore->ForEachEpg(action);
+    m_clientCore->ForEachArchiveEntry(action);
 //    if(size == 0){
 //        m_clientCore->ReloadRecordings();
 //        m_clientCore->ForEachEpg(action);
@@ -714,9 +850,10 @@ int PVRClientBase::GetRecordingsAmount(bool deleted)
             VFSDirEntry_Patch* patched_files = (VFSDirEntry_Patch*) files;
             for (int i = 0; i < num_files; ++i) {
                 const VFSDirEntry_Patch& f = patched_files[i];
-                if(f.folder)
+                if(f.folder) {
                     ++size;
-
+                    hash = hash_combine(hash, std::hash<std::string>()(f.path));
+                }
             }
             XBMC->FreeDirectory(files, num_files);
         } else {
@@ -725,8 +862,10 @@ int PVRClientBase::GetRecordingsAmount(bool deleted)
 
     }
 
-    if(m_lastRecordingsAmount  != size)
+    // Do not retransfer unchanged recordings
+    if(m_lastRecordingsHash != hash)
         PVR->TriggerRecordingUpdate();
+    m_lastRecordingsHash = hash;
     LogDebug("PVRClientBase: found %d recordings. Was %d", size, m_lastRecordingsAmount);
     m_lastRecordingsAmount = size;
     return size;
@@ -735,29 +874,50 @@ int PVRClientBase::GetRecordingsAmount(bool deleted)
 
 void PVRClientBase::FillRecording(const EpgEntryList::value_type& epgEntry, PVR_RECORDING& tag, const char* dirPrefix)
 {
-    const auto& epgTag = epgEntry.second;
+    RecordingDirectoryCache dirCache;
+    FillRecording(epgEntry.first, epgEntry.second, tag, dirPrefix, dirCache);
+}
+
+void PVRClientBase::FillRecording(UniqueBroadcastIdType id, const EpgEntry& epgTag, PVR_RECORDING& tag, const char* dirPrefix, RecordingDirectoryCache& dirCache)
+{
     
-    sprintf(tag.strRecordingId, "%d",  epgEntry.first);
+    if(dirCache.channelId != epgTag.ChannelId) {
+        dirCache.channelId = epgTag.ChannelId;
+        dirCache.channelName = m_clientCore->GetChannelList().at(epgTag.ChannelId).Name;
+        dirCache.dayStart = dirCache.dayEnd = 0;
+    }
+    if(epgTag.StartTime < dirCache.dayStart || epgTag.StartTime >= dirCache.dayEnd) {
+        struct tm day = *localtime(&epgTag.StartTime);
+        char buff[20];
+        strftime(buff, sizeof(buff), "/%d-%m-%y", &day);
+        dirCache.directory = dirPrefix;
+        dirCache.directory += '/';
+        dirCache.directory += dirCache.channelName;
+        dirCache.directory += buff;
+        // Local day boundaries
+        day.tm_hour = day.tm_min = day.tm_sec = 0;
+        day.tm_isdst = -1;
+        dirCache.dayStart = mktime(&day);
+        ++day.tm_mday;
+        day.tm_isdst = -1;
+        dirCache.dayEnd = mktime(&day);
+    }
+    
+    sprintf(tag.strRecordingId, "%d",  id);
     strncpy(tag.strTitle, epgTag.Title.c_str(), PVR_ADDON_NAME_STRING_LENGTH - 1);
     strncpy(tag.strPlot, epgTag.Description.c_str(), PVR_ADDON_DESC_STRING_LENGTH - 1);
-    strncpy(tag.strChannelName, m_clientCore->GetChannelList().at(epgTag.ChannelId).Name.c_str(), PVR_ADDON_NAME_STRING_LENGTH - 1);
+    strncpy(tag.strChannelName, dirCache.channelName.c_str(), PVR_ADDON_NAME_STRING_LENGTH - 1);
     tag.recordingTime = epgTag.StartTime;
     tag.iLifetime = 0; /* not implemented */
     
     tag.iDuration = epgTag.EndTime - epgTag.StartTime;
-    tag.iEpgEventId = epgEntry.first;
+    tag.iEpgEventId = id;
     tag.iChannelUid = epgTag.ChannelId;
     tag.channelType = PVR_RECORDING_CHANNEL_TYPE_TV;
     if(!epgTag.IconPath.empty())
         strncpy(tag.strIconPath, epgTag.IconPath.c_str(), sizeof(tag.strIconPath) -1);
     
-    string dirName(dirPrefix);
-    dirName += '/';
-    dirName += tag.strChannelName;
-    char buff[20];
-    strftime(buff, sizeof(buff), "/%d-%m-%y", localtime(&epgTag.StartTime));
-    dirName += buff;
-    strncpy(tag.strDirectory, dirName.c_str(), PVR_ADDON_NAME_STRING_LENGTH - 1);
+    strncpy(tag.strDirectory, dirCache.directory.c_str(), PVR_ADDON_NAME_STRING_LENGTH - 1);
 
 }
 PVR_ERROR PVRClientBase::GetRecordings(ADDON_HANDLE handle, bool deleted)
@@ -774,33 +934,39 @@ PVR_ERROR PVRClientBase::GetRecordings(ADDON_HANDLE handle, bool deleted)
 
     
     PVR_ERROR result = PVR_ERROR_NO_ERROR;
-    auto pThis = this;
     
-    std::list<PVR_RECORDING> recs;
-    IClientCore::EpgEntryAction action = [pThis ,&result, &recs](const EpgEntryList::value_type& epgEntry)
+    // Populate server recordings.
+    // Only IDs of archive entries are collected under EPG lock.
+    // Entries are looked up one by one and transferred without the lock,
+    // since Kodi may call back into the addon during transfer.
+    // Single entry and tag are reused for whole archive.
+    std::vector<UniqueBroadcastIdType> archive;
+    IClientCore::EpgEntryAction action = [&archive](const EpgEntryList::value_type& epgEntry)
     {
+        archive.push_back(epgEntry.first);
+        return true;
+    };
+    m_clientCore->ForEachArchiveEntry(action);
+    
+    EpgEntry epgTag;
+    PVR_RECORDING tag;
+    RecordingDirectoryCache dirCache;
+    for(const auto& id : archive) {
         try {
-            if(!epgEntry.second.HasArchive)
-                return true;
-
-            PVR_RECORDING tag = { 0 };
-            pThis->FillRecording(epgEntry, tag, s_RemoteRecPrefix.c_str());
-            recs.push_back(tag);
-            return true;
+            // Entry may be removed by EPG update meanwhile
+            if(!m_clientCore->GetEpgEntry(id, epgTag))
+                continue;
+            memset(&tag, 0, sizeof(tag));
+            FillRecording(id, epgTag, tag, s_RemoteRecPrefix.c_str(), dirCache);
+            PVR->TransferRecordingEntry(handle, &tag);
         }
         catch (...)  {
             LogError( "%s: failed.", __FUNCTION__);
             result = PVR_ERROR_FAILED;
+            break;
         }
-        // Should not be here..
-        return false;
-    };
-    m_clientCore->ForEachEpg(action);
-    
-    // Populate server recordings
-    for (auto& r : recs) {
-        PVR->TransferRecordingEntry(handle, &r);
     }
+    
     // Add local recordings
     if(XBMC->DirectoryExists(m_recordingsDir.c_str()))
     {
@@ -875,7 +1041,95 @@ PVR_ERROR PVRClientBase::DeleteRecording(const PVR_RECORDING &recording)
 
 bool PVRClientBase::IsLiveInRecording() const
 {
-    return m_inputBuffer == m_localRecordBuffer;
+    CLockObject lock(m_mutex);
+    if(nullptr == m_inputBuffer)
+        return false;
+    for (const auto& recording : m_localRecordings) {
+        if(recording.second.buffer == m_inputBuffer)
+            return true;
+    }
+    return false;
+}
+
+Buffers::TimeshiftBuffer* PVRClientBase::FindLocalRecordBuffer(ChannelId channelId) const
+{
+    for (const auto& recording : m_localRecordings) {
+        if(recording.second.channelId == channelId)
+            return recording.second.buffer;
+    }
+    return nullptr;
+}
+
+Buffers::TimeshiftBuffer* PVRClientBase::FindIngest(ChannelId channelId) const
+{
+    if(nullptr != m_inputBuffer && m_liveChannelId == channelId)
+        return m_inputBuffer;
+    return FindLocalRecordBuffer(channelId);
+}
+
+bool PVRClientBase::PromoteRecordingCache(Buffers::TimeshiftBuffer* ingest)
+{
+    LocalRecording* candidate = nullptr;
+    for (auto& recording : m_localRecordings) {
+        if(recording.second.buffer != ingest)
+            continue;
+        if(nullptr == recording.second.sink)
+            return true;
+        if(nullptr == candidate)
+            candidate = &recording.second;
+    }
+    if(nullptr == candidate)
+        return false;
+    // Main cache without reader would block the ingest
+    ingest->PromoteSink(candidate->sink);
+    candidate->sink = nullptr;
+    return true;
+}
+
+bool PVRClientBase::CanStartLocalRecording(ChannelId channelId) const
+{
+    const size_t slotsCount = m_localRecordings.size() + m_startingRecordings.size();
+    if(m_maxLocalRecordings > 0 && slotsCount >= (size_t) m_maxLocalRecordings) {
+        LogError("PVRClientBase: limit of %d local recordings is reached.", m_maxLocalRecordings);
+        return false;
+    }
+    // New stream is expected to be as heavy as an average running one
+    double ingestRate = 0.0;
+    int streamsCount = 0;
+    double diskBusy = 0.0;
+    std::set<Buffers::TimeshiftBuffer*> ingests;
+    for (const auto& recording : m_localRecordings)
+        ingests.insert(recording.second.buffer);
+    for (auto ingest : ingests) {
+        StreamMetricsPtr metrics = ingest->Metrics();
+        const uint64_t sessionTime = metrics->SessionTimeUs();
+        if(0 == sessionTime)
+            continue;
+        ingestRate += StreamMetrics::Rate(StreamMetrics::Get(metrics->bytesIngested), sessionTime);
+        // Share of time the recording writer spends in the file cache
+        diskBusy += double(StreamMetrics::Get(metrics->cacheWriteTimeUs)) / sessionTime;
+        ++streamsCount;
+    }
+    const int recordingsCount = streamsCount;
+    if(nullptr != m_inputBuffer && !IsLiveInRecording()) {
+        StreamMetricsPtr metrics = m_inputBuffer->Metrics();
+        ingestRate += StreamMetrics::Rate(StreamMetrics::Get(metrics->bytesIngested), metrics->SessionTimeUs());
+        ++streamsCount;
+    }
+    if(0 == streamsCount)
+        return true;
+    // Recording of ingested channel does not need bandwidth. MB/s to Mbit/s
+    const bool isIngested = nullptr != FindIngest(channelId);
+    const double expectedBandwidth = (ingestRate + (isIngested ? 0.0 : ingestRate / streamsCount)) * 8;
+    if(m_maxRecordingBandwidth > 0 && expectedBandwidth > m_maxRecordingBandwidth) {
+        LogError("PVRClientBase: another recording requires %.1f Mbit/s of %d allowed.", expectedBandwidth, m_maxRecordingBandwidth);
+        return false;
+    }
+    if(recordingsCount > 0 && diskBusy + diskBusy / recordingsCount > c_MaxRecordingsDiskBusy) {
+        LogError("PVRClientBase: disk is too busy (%.0f%%) for another recording.", diskBusy * 100);
+        return false;
+    }
+    return true;
 }
 
 
@@ -889,11 +1143,18 @@ bool PVRClientBase::OpenRecordedStream(const PVR_RECORDING &recording)
     if(!IsLocalRecording(recording))
         return false;
     try {
-        InputBuffer* buffer = new DirectBuffer(new FileCacheBuffer(DirectoryForRecording(stoul(recording.strRecordingId))));
+        const std::string recordDir = DirectoryForRecording(stoul(recording.strRecordingId));
+        InputBuffer* buffer = new DirectBuffer(new FileCacheBuffer(recordDir));
         
         if(m_recordBuffer)
             SAFE_DELETE(m_recordBuffer);
         m_recordBuffer = buffer;
+        m_recordDir = recordDir;
+        m_recordIndexLength = m_recordBuffer->GetLength();
+        m_recordIndexRefresh.Init(c_RecordIndexRefreshMs);
+        // Recordings made before the index report no stream times
+        if(!m_recordIndex.Load(m_recordDir))
+            LogInfo("OpenRecordedStream (local): recording has no TS index.");
     } catch (std::exception ex) {
         LogError("OpenRecordedStream (local) exception: %s", ex.what());
     }
@@ -937,6 +1198,8 @@ void PVRClientBase::CloseRecordedStream(void)
         SAFE_DELETE(m_recordBuffer);
         LogNotice("PVRClientBase: input recorded closed.");
     }
+    m_recordIndex = Buffers::TsIndex();
+    m_recordDir.clear();
     
 }
 
@@ -966,6 +1229,32 @@ long long PVRClientBase::LengthRecordedStream(void)
     return (m_recordBuffer == NULL) ? -1 : m_recordBuffer->GetLength();
 }
 
+// Kodi's time base of PTS values (microseconds)
+static const double c_DvdTimeBase = 1000000.0;
+
+PVR_ERROR PVRClientBase::GetStreamTimes(PVR_STREAM_TIMES* times)
+{
+    if(m_recordBuffer == NULL || m_recordDir.empty())
+        return PVR_ERROR_NOT_IMPLEMENTED;
+    // Kodi polls stream times during playback.
+    // Recording in progress grows beyond loaded index.
+    if(m_recordIndexRefresh.TimeLeft() == 0) {
+        m_recordIndexRefresh.Init(c_RecordIndexRefreshMs);
+        const int64_t length = m_recordBuffer->GetLength();
+        if(length != m_recordIndexLength) {
+            m_recordIndexLength = length;
+            m_recordIndex.Load(m_recordDir);
+        }
+    }
+    if(m_recordIndex.IsEmpty())
+        return PVR_ERROR_NOT_IMPLEMENTED;
+    times->startTime = 0;
+    times->ptsStart = 0;
+    times->ptsBegin = 0;
+    times->ptsEnd = m_recordIndex.DurationMs() * int64_t(c_DvdTimeBase / 1000);
+    return PVR_ERROR_NO_ERROR;
+}
+
 PVR_ERROR PVRClientBase::IsEPGTagRecordable(const EPG_TAG*, bool* bIsRecordable)
 {
     // Seems we can record all tags
@@ -996,6 +1285,28 @@ bool PVRClientBase::StartRecordingFor(const PVR_TIMER &timer)
 {
     if(NULL == m_clientCore)
         return false;
+    {
+        CLockObject lock(m_mutex);
+        if(m_localRecordings.count(timer.iEpgUid) != 0 || m_startingRecordings.count(timer.iEpgUid) != 0) {
+            LogNotice("StartRecordingFor(): EPG %d is in recording already.", timer.iEpgUid);
+            return true;
+        }
+        if(!CanStartLocalRecording(timer.iClientChannelUid))
+            return false;
+        // Reserve the slot, files and stream are opened without the lock
+        m_startingRecordings.insert(timer.iEpgUid);
+    }
+    // Releases the slot on any exit, after the recording is inserted or failed
+    struct StartingSlot
+    {
+        PVRClientBase* client;
+        unsigned int epgId;
+        ~StartingSlot()
+        {
+            CLockObject lock(client->m_mutex);
+            client->m_startingRecordings.erase(epgId);
+        }
+    } startingSlot = {this, timer.iEpgUid};
 
     bool hasEpg = false;
     auto pThis = this;
@@ -1046,21 +1357,36 @@ bool PVRClientBase::StartRecordingFor(const PVR_TIMER &timer)
     }
     XBMC->CloseFile(infoFile);
     
-    std::string url = m_clientCore ->GetUrl(timer.iClientChannelUid);
-    m_localRecordChannelId = timer.iClientChannelUid;
-    // When recording channel is same to live channel
-    // merge live buffer with local recording
-    if(m_liveChannelId == timer.iClientChannelUid){
-//        CLockObject lock(m_mutex);
-//        CloseLiveStream();
-        m_inputBuffer->SwapCache( new Buffers::FileCacheBuffer(recordingDir, 255, false));
-        m_localRecordBuffer = m_inputBuffer;
-        m_liveChannelId = m_localRecordChannelId; // ???
-        return true;
+    LocalRecording recording = {(ChannelId) timer.iClientChannelUid, nullptr, nullptr};
+    {
+        // When the channel is already ingested (live or another recording)
+        // record the same stream, no second connection is needed
+        CLockObject lock(m_mutex);
+        Buffers::TimeshiftBuffer* ingest = FindIngest(recording.channelId);
+        if(nullptr != ingest){
+            recording.sink = new Buffers::IndexedFileCacheBuffer(recordingDir, 255);
+            recording.buffer = ingest;
+            ingest->AddSink(recording.sink);
+            m_localRecordings[timer.iEpgUid] = recording;
+            m_startingRecordings.erase(timer.iEpgUid);
+            LogInfo("StartRecordingFor(): %d local recordings in progress.", (int) m_localRecordings.size());
+            return true;
+        }
     }
     // otherwise just open new recording stream
-    m_localRecordBuffer = new Buffers::TimeshiftBuffer(BufferForUrl(url), new Buffers::FileCacheBuffer(recordingDir, 255, false));
-
+    std::string url = m_clientCore ->GetUrl(timer.iClientChannelUid);
+    try {
+        recording.buffer = new Buffers::TimeshiftBuffer(BufferForUrl(url), new Buffers::IndexedFileCacheBuffer(recordingDir, 255));
+    }
+    catch (InputBufferException &ex)
+    {
+        LogError("StartRecordingFor(): input buffer error %s", ex.what());
+        return false;
+    }
+    CLockObject lock(m_mutex);
+    m_localRecordings[timer.iEpgUid] = recording;
+    m_startingRecordings.erase(timer.iEpgUid);
+    LogInfo("StartRecordingFor(): %d local recordings in progress.", (int) m_localRecordings.size());
     return true;
 }
 
@@ -1092,18 +1418,27 @@ bool PVRClientBase::StopRecordingFor(const PVR_TIMER &timer)
     if(nullptr != infoFile)
         XBMC->CloseFile(infoFile);
     
-    // When recording channel is same to live channel
-    // merge live buffer with local recording
-    if(m_liveChannelId == timer.iClientChannelUid){
-        //CLockObject lock(m_mutex);
-        m_inputBuffer->SwapCache(CreateLiveCache());
-        m_localRecordBuffer = nullptr;
-    } else {
-        if(m_localRecordBuffer) {
-            m_localRecordChannelId = UnknownChannelId;
-            SAFE_DELETE(m_localRecordBuffer);
+    Buffers::TimeshiftBuffer* recordBuffer = nullptr;
+    {
+        CLockObject lock(m_mutex);
+        auto recording = m_localRecordings.find(timer.iEpgUid);
+        if(recording != m_localRecordings.end()) {
+            Buffers::TimeshiftBuffer* ingest = recording->second.buffer;
+            Buffers::ICacheBuffer* sink = recording->second.sink;
+            m_localRecordings.erase(recording);
+            if(nullptr != sink)
+                ingest->RemoveSink(sink);
+            // Live stream continues with own cache
+            else if(ingest == m_inputBuffer)
+                m_inputBuffer->SwapCache(CreateLiveCache());
+            // Other recordings continue on the ingest
+            else if(!PromoteRecordingCache(ingest))
+                recordBuffer = ingest;
         }
     }
+    // Stopping of recording stream may take time, do not block live stream
+    if(nullptr != recordBuffer)
+        delete recordBuffer;
     
     // trigger Kodi recordings update
     PVR->TriggerRecordingUpdate();
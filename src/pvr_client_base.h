@@ -24,11 +24,17 @@
 #define pvr_client_base_h
 
 #include <string>
+#include <memory>
+#include <map>
+#include <set>
 #include "pvr_client_types.h"
 #include "xbmc_pvr_types.h"
 #include "p8-platform/threads/mutex.h"
+#include "p8-platform/util/timeutils.h"
 #include "addon.h"
 #include "globals.hpp"
+#include "stream_metrics.h"
+#include "ts_index.h"
 
 namespace Buffers {
     class IPlaylistBufferDelegate;
@@ -93,6 +99,8 @@ namespace PvrClient
         long long SeekRecordedStream(long long iPosition, int iWhence);
         long long PositionRecordedStream(void);
         long long LengthRecordedStream(void);
+        // Duration of local recording from its TS index (OSD time and seek bar)
+        PVR_ERROR GetStreamTimes(PVR_STREAM_TIMES* times);
         PVR_ERROR IsEPGTagRecordable(const EPG_TAG* tag, bool* bIsRecordable);
 
         bool StartRecordingFor(const PVR_TIMER &timer);
@@ -117,7 +125,9 @@ namespace PvrClient
         virtual std::string GetNextStreamUrl(ChannelId channelId) {return std::string();}
         ChannelId GetLiveChannelId() { return  m_liveChannelId;}
         bool IsLiveInRecording() const;
-        bool SwitchChannel(ChannelId channelId, const std::string& url);
+        bool SwitchChannel(ChannelId channelId, const std::vector<std::string>& urls);
+        // Adds live stream health (ingest rate, cache fill, stalls) to the status
+        void FillStreamStatus(PVR_SIGNAL_STATUS& signalStatus);
 
         bool OpenRecordedStream(const std::string& url, Buffers::IPlaylistBufferDelegate* delegate);
         bool IsLocalRecording(const PVR_RECORDING &recording) const;
@@ -136,18 +146,70 @@ namespace PvrClient
         void SetCacheLimit(uint64_t size);
         void SetChannelReloadTimeout(int timeout);
         
+        // Channel name and directory of recordings. Reused for
+        // consecutive recordings of the same channel and day.
+        struct RecordingDirectoryCache
+        {
+            RecordingDirectoryCache() : channelId(UnknownChannelId), dayStart(0), dayEnd(0) {}
+            ChannelId channelId;
+            std::string channelName;
+            time_t dayStart;
+            time_t dayEnd;
+            std::string directory;
+        };
         void FillRecording(const EpgEntryList::value_type& epgEntry, PVR_RECORDING& tag, const char* dirPrefix);
+        void FillRecording(UniqueBroadcastIdType id, const EpgEntry& epgTag, PVR_RECORDING& tag, const char* dirPrefix, RecordingDirectoryCache& dirCache);
         std::string DirectoryForRecording(unsigned int epgId) const;
         std::string PathForRecordingInfo(unsigned int epgId) const;
-        static Buffers::InputBuffer*  BufferForUrl(const std::string& url );
-        bool OpenLiveStream(ChannelId channelId, const std::string& url );
+        static Buffers::InputBuffer*  BufferForUrl(const std::string& url, const std::shared_ptr<Buffers::StreamMetrics>& metrics = nullptr);
+        // Live source with stall detection. Alternative URLs are raced.
+        static Buffers::InputBuffer*  BufferForUrls(const std::vector<std::string>& urls, const std::shared_ptr<Buffers::StreamMetrics>& metrics);
+        // Primary stream URL followed by alternative ones
+        std::vector<std::string> GetStreamUrls(ChannelId channelId);
+        bool OpenLiveStream(ChannelId channelId, const std::vector<std::string>& urls);
         Buffers::ICacheBuffer* CreateLiveCache() const;
+        // Should be called under m_mutex lock.
+        Buffers::TimeshiftBuffer* FindLocalRecordBuffer(ChannelId channelId) const;
+        // Ingest stream of the channel shared by live and recordings, NULL when none.
+        // Should be called under m_mutex lock.
+        Buffers::TimeshiftBuffer* FindIngest(ChannelId channelId) const;
+        // Makes a recording of the ingest owner of its main cache, when
+        // no recording owns it. Returns false when ingest has no recordings.
+        // Should be called under m_mutex lock, when ingest has no live reader.
+        bool PromoteRecordingCache(Buffers::TimeshiftBuffer* ingest);
+        // Checks recordings amount, bandwidth and disk load of running streams.
+        // Should be called under m_mutex lock.
+        bool CanStartLocalRecording(ChannelId channelId) const;
+        // Writes live stream metrics to the cache folder asynchronously.
+        // Should be called under m_mutex lock.
+        void DumpStreamMetrics();
 
         ChannelId m_liveChannelId;
         Buffers::TimeshiftBuffer *m_inputBuffer;
         Buffers::InputBuffer *m_recordBuffer;
-        ChannelId m_localRecordChannelId;
-        Buffers::TimeshiftBuffer *m_localRecordBuffer;
+        // Seek table of playing local recording, empty for other streams
+        Buffers::TsIndex m_recordIndex;
+        std::string m_recordDir;
+        // Index reload of a recording in progress: file length at last load and rate limit
+        int64_t m_recordIndexLength;
+        P8PLATFORM::CTimeout m_recordIndexRefresh;
+        // Local recordings in progress by EPG ID of the timer.
+        // Live stream and recordings of the same channel share single ingest buffer.
+        // Recording either owns main cache of the ingest or has own sink in it.
+        struct LocalRecording
+        {
+            ChannelId channelId;
+            Buffers::TimeshiftBuffer* buffer;
+            // NULL when recording owns the main cache
+            Buffers::ICacheBuffer* sink;
+        };
+        std::map<unsigned int, LocalRecording> m_localRecordings;
+        // EPG IDs of recordings being opened outside of m_mutex lock.
+        // Their slots are counted by the recordings limit.
+        std::set<unsigned int> m_startingRecordings;
+        int m_maxLocalRecordings;
+        // Mbit/s, 0 - unlimited
+        int m_maxRecordingBandwidth;
         bool m_isTimeshiftEnabled;
         uint64_t m_timshiftBufferSize;
         uint64_t m_cacheSizeLimit;
@@ -155,11 +217,17 @@ namespace PvrClient
         std::string m_cacheDir;
         std::string m_recordingsDir;
         int m_lastRecordingsAmount;
+        uint64_t m_lastRecordingsHash;
         std::string m_clientPath;
         std::string m_userPath;
         int m_channelReloadTimeout;
         mutable P8PLATFORM::CMutex m_mutex;
         int m_lastBytesRead;
+        P8PLATFORM::CTimeout m_metricsDumpTimeout;
+        // Last sample of live ingest to calculate current rate
+        uint64_t m_lastIngestedBytes;
+        uint64_t m_lastIngestedTime;
+        Buffers::IngestWatchdog m_ingestWatchdog;
         
         int m_rpcPort;
         int m_channelIndexOffset;
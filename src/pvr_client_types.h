@@ -75,7 +75,6 @@ namespace PvrClient {
         : ChannelId(-1)
         , StartTime(0)
         , EndTime(0)
-        , HasArchive (false)
         {}
         const char* ChannelIdName = "ch";
         PvrClient::ChannelId ChannelId;
@@ -92,9 +91,6 @@ namespace PvrClient {
         const char* DescriptionName = "de";
         std::string Description;
         
-        const char* HasArchiveName = "ha";
-        bool HasArchive;
-        
         const char* IconPathName = "ic";
         std::string IconPath;
         
@@ -121,10 +117,6 @@ namespace PvrClient {
                 writer.Key(DescriptionName);
                 writer.String(Description.c_str());
             }
-            if(HasArchive) {
-                writer.Key(HasArchiveName);
-                writer.Bool(HasArchive);
-            }
             if(!IconPath.empty()) {
                 writer.Key(IconPathName);
                 writer.String(IconPath.c_str());
@@ -149,8 +141,6 @@ namespace PvrClient {
             Title = reader[TitileName].GetString();
             if(reader.HasMember(DescriptionName))
                 Description = reader[DescriptionName].GetString();
-            if(reader.HasMember(HasArchiveName))
-                HasArchive = reader[HasArchiveName].GetBool();
             if(reader.HasMember(IconPathName))
                 IconPath = reader[IconPathName].GetString();
             if(reader.HasMember(ProgramIdName))
@@ -196,6 +186,8 @@ namespace PvrClient {
         virtual void GetEpg(ChannelId  channelId, time_t startTime, time_t endTime, EpgEntryList& epgEntries) = 0;
         virtual bool GetEpgEntry(UniqueBroadcastIdType i,  EpgEntry& enrty) = 0;
         virtual void ForEachEpg(const EpgEntryAction& action) const = 0;
+        // EPG entries available in archive now
+        virtual void ForEachArchiveEntry(const EpgEntryAction& action) const = 0;
         virtual std::string GetUrl(PvrClient::ChannelId channelId) = 0;
         
         virtual void ReloadRecordings() = 0;
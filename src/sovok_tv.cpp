@@ -33,6 +33,7 @@
 #include <algorithm>
 #include <sstream>
 #include <ctime>
+#include <limits>
 #include "p8-platform/threads/mutex.h"
 #include "p8-platform/util/timeutils.h"
 #include "p8-platform/util/util.h"
@@ -268,6 +269,142 @@ void SovokTV::UpdateEpgForAllChannels(time_t startTime, time_t endTime)
 
 }
 
+static void ThrowServerError(const std::string& err, int code)
+{
+    XBMC->Log(LOG_ERROR, "Sovok TV server responses error:");
+    XBMC->Log(LOG_ERROR, err.c_str());
+    throw ServerErrorException(err.c_str(),code);
+}
+
+// SAX handler of "epg3" response:
+// {"epg3":[{"id":"1","epg":[{"progname":"","description":"","ut_start":"1"},...]},...]}
+// Every channel is reported as soon as it is parsed,
+// so DOM of whole response is never built.
+// Server error object is collected to be reported after parsing.
+class SovokEpgSaxHandler : public BaseReaderHandler<UTF8<>, SovokEpgSaxHandler>
+{
+public:
+    struct Programme
+    {
+        string title;
+        string description;
+        string start;
+    };
+    typedef vector<Programme> ProgrammeList;
+    typedef std::function<void(const string& channelId, const ProgrammeList& epg)> TChannelCallback;
+    
+    SovokEpgSaxHandler(const TChannelCallback& onChannel)
+    : m_onChannel(onChannel)
+    , m_depth(0)
+    , m_isInEpg3(false)
+    , m_isInEpg(false)
+    , m_isInError(false)
+    , m_hasError(false)
+    , m_errorCode(-100)
+    {}
+    
+    bool HasError() const { return m_hasError; }
+    const string& ErrorMessage() const { return m_errorMessage; }
+    int ErrorCode() const { return m_errorCode; }
+    
+    bool StartObject()
+    {
+        if(1 == m_depth && m_key == "error") {
+            m_isInError = m_hasError = true;
+        } else if(2 == m_depth && m_isInEpg3) {
+            m_channelId.clear();
+            m_epg.clear();
+        } else if(4 == m_depth && m_isInEpg) {
+            m_programme = Programme();
+        }
+        ++m_depth;
+        return true;
+    }
+    bool EndObject(SizeType)
+    {
+        --m_depth;
+        if(1 == m_depth) {
+            m_isInError = false;
+        } else if(2 == m_depth && m_isInEpg3) {
+            m_onChannel(m_channelId, m_epg);
+            m_epg.clear();
+        } else if(4 == m_depth && m_isInEpg) {
+            m_epg.push_back(m_programme);
+        }
+        return true;
+    }
+    bool StartArray()
+    {
+        if(1 == m_depth && m_key == "epg3")
+            m_isInEpg3 = true;
+        else if(3 == m_depth && m_isInEpg3 && m_key == "epg")
+            m_isInEpg = true;
+        ++m_depth;
+        return true;
+    }
+    bool EndArray(SizeType)
+    {
+        --m_depth;
+        if(1 == m_depth)
+            m_isInEpg3 = false;
+        else if(3 == m_depth)
+            m_isInEpg = false;
+        return true;
+    }
+    bool Key(const char* str, SizeType length, bool)
+    {
+        m_key.assign(str, length);
+        return true;
+    }
+    bool String(const char* str, SizeType length, bool)
+    {
+        if(2 == m_depth && m_isInError) {
+            if(m_key == "message")
+                m_errorMessage.assign(str, length);
+            else if(m_key == "code")
+                m_errorCode = atoi(string(str, length).c_str());
+        } else if(3 == m_depth && m_isInEpg3) {
+            if(m_key == "id")
+                m_channelId.assign(str, length);
+        } else if(5 == m_depth && m_isInEpg) {
+            if(m_key == "progname")
+                m_programme.title.assign(str, length);
+            else if(m_key == "description")
+                m_programme.description.assign(str, length);
+            else if(m_key == "ut_start")
+                m_programme.start.assign(str, length);
+        }
+        return true;
+    }
+    bool Int(int i)
+    {
+        if(2 == m_depth && m_isInError && m_key == "code")
+            m_errorCode = i;
+        return true;
+    }
+    // Reader reports non-negative numbers as unsigned
+    bool Uint(unsigned u)
+    {
+        if(u <= (unsigned)std::numeric_limits<int>::max())
+            return Int((int)u);
+        return true;
+    }
+    
+private:
+    const TChannelCallback m_onChannel;
+    int m_depth;
+    string m_key;
+    bool m_isInEpg3;
+    bool m_isInEpg;
+    bool m_isInError;
+    bool m_hasError;
+    string m_errorMessage;
+    int m_errorCode;
+    string m_channelId;
+    ProgrammeList m_epg;
+    Programme m_programme;
+};
+
 void SovokTV::GetEpgForAllChannelsForNHours(time_t startTime, short numberOfHours)
 {
     // For queries over 24 hours Sovok.TV returns incomplete results.
@@ -290,81 +427,78 @@ void SovokTV::GetEpgForAllChannelsForNHours(time_t startTime, short numberOfHour
     ApiFunctionData apiParams("epg3", params);
     unsigned int epgActivityCounter = ++m_epgActivityCounter;
     try {
-        CallApiFunction(apiParams, [this, numberOfHours, startTime] (Document& jsonRoot) {
-            const Value &channels = jsonRoot["epg3"];
-            for (const auto& channel : channels.GetArray())
-            {
-                const auto currentChannelId = stoul(channel["id"].GetString());
-                // Check last EPG entrie for missing end time
-                const EpgEntry* lastEpgForChannel = nullptr;
-                IClientCore::EpgEntryAction action = [&lastEpgForChannel, currentChannelId] (const EpgEntryList::value_type& i)
-                {
-                    if(!lastEpgForChannel) {
-                        lastEpgForChannel = &i.second;
-                    } else if(currentChannelId == i.second.ChannelId  &&
-                              lastEpgForChannel->StartTime < i.second.StartTime) {
-                        lastEpgForChannel = &i.second;
-                    }
-                    return true;
-                };
-                ForEachEpg(action);
-                
-                
-                const Value& jsonChannelEpg = channel["epg"];
-                Value::ConstValueIterator itJsonEpgEntry1 = jsonChannelEpg.Begin();
-                Value::ConstValueIterator itJsonEpgEntry2  = itJsonEpgEntry1;
-                itJsonEpgEntry2++;
-                // Fix end time of last enrty for the channel
-                // It can't be calculated during previous iteation.
-                if(lastEpgForChannel) {
-                    EpgEntry* fixMe = const_cast<EpgEntry*>(lastEpgForChannel);
-                    fixMe->EndTime = stol((*itJsonEpgEntry1)["ut_start"].GetString()) - m_serverTimeShift;
+        auto onChannel = [this, numberOfHours, startTime] (const string& channelId, const SovokEpgSaxHandler::ProgrammeList& jsonChannelEpg) {
+            if(jsonChannelEpg.empty())
+                return;
+            const auto currentChannelId = stoul(channelId);
+            auto itJsonEpgEntry1 = jsonChannelEpg.begin();
+            auto itJsonEpgEntry2  = itJsonEpgEntry1;
+            itJsonEpgEntry2++;
+            // Fix end time of last enrty for the channel
+            // It can't be calculated during previous iteation.
+            UniqueBroadcastIdType lastEpgId;
+            EpgEntry lastEpgForChannel;
+            if(GetLastEpgEntry(currentChannelId, lastEpgId, lastEpgForChannel)) {
+                const time_t firstStartTime = stol(itJsonEpgEntry1->start) - m_serverTimeShift;
+                if(lastEpgForChannel.StartTime < firstStartTime && lastEpgForChannel.EndTime != firstStartTime) {
+                    lastEpgForChannel.EndTime = firstStartTime;
+                    UpdateEpgEntry(lastEpgId, lastEpgForChannel);
                 }
-                for (; itJsonEpgEntry2 != jsonChannelEpg.End(); ++itJsonEpgEntry1, ++itJsonEpgEntry2)
-                {
-                    EpgEntry epgEntry;
-                    epgEntry.ChannelId = currentChannelId;
-                    epgEntry.Title = (*itJsonEpgEntry1)["progname"].GetString();
-                    epgEntry.Description = (*itJsonEpgEntry1)["description"].GetString();
-                    epgEntry.StartTime = stol((*itJsonEpgEntry1)["ut_start"].GetString()) - m_serverTimeShift;
-                    epgEntry.EndTime = stol((*itJsonEpgEntry2)["ut_start"].GetString()) - m_serverTimeShift;
-                    
-                    UniqueBroadcastIdType id = epgEntry.StartTime;
-                    AddEpgEntry(id, epgEntry);
-                }
-                // Last EPG entrie  missing end time.
-                // Put end of requested interval
+            }
+            EpgEntryBatch batch;
+            batch.reserve(jsonChannelEpg.size());
+            for (; itJsonEpgEntry2 != jsonChannelEpg.end(); ++itJsonEpgEntry1, ++itJsonEpgEntry2)
+            {
                 EpgEntry epgEntry;
                 epgEntry.ChannelId = currentChannelId;
-                epgEntry.Title = (*itJsonEpgEntry1)["progname"].GetString();
-                epgEntry.Description = (*itJsonEpgEntry1)["description"].GetString();
-                epgEntry.StartTime = stol((*itJsonEpgEntry1)["ut_start"].GetString()) - m_serverTimeShift;
-                epgEntry.EndTime = startTime + numberOfHours * 60 * 60;
+                epgEntry.Title = itJsonEpgEntry1->title;
+                epgEntry.Description = itJsonEpgEntry1->description;
+                epgEntry.StartTime = stol(itJsonEpgEntry1->start) - m_serverTimeShift;
+                epgEntry.EndTime = stol(itJsonEpgEntry2->start) - m_serverTimeShift;
                 
-                UniqueBroadcastIdType id = epgEntry.StartTime;
-                AddEpgEntry(id, epgEntry);
-               // PVR->TriggerEpgUpdate(currentChannelId);
+                AddEpgEntry(epgEntry, batch);
             }
+            // Last EPG entrie  missing end time.
+            // Put end of requested interval
+            EpgEntry epgEntry;
+            epgEntry.ChannelId = currentChannelId;
+            epgEntry.Title = itJsonEpgEntry1->title;
+            epgEntry.Description = itJsonEpgEntry1->description;
+            epgEntry.StartTime = stol(itJsonEpgEntry1->start) - m_serverTimeShift;
+            epgEntry.EndTime = startTime + numberOfHours * 60 * 60;
+            
+            AddEpgEntry(epgEntry, batch);
+            AddEpgEntries(batch);
+           // PVR->TriggerEpgUpdate(currentChannelId);
+        };
+        // Response for all channels may be huge.
+        // Parse it with SAX handler channel by channel.
+        RawResponseParser parser([this, onChannel] (const std::string& response) {
+            SovokEpgSaxHandler handler(onChannel);
+            ParseJsonSax(response, handler);
+            if(handler.HasError())
+                ThrowServerError(handler.ErrorMessage(), handler.ErrorCode());
         });
+        CallApiFunction(apiParams, parser);
     } catch (ServerErrorException& ex) {
+        OnEpgRequestFailed(UnknownChannelId, startTime, startTime + numberOfHours * secondsPerHour);
         XBMC->QueueNotification(QUEUE_ERROR, XBMC->GetLocalizedString(32009), ex.reason.c_str() );
     } catch (...) {
+        OnEpgRequestFailed(UnknownChannelId, startTime, startTime + numberOfHours * secondsPerHour);
         LogError(" >>>>  FAILED receive EPG for N hours<<<<<");
     }
 }
 
-void SovokTV::UpdateHasArchive(EpgEntry& entry)
+time_t SovokTV::GetArchiveDepth(ChannelId channelId) const
 {
-    auto channel = m_channelList.find(entry.ChannelId);
-    entry.HasArchive = channel != m_channelList.end() &&  channel->second.HasArchive;
-    
-    if(!entry.HasArchive)
-        return;
-    
-    time_t now = time(nullptr);
-    time_t epgTime = m_addCurrentEpgToArchive ? entry.StartTime : entry.EndTime;
-    time_t from = now - m_archivesInfo.at(entry.ChannelId) * 60 * 60;
-    entry.HasArchive = epgTime >= from && epgTime < now;
+    auto channel = m_channelList.find(channelId);
+    if(channel == m_channelList.end() || !channel->second.HasArchive)
+        return 0;
+    // Archive info in hours
+    auto archiveInfo = m_archivesInfo.find(channelId);
+    if(archiveInfo == m_archivesInfo.end())
+        return 0;
+    return archiveInfo->second * 60 * 60;
 }
 
 string SovokTV::GetUrl(ChannelId channelId)
@@ -488,6 +622,29 @@ void SovokTV::CallApiFunction(const ApiFunctionData& data, TParser parser)
         std::rethrow_exception(ex);
 }
 
+template <typename TParser>
+void SovokTV::ParseApiResponse(const std::string& response, const TParser& parser)
+{
+    ParseJson(response, [&] (Document& jsonRoot)
+              {
+                  if (!jsonRoot.HasMember("error"))
+                  {
+                      parser(jsonRoot);
+                      return;
+                  }
+                  const Value & errObj = jsonRoot["error"];
+                  auto err = errObj["message"].GetString();
+                  const Value & errCode = errObj["code"];
+                  auto code = errCode.IsInt() ? errCode.GetInt() : errCode.IsString() ? atoi(errCode.GetString()) : -100;
+                  ThrowServerError(err, code);
+              });
+}
+
+void SovokTV::ParseApiResponse(const std::string& response, const RawResponseParser& parser)
+{
+    parser.parse(response);
+}
+
 template <typename TParser>
 void SovokTV::CallApiAsync(const ApiFunctionData& data, TParser parser, TApiCallCompletion completion)
 {
@@ -517,21 +674,7 @@ void SovokTV::CallApiAsync(const ApiFunctionData& data, TParser parser, TApiCall
         //            if(data.name.compare( "get_url") == 0)
         //                LogDebug(response.substr(0, 16380).c_str());
         
-        ParseJson(response, [&] (Document& jsonRoot)
-                  {
-                      if (!jsonRoot.HasMember("error"))
-                      {
-                          parser(jsonRoot);
-                          return;
-                      }
-                      const Value & errObj = jsonRoot["error"];
-                      auto err = errObj["message"].GetString();
-                      const Value & errCode = errObj["code"];
-                      auto code = errCode.IsInt() ? errCode.GetInt() : errCode.IsString() ? atoi(errCode.GetString()) : -100;
-                      XBMC->Log(LOG_ERROR, "Sovok TV server responses error:");
-                      XBMC->Log(LOG_ERROR, err);
-                      throw ServerErrorException(err,code);
-                  });
+        ParseApiResponse(response, parser);
     };
     m_httpEngine->CallApiAsync(strRequest, parserWrapper, [=](const ActionQueue::ActionResult& s)
                  {
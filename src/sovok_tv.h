@@ -110,7 +110,7 @@ public:
 
 protected:
     void Init(bool clearEpgCache);
-    void UpdateHasArchive(PvrClient::EpgEntry& entry);
+    time_t GetArchiveDepth(PvrClient::ChannelId channelId) const;
     void BuildChannelAndGroupList();
 
 private:
@@ -129,6 +129,9 @@ private:
     void CallApiFunction(const ApiFunctionData& data, TParser parser);
     template <typename TParser>
     void CallApiAsync(const ApiFunctionData& data, TParser parser, TApiCallCompletion completion);
+    template <typename TParser>
+    void ParseApiResponse(const std::string& response, const TParser& parser);
+    void ParseApiResponse(const std::string& response, const PvrClient::RawResponseParser& parser);
     
     void LoadSettings();
     void InitArchivesInfo();
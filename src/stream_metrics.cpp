@@ -0,0 +1,266 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <algorithm>
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+#include "stream_metrics.h"
+#include "globals.hpp"
+
+namespace Buffers
+{
+    using namespace Globals;
+    
+#pragma mark - LatencyHistogram
+    
+    void LatencyHistogram::Reset()
+    {
+        for(auto& b : m_buckets)
+            b.store(0, std::memory_order_relaxed);
+        m_count.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+    
+    void LatencyHistogram::Add(uint64_t latencyUs)
+    {
+        int bucket = 0;
+        while(bucket < c_BucketsCount - 1 && (1ULL << bucket) < latencyUs)
+            ++bucket;
+        m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while(latencyUs > max && !m_max.compare_exchange_weak(max, latencyUs, std::memory_order_relaxed))
+            ;
+    }
+    
+    uint64_t LatencyHistogram::Percentile(unsigned int percent) const
+    {
+        const uint64_t count = Count();
+        if(0 == count)
+            return 0;
+        const uint64_t rank = (count * percent + 99) / 100;
+        uint64_t counted = 0;
+        for(int bucket = 0; bucket < c_BucketsCount; ++bucket) {
+            counted += m_buckets[bucket].load(std::memory_order_relaxed);
+            if(counted >= rank && counted > 0)
+                return std::min<uint64_t>(1ULL << bucket, Max());
+        }
+        return Max();
+    }
+    
+#pragma mark - StreamMetrics
+    
+    void StreamMetrics::Reset()
+    {
+        startTime = monotonic_time_us();
+        bytesIngested = 0;
+        bytesDownloaded = 0;
+        segmentDownloadTime.Reset();
+        segmentsFailed = 0;
+        segmentWaits = 0;
+        playlistReloads = 0;
+        reconnects = 0;
+        failovers = 0;
+        cacheWriteTimeUs = 0;
+        cacheFill = 0;
+        swapsCount = 0;
+        swapTimeUs = 0;
+        bytesDelivered = 0;
+        startupLatencyUs = 0;
+        readerWait.Reset();
+        readerStalls = 0;
+        seekLatency.Reset();
+    }
+    
+    void StreamMetrics::Log(const char* owner) const
+    {
+        const uint64_t sessionTime = SessionTimeUs();
+        LogInfo("%s: ingested %llu bytes (%.2f MB/s), cache write %.2f MB/s, delivered %llu bytes, startup %llu ms.",
+                owner, (unsigned long long) Get(bytesIngested), Rate(Get(bytesIngested), sessionTime),
+                Rate(Get(bytesIngested), Get(cacheWriteTimeUs)),
+                (unsigned long long) Get(bytesDelivered), (unsigned long long) Get(startupLatencyUs) / 1000);
+        LogInfo("%s: reader wait usec p50=%llu p90=%llu p99=%llu max=%llu, %llu stalls, %llu reconnects, %llu failovers.",
+                owner, (unsigned long long) readerWait.Percentile(50), (unsigned long long) readerWait.Percentile(90),
+                (unsigned long long) readerWait.Percentile(99), (unsigned long long) readerWait.Max(),
+                (unsigned long long) Get(readerStalls), (unsigned long long) Get(reconnects),
+                (unsigned long long) Get(failovers));
+        if(segmentDownloadTime.Count() > 0)
+            LogInfo("%s: %llu segments (%llu bytes) in p50=%llu ms, %llu failed, %llu waits, %.1f playlist reloads per minute.",
+                    owner, (unsigned long long) segmentDownloadTime.Count(), (unsigned long long) Get(bytesDownloaded),
+                    (unsigned long long) segmentDownloadTime.Percentile(50) / 1000, (unsigned long long) Get(segmentsFailed),
+                    (unsigned long long) Get(segmentWaits), sessionTime > 0 ? Get(playlistReloads) * 60000000.0 / sessionTime : 0.0);
+        if(seekLatency.Count() > 0)
+            LogInfo("%s: %llu seeks, latency usec p50=%llu p99=%llu max=%llu.",
+                    owner, (unsigned long long) seekLatency.Count(), (unsigned long long) seekLatency.Percentile(50),
+                    (unsigned long long) seekLatency.Percentile(99), (unsigned long long) seekLatency.Max());
+        if(Get(swapsCount) > 0)
+            LogInfo("%s: %llu cache swaps in %llu ms.",
+                    owner, (unsigned long long) Get(swapsCount), (unsigned long long) Get(swapTimeUs) / 1000);
+    }
+    
+    template <typename TWriter>
+    static void WriteHistogram(TWriter& writer, const char* name, const LatencyHistogram& h)
+    {
+        writer.Key(name);
+        writer.StartObject();
+        writer.Key("count");
+        writer.Uint64(h.Count());
+        writer.Key("p50");
+        writer.Uint64(h.Percentile(50));
+        writer.Key("p90");
+        writer.Uint64(h.Percentile(90));
+        writer.Key("p99");
+        writer.Uint64(h.Percentile(99));
+        writer.Key("max");
+        writer.Uint64(h.Max());
+        writer.EndObject();
+    }
+    
+    std::string StreamMetrics::ToJson() const
+    {
+        using namespace rapidjson;
+        StringBuffer s;
+        Writer<StringBuffer> writer(s);
+        
+        writer.StartObject();
+        writer.Key("sessionTimeUs");
+        writer.Uint64(SessionTimeUs());
+        writer.Key("bytesIngested");
+        writer.Uint64(Get(bytesIngested));
+        writer.Key("bytesDownloaded");
+        writer.Uint64(Get(bytesDownloaded));
+        WriteHistogram(writer, "segmentDownloadTimeUs", segmentDownloadTime);
+        writer.Key("segmentsFailed");
+        writer.Uint64(Get(segmentsFailed));
+        writer.Key("segmentWaits");
+        writer.Uint64(Get(segmentWaits));
+        writer.Key("playlistReloads");
+        writer.Uint64(Get(playlistReloads));
+        writer.Key("reconnects");
+        writer.Uint64(Get(reconnects));
+        writer.Key("failovers");
+        writer.Uint64(Get(failovers));
+        writer.Key("cacheWriteTimeUs");
+        writer.Uint64(Get(cacheWriteTimeUs));
+        writer.Key("cacheFill");
+        writer.Int64(cacheFill.load(std::memory_order_relaxed));
+        writer.Key("swapsCount");
+        writer.Uint64(Get(swapsCount));
+        writer.Key("swapTimeUs");
+        writer.Uint64(Get(swapTimeUs));
+        writer.Key("bytesDelivered");
+        writer.Uint64(Get(bytesDelivered));
+        writer.Key("startupLatencyUs");
+        writer.Uint64(Get(startupLatencyUs));
+        WriteHistogram(writer, "readerWaitUs", readerWait);
+        writer.Key("readerStalls");
+        writer.Uint64(Get(readerStalls));
+        WriteHistogram(writer, "seekLatencyUs", seekLatency);
+        writer.EndObject();
+        
+        return s.GetString();
+    }
+    
+#pragma mark - IngestWatchdog
+    
+    static const uint64_t c_SampleIntervalUs = 500 * 1000;
+    // Ingest rate window covers an HLS segment interval
+    static const uint64_t c_IngestWindowUs = 5 * 1000 * 1000;
+    // Playback rate is averaged over longer window
+    static const uint64_t c_NominalWindowUs = 60 * 1000 * 1000;
+    // Player fills own buffer faster than playback after start
+    static const uint64_t c_WarmupUs = 10 * 1000 * 1000;
+    // Deficit should be sustained to ignore network jitter
+    static const double c_MinRateRatio = 0.7;
+    static const uint64_t c_MinDeficitUs = 2 * 1000 * 1000;
+    // Buffered data should last longer than reconnection
+    static const uint64_t c_ReconnectLeadUs = 5 * 1000 * 1000;
+    static const uint64_t c_CooldownUs = 30 * 1000 * 1000;
+    
+    void IngestWatchdog::Reset()
+    {
+        m_firstSampleTime = m_lastSampleTime = 0;
+        m_lastIngested = m_lastDelivered = 0;
+        m_ingestRate = m_nominalRate = 0.0;
+        m_deficitStart = 0;
+        m_cooldownEnd = 0;
+    }
+    
+    bool IngestWatchdog::IsStarving(const StreamMetrics& metrics)
+    {
+        const uint64_t now = monotonic_time_us();
+        const uint64_t ingested = StreamMetrics::Get(metrics.bytesIngested);
+        const uint64_t delivered = StreamMetrics::Get(metrics.bytesDelivered);
+        // Nothing to compare with before playback starts
+        if(0 == StreamMetrics::Get(metrics.startupLatencyUs) || ingested < m_lastIngested || delivered < m_lastDelivered) {
+            Reset();
+            return false;
+        }
+        if(0 == m_lastSampleTime) {
+            m_firstSampleTime = m_lastSampleTime = now;
+            m_lastIngested = ingested;
+            m_lastDelivered = delivered;
+            return false;
+        }
+        const uint64_t interval = now - m_lastSampleTime;
+        if(interval < c_SampleIntervalUs)
+            return false;
+        
+        const double rate = StreamMetrics::Rate(ingested - m_lastIngested, interval);
+        // The player consumes data at the playback rate
+        const double playbackRate = StreamMetrics::Rate(delivered - m_lastDelivered, interval);
+        // First sample seeds the average
+        if(m_lastSampleTime == m_firstSampleTime)
+            m_ingestRate = rate;
+        else
+            m_ingestRate += std::min(1.0, double(interval) / c_IngestWindowUs) * (rate - m_ingestRate);
+        m_lastSampleTime = now;
+        m_lastIngested = ingested;
+        m_lastDelivered = delivered;
+        if(now - m_firstSampleTime < c_WarmupUs) {
+            m_nominalRate = playbackRate;
+            return false;
+        }
+        m_nominalRate += std::min(1.0, double(interval) / c_NominalWindowUs) * (playbackRate - m_nominalRate);
+        
+        if(m_ingestRate >= m_nominalRate * c_MinRateRatio) {
+            m_deficitStart = 0;
+            return false;
+        }
+        if(now < m_cooldownEnd)
+            return false;
+        if(0 == m_deficitStart)
+            m_deficitStart = now;
+        if(now - m_deficitStart < c_MinDeficitUs)
+            return false;
+        // Time to drain data buffered ahead of the player.
+        // Buffered data shrinks by playback minus ingest rate.
+        const int64_t cacheFill = metrics.cacheFill.load(std::memory_order_relaxed);
+        const double drainTimeUs = cacheFill > 0 ? cacheFill / (m_nominalRate - m_ingestRate) : 0.0;
+        if(drainTimeUs > c_ReconnectLeadUs)
+            return false;
+        
+        m_deficitStart = 0;
+        m_cooldownEnd = now + c_CooldownUs;
+        return true;
+    }
+}
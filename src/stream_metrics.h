@@ -0,0 +1,136 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef stream_metrics_h
+#define stream_metrics_h
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include "helpers.h"
+
+namespace Buffers
+{
+    // Lock-free latency histogram with power of two microsecond buckets
+    class LatencyHistogram
+    {
+    public:
+        LatencyHistogram() {Reset();}
+        
+        void Reset();
+        void Add(uint64_t latencyUs);
+        uint64_t Count() const {return m_count.load(std::memory_order_relaxed);}
+        uint64_t Max() const {return m_max.load(std::memory_order_relaxed);}
+        // Upper bound (usec) of the bucket holding the percentile (0..100)
+        uint64_t Percentile(unsigned int percent) const;
+        
+    private:
+        static const int c_BucketsCount = 40;
+        std::atomic<uint64_t> m_buckets[c_BucketsCount];
+        std::atomic<uint64_t> m_count;
+        std::atomic<uint64_t> m_max;
+    };
+    
+    typedef std::atomic<uint64_t> MetricsCounter;
+    
+    // Runtime metrics of a stream session, shared by all buffers of the session.
+    // Counters are updated lock-free from loading and reading threads.
+    class StreamMetrics
+    {
+    public:
+        StreamMetrics() {Reset();}
+        void Reset();
+        
+        // Counter increment on hot path
+        static void Add(MetricsCounter& counter, uint64_t value = 1) {
+            counter.fetch_add(value, std::memory_order_relaxed);
+        }
+        static uint64_t Get(const MetricsCounter& counter) {
+            return counter.load(std::memory_order_relaxed);
+        }
+        // Megabytes per second of the amount over the interval
+        static double Rate(uint64_t bytes, uint64_t intervalUs) {
+            return intervalUs > 0 ? double(bytes) / intervalUs : 0.0;
+        }
+        uint64_t SessionTimeUs() const {return monotonic_time_us() - Get(startTime);}
+        
+        void Log(const char* owner) const;
+        std::string ToJson() const;
+        
+        MetricsCounter startTime;
+        // Network (source) side
+        MetricsCounter bytesIngested;
+        MetricsCounter bytesDownloaded;
+        LatencyHistogram segmentDownloadTime;
+        MetricsCounter segmentsFailed;
+        MetricsCounter segmentWaits;
+        MetricsCounter playlistReloads;
+        MetricsCounter reconnects;
+        // Switches to an alternative source of the stream
+        MetricsCounter failovers;
+        // Cache side
+        MetricsCounter cacheWriteTimeUs;
+        // Bytes available for reader ahead of read position
+        std::atomic<int64_t> cacheFill;
+        MetricsCounter swapsCount;
+        MetricsCounter swapTimeUs;
+        // Reader side
+        MetricsCounter bytesDelivered;
+        // Time to first delivered data, 0 while not started
+        MetricsCounter startupLatencyUs;
+        LatencyHistogram readerWait;
+        // Reader waited for data after playback has started
+        MetricsCounter readerStalls;
+        LatencyHistogram seekLatency;
+    };
+    typedef std::shared_ptr<StreamMetrics> StreamMetricsPtr;
+    
+    // Detects ingest slower than the stream rate for long enough to drain
+    // buffered data, so the source can be replaced before the player starves.
+    // Stream (nominal) rate is the playback rate, i.e. reader consumption.
+    // Not thread safe, should be polled by the reader.
+    class IngestWatchdog
+    {
+    public:
+        IngestWatchdog() {Reset();}
+        void Reset();
+        // Returns true when reconnect or failover is advised
+        bool IsStarving(const StreamMetrics& metrics);
+        // Bytes per usec, i.e. MB/s
+        double IngestRate() const {return m_ingestRate;}
+        double NominalRate() const {return m_nominalRate;}
+        
+    private:
+        uint64_t m_firstSampleTime;
+        uint64_t m_lastSampleTime;
+        uint64_t m_lastIngested;
+        uint64_t m_lastDelivered;
+        // Moving averages of ingest (short window) and playback (long window) rates
+        double m_ingestRate;
+        double m_nominalRate;
+        uint64_t m_deficitStart;
+        uint64_t m_cooldownEnd;
+    };
+}
+
+#endif /* stream_metrics_h */
@@ -36,6 +36,8 @@
 #include "helpers.h"
 #include <sstream>
 #include <functional>
+#include <algorithm>
+#include <string.h>
 #include "libXBMC_addon.h"
 #include "globals.hpp"
 
@@ -46,10 +48,12 @@ namespace Buffers {
     using namespace P8PLATFORM;
     using namespace Globals;
     
-    TimeshiftBuffer::TimeshiftBuffer(InputBuffer* inputBuffer, ICacheBuffer* cache)
+    TimeshiftBuffer::TimeshiftBuffer(InputBuffer* inputBuffer, ICacheBuffer* cache, StreamMetricsPtr metrics)
     : m_inputBuffer(inputBuffer)
     , m_cache(cache)
     , m_cacheToSwap(nullptr)
+    , m_sinkToPromote(nullptr)
+    , m_metrics(metrics ? metrics : std::make_shared<StreamMetrics>())
     {
         if (!m_inputBuffer)
             throw InputBufferException("TimesiftBuffer: source stream buffer is NULL.");
@@ -74,11 +78,15 @@ namespace Buffers {
     TimeshiftBuffer::~TimeshiftBuffer()
     {
         StopThread();
+        if(StreamMetrics::Get(m_metrics->bytesIngested) > 0)
+            m_metrics->Log("TimeshiftBuffer");
         
         if(m_inputBuffer)
             delete m_inputBuffer;
         if(m_cache)
              delete m_cache;
+        for (auto sink : m_sinks)
+            delete sink;
     }
     
     bool TimeshiftBuffer::StopThread(int iWaitMs)
@@ -110,6 +118,7 @@ namespace Buffers {
         // Can swap cache when we have a cache for swap and writer is waiting for us.
         if(nullptr != m_cacheToSwap &&  m_writerWaitingForCacheSwap){
             LogDebug("TimeshiftBuffer::CheckAndSwap(): starting cache swap.");
+            const uint64_t swapStart = monotonic_time_us();
             
             m_cacheToSwap->Init();
             const size_t bufferLenght = m_cacheToSwap->UnitSize();
@@ -130,6 +139,8 @@ namespace Buffers {
             delete m_cache;
             m_cache = m_cacheToSwap;
             m_cacheToSwap = nullptr;
+            StreamMetrics::Add(m_metrics->swapsCount);
+            StreamMetrics::Add(m_metrics->swapTimeUs, monotonic_time_us() - swapStart);
             m_writeEvent.Reset();
             m_cacheSwapEvent.Broadcast();
             LogDebug("TimeshiftBuffer::CheckAndSwap(): cache swap done.");
@@ -137,6 +148,92 @@ namespace Buffers {
     }
 
     
+    void TimeshiftBuffer::AddSink(ICacheBuffer* sink)
+    {
+        sink->Init();
+        CLockObject lock(m_sinksMutex);
+        m_sinks.push_back(sink);
+    }
+    
+    void TimeshiftBuffer::RemoveSink(ICacheBuffer* sink)
+    {
+        {
+            CLockObject lock(m_sinksMutex);
+            auto it = std::find(m_sinks.begin(), m_sinks.end(), sink);
+            if(it == m_sinks.end())
+                return;
+            m_sinks.erase(it);
+            if(m_sinkToPromote == sink)
+                m_sinkToPromote = nullptr;
+        }
+        delete sink;
+    }
+    
+    void TimeshiftBuffer::PromoteSink(ICacheBuffer* sink)
+    {
+        CLockObject lock(m_sinksMutex);
+        m_sinkToPromote = sink;
+    }
+    
+    void TimeshiftBuffer::CheckAndPromoteSink()
+    {
+        // Called by writer when no cache unit is locked
+        ICacheBuffer* oldCache = nullptr;
+        {
+            CLockObject lock(m_sinksMutex);
+            if(nullptr == m_sinkToPromote)
+                return;
+            m_sinks.erase(std::remove(m_sinks.begin(), m_sinks.end(), m_sinkToPromote), m_sinks.end());
+            oldCache = m_cache;
+            m_cache = m_sinkToPromote;
+            m_sinkToPromote = nullptr;
+        }
+        LogDebug("TimeshiftBuffer: sink is promoted to main cache.");
+        delete oldCache;
+        m_sinkPromotedEvent.Broadcast();
+    }
+    
+    bool TimeshiftBuffer::WaitForSinkPromotion(uint32_t timeoutMs)
+    {
+        P8PLATFORM::CTimeout timeout(timeoutMs);
+        while(IsRunning()) {
+            {
+                CLockObject lock(m_sinksMutex);
+                if(nullptr == m_sinkToPromote)
+                    return true;
+            }
+            if(0 == timeout.TimeLeft())
+                return false;
+            m_sinkPromotedEvent.Wait(std::min<uint32_t>(timeout.TimeLeft(), 100));
+        }
+        return false;
+    }
+    
+    bool TimeshiftBuffer::HasSinks()
+    {
+        CLockObject lock(m_sinksMutex);
+        return !m_sinks.empty();
+    }
+    
+    void TimeshiftBuffer::WriteToSinks(const uint8_t* data, size_t size)
+    {
+        CLockObject lock(m_sinksMutex);
+        for (auto sink : m_sinks) {
+            size_t written = 0;
+            while(written < size) {
+                uint8_t* unit = nullptr;
+                if(!sink->LockUnitForWrite(&unit) || nullptr == unit) {
+                    LOG_RATE_LIMITED(1000, LogError, "TimeshiftBuffer: no free unit in sink. Data is lost.");
+                    break;
+                }
+                const size_t portion = std::min<size_t>(size - written, sink->UnitSize());
+                memcpy(unit, data + written, portion);
+                sink->UnlockAfterWriten(unit, portion);
+                written += portion;
+            }
+        }
+    }
+    
     void *TimeshiftBuffer::Process()
     {
         bool isError = false;
@@ -144,21 +241,47 @@ namespace Buffers {
             while (!isError && m_inputBuffer != NULL && !IsStopped()) {
                 
                 CheckAndWaitForSwap() ;
+                CheckAndPromoteSink();
                 // Fill read buffer
                 const size_t bufferLenght = m_cache->UnitSize();
                 uint8_t* buffer = nullptr;
+                uint64_t cacheWriteStart = monotonic_time_us();
+                bool isSinksOnly = false;
                 while(!IsStopped() && !m_cache->LockUnitForWrite(&buffer)) {
+                    // Recordings can't wait for the reader of paused timeshift
+                    if(HasSinks()) {
+                        LOG_RATE_LIMITED(1000, LogNotice, "TimeshiftBuffer: cache is full, data is written to sinks only.");
+                        m_sinksOnlyBuffer.resize(bufferLenght);
+                        buffer = &m_sinksOnlyBuffer[0];
+                        isSinksOnly = true;
+                        break;
+                    }
                     LogError("TimeshiftBuffer: no free cache unit available. Cache is full? ");
                     Sleep(1000);
+                    // Reader of the full cache may be gone
+                    CheckAndPromoteSink();
                 }
+                StreamMetrics::Add(m_metrics->cacheWriteTimeUs, monotonic_time_us() - cacheWriteStart);
                 ssize_t bytesRead = 0;
                 while (!isError && bytesRead < bufferLenght && !IsStopped()){
                     ssize_t loacalBytesRad = m_inputBuffer->Read(buffer + bytesRead, bufferLenght - bytesRead, 1000);
                     bytesRead += loacalBytesRad;
                     isError = loacalBytesRad < 0;
                 }
-                if(nullptr != buffer) {
+                if(isSinksOnly) {
+                    if(bytesRead > 0) {
+                        WriteToSinks(buffer, bytesRead);
+                        StreamMetrics::Add(m_metrics->bytesIngested, bytesRead);
+                    }
+                } else if(nullptr != buffer) {
+                    cacheWriteStart = monotonic_time_us();
+                    // Copy before the unit is released to reader
+                    if(bytesRead > 0)
+                        WriteToSinks(buffer, bytesRead);
                     m_cache->UnlockAfterWriten(buffer, bytesRead);
+                    StreamMetrics::Add(m_metrics->cacheWriteTimeUs, monotonic_time_us() - cacheWriteStart);
+                    if(bytesRead > 0)
+                        StreamMetrics::Add(m_metrics->bytesIngested, bytesRead);
                     m_writeEvent.Signal();
                 }
 //                if(bytesRead > 0) {
@@ -183,7 +306,11 @@ namespace Buffers {
     ssize_t TimeshiftBuffer::Read(unsigned char *buffer, size_t bufferSize, uint32_t timeoutMs)
     {
         size_t totalBytesRead = 0;
+        const uint64_t readStart = monotonic_time_us();
 
+        // Writer may be replacing the main cache
+        if(!WaitForSinkPromotion(timeoutMs))
+            return -1;
         CheckAndSwap();
         
         while (totalBytesRead < bufferSize && IsRunning()) {
@@ -191,17 +318,28 @@ namespace Buffers {
             size_t bytesToRead = bufferSize - totalBytesRead;
             bytesRead = m_cache->Read( buffer + totalBytesRead, bytesToRead);
             bool isTimeout = false;
+            bool isWaiting = false;
             while(!isTimeout && bytesRead == 0 && (m_cache->Length() - m_cache->Position()) < (bufferSize - totalBytesRead)) {
+                if(!isWaiting && StreamMetrics::Get(m_metrics->bytesDelivered) > 0)
+                    StreamMetrics::Add(m_metrics->readerStalls);
+                isWaiting = true;
                 if(!(isTimeout = !m_writeEvent.Wait(timeoutMs)))
                    bytesRead = m_cache->Read( buffer + totalBytesRead, bytesToRead);
             }
             totalBytesRead += bytesRead;
+            if(bytesRead > 0) {
+                if(0 == StreamMetrics::Get(m_metrics->startupLatencyUs))
+                    m_metrics->startupLatencyUs = monotonic_time_us() - StreamMetrics::Get(m_metrics->startTime);
+                StreamMetrics::Add(m_metrics->bytesDelivered, bytesRead);
+            }
             if(isTimeout){
-                LogNotice("TimeshiftBuffer: nothing to read within %d msec.", timeoutMs);
+                LOG_RATE_LIMITED(1000, LogNotice, "TimeshiftBuffer: nothing to read within %d msec.", timeoutMs);
                 totalBytesRead = -1;
                 break;
             }
         }
+        m_metrics->readerWait.Add(monotonic_time_us() - readStart);
+        m_metrics->cacheFill.store(m_cache->Length() - m_cache->Position(), std::memory_order_relaxed);
         return (IsStopped() || !IsRunning()) ? -1 :totalBytesRead;
     }
     
@@ -218,7 +356,21 @@ namespace Buffers {
     
     int64_t TimeshiftBuffer::Seek(int64_t iPosition, int iWhence)
     {
-           return m_cache->Seek(iPosition,iWhence);
+        const uint64_t seekStart = monotonic_time_us();
+        const int64_t position = m_cache->Seek(iPosition,iWhence);
+        m_metrics->seekLatency.Add(monotonic_time_us() - seekStart);
+        return position;
+    }
+    
+    bool TimeshiftBuffer::SwitchInput(InputBuffer* inputBuffer)
+    {
+        if(nullptr == inputBuffer)
+            return false;
+        StopThread();
+        delete m_inputBuffer;
+        m_inputBuffer = inputBuffer;
+        Init();
+        return true;
     }
     
     bool TimeshiftBuffer::SwitchStream(const string &newUrl)
@@ -29,17 +29,20 @@
 
 
 #include <string>
+#include <vector>
 #include "p8-platform/threads/threads.h"
 #include "p8-platform/util/buffer.h"
 #include "input_buffer.h"
 #include "cache_buffer.h"
+#include "stream_metrics.h"
 
 namespace Buffers {
     
     class TimeshiftBuffer : public InputBuffer, public P8PLATFORM::CThread
     {
     public:
-        TimeshiftBuffer(InputBuffer* inputBuffer, ICacheBuffer* cache);
+        // Input buffer may report to the same metrics
+        TimeshiftBuffer(InputBuffer* inputBuffer, ICacheBuffer* cache, StreamMetricsPtr metrics = nullptr);
         ~TimeshiftBuffer();
         
         int64_t GetLength() const;
@@ -47,6 +50,23 @@ namespace Buffers {
         ssize_t Read(unsigned char *buffer, size_t bufferSize, uint32_t timeoutMs);
         int64_t Seek(int64_t iPosition, int iWhence);
         bool SwitchStream(const std::string &newUrl);
+        // Replaces source stream. Takes ownership of the input buffer.
+        bool SwitchInput(InputBuffer* inputBuffer);
+        bool RequestFailover() {return m_inputBuffer->RequestFailover();}
+        StreamMetricsPtr Metrics() const {return m_metrics;}
+        
+        // Secondary caches receive copy of ingested data, e.g. recordings.
+        // Sinks are written even when the main cache is full,
+        // then the data is dropped for the main cache only.
+        // Sink should accept partial units, e.g. FileCacheBuffer.
+        // The buffer owns added sinks.
+        void AddSink(ICacheBuffer* sink);
+        // Deletes the sink
+        void RemoveSink(ICacheBuffer* sink);
+        // Sink replaces the main cache without data copy, the main cache is deleted.
+        // Should be used only when the buffer has no reader.
+        // Next reader waits until the writer completes the promotion.
+        void PromoteSink(ICacheBuffer* sink);
         
         void SwapCache(ICacheBuffer* cache){
             m_cacheToSwap = cache;
@@ -65,13 +85,24 @@ namespace Buffers {
         void Init(const std::string &newUrl = std::string());
         void CheckAndWaitForSwap();
         void CheckAndSwap();
+        void CheckAndPromoteSink();
+        bool WaitForSinkPromotion(uint32_t timeoutMs);
+        bool HasSinks();
+        void WriteToSinks(const uint8_t* data, size_t size);
         
         P8PLATFORM::CEvent m_writeEvent;
         P8PLATFORM::CEvent m_cacheSwapEvent;
+        P8PLATFORM::CEvent m_sinkPromotedEvent;
         bool m_writerWaitingForCacheSwap;
         InputBuffer* m_inputBuffer;
         ICacheBuffer* m_cache;
         ICacheBuffer* m_cacheToSwap;
+        P8PLATFORM::CMutex m_sinksMutex;
+        std::vector<ICacheBuffer*> m_sinks;
+        ICacheBuffer* m_sinkToPromote;
+        // Input data for sinks while the main cache is full
+        std::vector<uint8_t> m_sinksOnlyBuffer;
+        const StreamMetricsPtr m_metrics;
         
     };
 }
@@ -0,0 +1,298 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <string.h>
+#include "libXBMC_addon.h"
+#include "ts_index.h"
+#include "globals.hpp"
+
+namespace Buffers
+{
+    using namespace Globals;
+
+    static const uint8_t c_TsSyncByte = 0x47;
+    static const size_t c_TsPacketSize = 188;
+    // Sync bytes of consecutive packets required to accept a resync
+    static const size_t c_SyncPackets = 3;
+    static const char c_IndexMagic[4] = {'T', 'S', 'I', 'X'};
+    static const uint32_t c_IndexVersion = 1;
+    // PCR base is 33 bit of 90 kHz clock
+    static const int64_t c_PcrWrap = int64_t(1) << 33;
+    // Larger PCR jump is a discontinuity, e.g. reconnected source
+    static const int64_t c_MaxPcrStep = 10 * 90000;
+    // Minimal distance between index entries
+    static const int64_t c_MinKeyframeEntryGapMs = 250;
+    static const int64_t c_MinPesEntryGapMs = 1000;
+
+    static std::string IndexPath(const std::string& dir)
+    {
+        std::string path = dir;
+        if(path[path.length() -1] != PATH_SEPARATOR_CHAR)
+            path += PATH_SEPARATOR_CHAR;
+        path += TsIndex::c_FileName;
+        return path;
+    }
+
+#pragma mark - TsIndex
+
+    const char* const TsIndex::c_FileName = "index.idx";
+
+    bool TsIndex::Load(const std::string& dir)
+    {
+        m_entriesCount = 0;
+        const std::string path = IndexPath(dir);
+        void* file = XBMC->OpenFile(path.c_str(), XFILE::READ_NO_CACHE);
+        if(nullptr == file)
+            return false;
+        const size_t headerSize = sizeof(c_IndexMagic) + sizeof(c_IndexVersion);
+        uint8_t header[headerSize];
+        uint32_t version = 0;
+        if(XBMC->ReadFile(file, header, headerSize) != (ssize_t)headerSize || memcmp(header, c_IndexMagic, sizeof(c_IndexMagic)) != 0) {
+            XBMC->CloseFile(file);
+            LogError("TsIndex: wrong index file %s", path.c_str());
+            return false;
+        }
+        memcpy(&version, &header[sizeof(c_IndexMagic)], sizeof(version));
+        if(version != c_IndexVersion) {
+            XBMC->CloseFile(file);
+            LogError("TsIndex: unsupported index version %d", version);
+            return false;
+        }
+        // Only the last entry is needed for duration.
+        // It may be incomplete while recording is in progress.
+        const int64_t length = XBMC->GetFileLength(file);
+        const int64_t entriesCount = length > (int64_t)headerSize ? (length - headerSize) / sizeof(Entry) : 0;
+        if(entriesCount > 0) {
+            const int64_t lastEntryPos = headerSize + (entriesCount - 1) * sizeof(Entry);
+            if(XBMC->SeekFile(file, lastEntryPos, SEEK_SET) != lastEntryPos ||
+               XBMC->ReadFile(file, &m_lastEntry, sizeof(m_lastEntry)) != sizeof(m_lastEntry)) {
+                XBMC->CloseFile(file);
+                LogError("TsIndex: failed to read last entry of %s", path.c_str());
+                return false;
+            }
+            m_entriesCount = entriesCount;
+        }
+        XBMC->CloseFile(file);
+        LogDebug("TsIndex: %lld entries, duration %lld ms.", m_entriesCount, DurationMs());
+        return true;
+    }
+
+#pragma mark - TsIndexWriter
+
+    TsIndexWriter::TsIndexWriter(const std::string& dir)
+    : m_file(XBMC->OpenFileForWrite(IndexPath(dir).c_str(), true))
+    , m_offset(0)
+    , m_isSynced(false)
+    , m_pmtPid(-1)
+    , m_videoPid(-1)
+    , m_pcrPid(-1)
+    , m_lastPcr(-1)
+    , m_time(0)
+    , m_lastEntryTimeMs(-1)
+    , m_hasRandomAccessFlags(false)
+    {
+        if(nullptr == m_file)
+            throw CacheBufferException("Failed to create TS index file.");
+        XBMC->WriteFile(m_file, c_IndexMagic, sizeof(c_IndexMagic));
+        XBMC->WriteFile(m_file, &c_IndexVersion, sizeof(c_IndexVersion));
+    }
+
+    TsIndexWriter::~TsIndexWriter()
+    {
+        XBMC->CloseFile(m_file);
+    }
+
+    void TsIndexWriter::Write(const uint8_t* data, size_t size)
+    {
+        m_pending.insert(m_pending.end(), data, data + size);
+        const uint8_t* buf = m_pending.data();
+        const size_t length = m_pending.size();
+        const size_t syncSpan = (c_SyncPackets - 1) * c_TsPacketSize;
+        size_t pos = 0;
+        while(true) {
+            // Resync on 0x47 repeated at packet size.
+            // Tail shorter than the sync check waits for next data.
+            while(!m_isSynced && pos + syncSpan < length) {
+                const uint8_t* sync = (const uint8_t*)memchr(buf + pos, c_TsSyncByte, length - syncSpan - pos);
+                if(nullptr == sync) {
+                    pos = length - syncSpan;
+                    break;
+                }
+                pos = sync - buf;
+                m_isSynced = true;
+                for(size_t i = 1; i < c_SyncPackets && m_isSynced; ++i)
+                    m_isSynced = buf[pos + i * c_TsPacketSize] == c_TsSyncByte;
+                if(!m_isSynced)
+                    ++pos;
+            }
+            if(!m_isSynced || pos + c_TsPacketSize > length)
+                break;
+            if(buf[pos] != c_TsSyncByte) {
+                m_isSynced = false;
+                continue;
+            }
+            ProcessPacket(buf + pos, m_offset + pos);
+            pos += c_TsPacketSize;
+        }
+        m_pending.erase(m_pending.begin(), m_pending.begin() + pos);
+        m_offset += pos;
+    }
+
+    void TsIndexWriter::ProcessPacket(const uint8_t* packet, int64_t offset)
+    {
+        const int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+        const bool isPayloadStart = (packet[1] & 0x40) != 0;
+        const bool hasAdaptation = (packet[3] & 0x20) != 0;
+        const bool hasPayload = (packet[3] & 0x10) != 0;
+        bool isRandomAccess = false;
+        if(hasAdaptation && packet[4] > 0 && packet[4] < c_TsPacketSize - 4) {
+            const uint8_t flags = packet[5];
+            isRandomAccess = (flags & 0x40) != 0;
+            // PCR of the first PID carrying it
+            if((flags & 0x10) && packet[4] >= 7 && (m_pcrPid < 0 || m_pcrPid == pid)) {
+                m_pcrPid = pid;
+                const int64_t pcr = (int64_t(packet[6]) << 25) | (packet[7] << 17) | (packet[8] << 9) | (packet[9] << 1) | (packet[10] >> 7);
+                if(m_lastPcr >= 0) {
+                    const int64_t step = (pcr - m_lastPcr + c_PcrWrap) % c_PcrWrap;
+                    // Time continues over discontinuities
+                    if(step <= c_MaxPcrStep)
+                        m_time += step;
+                }
+                m_lastPcr = pcr;
+            }
+        }
+        // PSI sections starting in this packet (single packet tables only)
+        if(isPayloadStart && hasPayload && (pid == 0 || pid == m_pmtPid)) {
+            const size_t payloadPos = 4 + (hasAdaptation ? 1 + packet[4] : 0);
+            if(payloadPos < c_TsPacketSize) {
+                const size_t sectionPos = payloadPos + 1 + packet[payloadPos];
+                if(sectionPos < c_TsPacketSize) {
+                    if(pid == 0)
+                        ParsePat(packet + sectionPos, c_TsPacketSize - sectionPos);
+                    else
+                        ParsePmt(packet + sectionPos, c_TsPacketSize - sectionPos);
+                }
+            }
+        }
+        // Video stream is indexed when known, PCR stream otherwise.
+        // Streams may carry PCR on a separate PID.
+        const int indexPid = m_videoPid >= 0 ? m_videoPid : m_pcrPid;
+        if(pid != indexPid || m_lastPcr < 0)
+            return;
+        // Video keyframes are flagged by most muxers.
+        // Otherwise PES starts of indexed stream are used.
+        m_hasRandomAccessFlags |= isRandomAccess;
+        const int64_t timeMs = m_time / 90;
+        if(isRandomAccess) {
+            if(m_lastEntryTimeMs < 0 || timeMs - m_lastEntryTimeMs >= c_MinKeyframeEntryGapMs)
+                AddEntry(timeMs, offset);
+        } else if(!m_hasRandomAccessFlags && isPayloadStart) {
+            if(m_lastEntryTimeMs < 0 || timeMs - m_lastEntryTimeMs >= c_MinPesEntryGapMs)
+                AddEntry(timeMs, offset);
+        }
+    }
+
+    void TsIndexWriter::ParsePat(const uint8_t* section, size_t size)
+    {
+        if(size < 8 || section[0] != 0x00)
+            return;
+        const size_t sectionEnd = 3 + (((section[1] & 0x0F) << 8) | section[2]);
+        // Program loop ends before CRC32
+        if(sectionEnd > size || sectionEnd < 12)
+            return;
+        for(size_t pos = 8; pos + 4 <= sectionEnd - 4; pos += 4) {
+            const int programNumber = (section[pos] << 8) | section[pos + 1];
+            // Program 0 points to network PID
+            if(programNumber != 0) {
+                m_pmtPid = ((section[pos + 2] & 0x1F) << 8) | section[pos + 3];
+                return;
+            }
+        }
+    }
+
+    void TsIndexWriter::ParsePmt(const uint8_t* section, size_t size)
+    {
+        if(size < 12 || section[0] != 0x02)
+            return;
+        const size_t sectionEnd = 3 + (((section[1] & 0x0F) << 8) | section[2]);
+        if(sectionEnd > size || sectionEnd < 16)
+            return;
+        size_t pos = 12 + (((section[10] & 0x0F) << 8) | section[11]);
+        while(pos + 5 <= sectionEnd - 4) {
+            const uint8_t streamType = section[pos];
+            const int pid = ((section[pos + 1] & 0x1F) << 8) | section[pos + 2];
+            switch (streamType) {
+                case 0x01: // MPEG-1 video
+                case 0x02: // MPEG-2 video
+                case 0x10: // MPEG-4 part 2
+                case 0x1B: // H.264
+                case 0x24: // HEVC
+                    if(m_videoPid != pid)
+                        LogDebug("TsIndexWriter: video PID %d (type 0x%02X)", pid, streamType);
+                    m_videoPid = pid;
+                    return;
+                default:
+                    break;
+            }
+            pos += 5 + (((section[pos + 3] & 0x0F) << 8) | section[pos + 4]);
+        }
+    }
+
+    void TsIndexWriter::AddEntry(int64_t timeMs, int64_t offset)
+    {
+        TsIndex::Entry entry = {timeMs, offset};
+        if(XBMC->WriteFile(m_file, &entry, sizeof(entry)) != sizeof(entry)) {
+            LOG_RATE_LIMITED(1000, LogError, "TsIndexWriter: failed to write index entry.");
+            return;
+        }
+        m_lastEntryTimeMs = timeMs;
+    }
+
+#pragma mark - IndexedFileCacheBuffer
+
+    IndexedFileCacheBuffer::IndexedFileCacheBuffer(const std::string& bufferCacheDir, uint8_t sizeFactor)
+    : FileCacheBuffer(bufferCacheDir, sizeFactor, false)
+    , m_dir(bufferCacheDir)
+    {
+    }
+
+    void IndexedFileCacheBuffer::Init()
+    {
+        FileCacheBuffer::Init();
+        m_indexWriter.reset();
+        // Recording without index is still playable
+        try {
+            m_indexWriter.reset(new TsIndexWriter(m_dir));
+        } catch (CacheBufferException& ex) {
+            LogError("IndexedFileCacheBuffer: %s Directory %s", ex.what(), m_dir.c_str());
+        }
+    }
+
+    void IndexedFileCacheBuffer::UnlockAfterWriten(uint8_t* pBuf, ssize_t writtenBytes)
+    {
+        const int64_t lengthBefore = Length();
+        FileCacheBuffer::UnlockAfterWriten(pBuf, writtenBytes);
+        const int64_t written = Length() - lengthBefore;
+        if(m_indexWriter && written > 0)
+            m_indexWriter->Write(pBuf, written);
+    }
+}
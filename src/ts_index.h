@@ -0,0 +1,112 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef ts_index_h
+#define ts_index_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "file_cache_buffer.hpp"
+
+namespace Buffers
+{
+    // Seek table of MPEG-TS stream.
+    // Maps stream time (by PCR) to byte offset of random access points.
+    // Playback reads only the last entry for stream times reporting.
+    class TsIndex
+    {
+    public:
+        struct Entry
+        {
+            // Milliseconds from the stream start
+            int64_t timeMs;
+            // Offset of TS packet starting the access point
+            int64_t offset;
+        };
+
+        static const char* const c_FileName;
+
+        TsIndex() : m_entriesCount(0) {}
+        // Reads header and last entry of the sidecar index of recording directory.
+        // Returns false when the index is missing or damaged.
+        bool Load(const std::string& dir);
+        bool IsEmpty() const {return m_entriesCount == 0;}
+        int64_t DurationMs() const {return IsEmpty() ? 0 : m_lastEntry.timeMs;}
+
+    private:
+        int64_t m_entriesCount;
+        Entry m_lastEntry;
+    };
+
+    // Builds TS index incrementally from written stream data.
+    class TsIndexWriter
+    {
+    public:
+        // Throws CacheBufferException when index file can't be created
+        TsIndexWriter(const std::string& dir);
+        ~TsIndexWriter();
+
+        // Data may be split at any byte
+        void Write(const uint8_t* data, size_t size);
+
+    private:
+        void ProcessPacket(const uint8_t* packet, int64_t offset);
+        void ParsePat(const uint8_t* section, size_t size);
+        void ParsePmt(const uint8_t* section, size_t size);
+        void AddEntry(int64_t timeMs, int64_t offset);
+
+        void* m_file;
+        // Incomplete packet, or bytes awaiting sync confirmation
+        std::vector<uint8_t> m_pending;
+        // Stream offset of the first pending byte
+        int64_t m_offset;
+        bool m_isSynced;
+        int m_pmtPid;
+        // Video stream of the first program, when PMT declares one
+        int m_videoPid;
+        int m_pcrPid;
+        int64_t m_lastPcr;
+        // 90 kHz ticks from the stream start
+        int64_t m_time;
+        int64_t m_lastEntryTimeMs;
+        bool m_hasRandomAccessFlags;
+    };
+
+    // Recording file cache with sidecar TS index.
+    // Index is restarted by Init() as the cache content is.
+    class IndexedFileCacheBuffer : public FileCacheBuffer
+    {
+    public:
+        IndexedFileCacheBuffer(const std::string& bufferCacheDir, uint8_t sizeFactor);
+
+        void Init();
+        void UnlockAfterWriten(uint8_t* pBuf, ssize_t writtenBytes = -1);
+
+    private:
+        const std::string m_dir;
+        std::unique_ptr<TsIndexWriter> m_indexWriter;
+    };
+}
+
+#endif /* ts_index_h */
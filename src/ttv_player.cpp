@@ -107,12 +107,13 @@ namespace TtvEngine
         }
 
         RebuildChannelAndGroupList();
+        bool isEpgCacheLoaded = false;
         if(clearEpgCache) {
             ClearEpgCache(c_EpgCacheFile);
         } else {
-            LoadEpgCache(c_EpgCacheFile);
+            isEpgCacheLoaded = LoadEpgCache(c_EpgCacheFile);
         }
-        LoadEpg();
+        LoadEpg(isEpgCacheLoaded);
     }
     
     Core::~Core()
@@ -233,17 +234,15 @@ namespace TtvEngine
 //    }
 
 #pragma mark - Playlist methods
-    UniqueBroadcastIdType Core::AddEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry)
+    void Core::AddEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry, EpgEntryBatch& batch)
     {
-        UniqueBroadcastIdType id = xmlEpgEntry.startTime;
-        
         EpgEntry epgEntry;
         epgEntry.ChannelId = xmlEpgEntry.iChannelId;
         epgEntry.Title = xmlEpgEntry.strTitle;
         epgEntry.Description = xmlEpgEntry.strPlot;
         epgEntry.StartTime = xmlEpgEntry.startTime;
         epgEntry.EndTime = xmlEpgEntry.endTime;
-        return ClientCoreBase::AddEpgEntry(id, epgEntry);
+        ClientCoreBase::AddEpgEntry(epgEntry, batch);
     }
     
     void Core::UpdateEpgForAllChannels_Plist(time_t startTime, time_t endTime)
@@ -253,15 +252,20 @@ namespace TtvEngine
             auto pThis = this;
             
             set<ChannelId> channelsToUpdate;
-            EpgEntryCallback onEpgEntry = [pThis, &channelsToUpdate,  startTime] (const XMLTV::EpgEntry& newEntry) {
-                if(c_UniqueBroadcastIdUnknown != pThis->AddEpgEntry(newEntry) && newEntry.startTime >= startTime)
+            EpgEntryBatch batch;
+            EpgEntryCallback onEpgEntry = [pThis, &channelsToUpdate, &batch, startTime] (const XMLTV::EpgEntry& newEntry) {
+                pThis->AddEpgEntry(newEntry, batch);
+                if(newEntry.startTime >= startTime)
                 channelsToUpdate.insert(newEntry.iChannelId);
             };
             
-            XMLTV::ParseEpg(m_coreParams.epgUrl, onEpgEntry);
-            
-            SaveEpgCache(c_EpgCacheFile, 11);
+            // EPG store already contains entries of unmodified document
+            bool isParsed = XMLTV::ParseEpgIfModified(m_coreParams.epgUrl, onEpgEntry);
+            AddEpgEntries(batch);
+            if(isParsed)
+                SaveEpgCache(c_EpgCacheFile, 11);
         } catch (...) {
+            OnEpgRequestFailed(UnknownChannelId, startTime, endTime);
             LogError(" >>>>  FAILED receive EPG <<<<<");
         }
     }
@@ -320,14 +324,22 @@ namespace TtvEngine
         }
     }
     
-    void Core::LoadEpg()
+    void Core::LoadEpg(bool isEpgCacheLoaded)
     {
         using namespace XMLTV;
         auto pThis = this;
         
-        EpgEntryCallback onEpgEntry = [pThis] (const XMLTV::EpgEntry& newEntry) {pThis->AddEpgEntry(newEntry);};
+        EpgEntryBatch batch;
+        EpgEntryCallback onEpgEntry = [pThis, &batch] (const XMLTV::EpgEntry& newEntry) {pThis->AddEpgEntry(newEntry, batch);};
         
-        XMLTV::ParseEpg(m_coreParams.epgUrl, onEpgEntry);
+        // Skip parsing of unmodified document when EPG cache is loaded already
+        bool isParsed = isEpgCacheLoaded
+            ? XMLTV::ParseEpgIfModified(m_coreParams.epgUrl, onEpgEntry)
+            : XMLTV::ParseEpg(m_coreParams.epgUrl, onEpgEntry);
+        AddEpgEntries(batch);
+        // Keep EPG cache in sync with parsed document
+        if(isParsed)
+            SaveEpgCache(c_EpgCacheFile, 11);
     }
     
     void Core::LoadPlaylist(std::function<void(const Document::ValueType &)> onChannel)
@@ -338,16 +350,9 @@ namespace TtvEngine
             // Download playlist
             XBMC->Log(LOG_DEBUG, "TtvPlayer: loading playlist: %s", plistUrl.c_str());
 
-            string zipContent;
-            string unzipedContent;
-            XMLTV::GetCachedFileContents(plistUrl, zipContent);
-            string& data = zipContent;
-
-            if(XMLTV::IsDataCompressed(zipContent)) {
-                if(!XMLTV::GzipInflate(zipContent, unzipedContent))
-                    throw IoErrorException("Failed to unzip playlist.");
-                data = unzipedContent;
-            }
+            string data;
+            if(0 == XMLTV::GetInflatedCachedFileContents(plistUrl, data))
+                throw IoErrorException("Failed to obtain playlist.");
             
 //            string compressedFile = XMLTV::GetCachedFilePath(plistUrl);
 //            if(compressedFile.empty())
@@ -89,7 +89,7 @@ namespace TtvEngine
         void ClearSession();
     protected:
         virtual void Init(bool clearEpgCache);
-        virtual void UpdateHasArchive(PvrClient::EpgEntry& entry) { entry.HasArchive = false; }
+        virtual time_t GetArchiveDepth(PvrClient::ChannelId channelId) const { return 0; }
         virtual void BuildChannelAndGroupList();
 
     private:
@@ -116,9 +116,9 @@ namespace TtvEngine
         std::string m_deviceId;
 
         // Epg management
-        void LoadEpg();
+        void LoadEpg(bool isEpgCacheLoaded);
         void ScheduleEpgDetails();
-        PvrClient::UniqueBroadcastIdType AddEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry);
+        void AddEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry, EpgEntryBatch& batch);
         PvrClient::UniqueBroadcastIdType AddEpgEntry(PvrClient::EpgEntry& epg);
 
         bool CheckAceEngineRunning();
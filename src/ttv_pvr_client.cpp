@@ -210,7 +210,7 @@ string TtvPVRClient::GetNextStreamUrl(ChannelId channelId)
 {
     if(m_core == nullptr)
         return string();
-    LogError("TtvPVRClient:: trying to move to next stream from [%d].", m_currentChannelStreamIdx);
+    LogDebug("TtvPVRClient:: next stream after [%d].", m_currentChannelStreamIdx);
     return m_core->GetNextStream(channelId, m_currentChannelStreamIdx++);
 }
 
@@ -227,6 +227,7 @@ PVR_ERROR TtvPVRClient::SignalStatus(PVR_SIGNAL_STATUS &signalStatus)
 {
     snprintf(signalStatus.strAdapterName, sizeof(signalStatus.strAdapterName), "IPTV Torrent TV");
     snprintf(signalStatus.strAdapterStatus, sizeof(signalStatus.strAdapterStatus), (m_core == NULL) ? "Not connected" :"OK");
+    FillStreamStatus(signalStatus);
     return PVR_ERROR_NO_ERROR;
 }
 
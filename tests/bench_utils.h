@@ -0,0 +1,87 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef bench_utils_h
+#define bench_utils_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "plist_buffer_delegate.h"
+
+// Microseconds since arbitrary point
+inline uint64_t NowUs()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Megabytes per second of the amount over the interval
+inline double Rate(uint64_t bytes, uint64_t intervalUs)
+{
+    return intervalUs > 0 ? double(bytes) / intervalUs : 0.0;
+}
+
+// Raw latency samples for exact percentiles
+class Samples
+{
+public:
+    void Add(uint64_t us) {m_values.push_back(us);}
+    void Print(const char* name)
+    {
+        if(m_values.empty()) {
+            printf("  %-22s n/a\n", name);
+            return;
+        }
+        std::sort(m_values.begin(), m_values.end());
+        printf("  %-22s n=%-6zu p50=%-7llu p90=%-7llu p99=%-7llu max=%llu us\n", name, m_values.size(),
+               Percentile(50), Percentile(90), Percentile(99), (unsigned long long)m_values.back());
+    }
+private:
+    unsigned long long Percentile(unsigned int percent) const {
+        return m_values[std::min(m_values.size() - 1, m_values.size() * percent / 100)];
+    }
+    std::vector<uint64_t> m_values;
+};
+
+// VOD playlist is seekable in itself, timeshift URL is the same playlist
+class VodDelegate : public Buffers::IPlaylistBufferDelegate
+{
+public:
+    VodDelegate(const std::string& url, time_t duration) : m_url(url), m_duration(duration) {}
+    int SegmentsAmountToCache() const {return 3;}
+    time_t Duration() const {return m_duration;}
+    std::string UrlForTimeshift(time_t timeshift, time_t* timeshiftAdjusted) const {
+        if(timeshiftAdjusted)
+            *timeshiftAdjusted = timeshift;
+        return m_url;
+    }
+private:
+    const std::string m_url;
+    const time_t m_duration;
+};
+
+#endif /* bench_utils_h */
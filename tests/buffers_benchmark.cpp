@@ -0,0 +1,358 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+// Offline benchmark of stream buffers over the stub Kodi VFS.
+// Reports sustained write rate, read latency percentiles, seek latency
+// over the whole cache window and cache swap time.
+//
+// Usage: buffers_benchmark [-v] [-w window_MB] [-s stream_MB] [-r source_MBps] [-d cache_dir]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "libXBMC_addon.h"
+#include "globals.hpp"
+#include "helpers.h"
+#include "memory_cache_buffer.hpp"
+#include "file_cache_buffer.hpp"
+#include "simple_cyclic_buffer.hpp"
+#include "timeshift_buffer.h"
+#include "plist_buffer.h"
+#include "hls_origin.h"
+#include "bench_utils.h"
+
+namespace Globals
+{
+    bool CreateWithHandle(void* hdl);
+    void Cleanup();
+}
+
+using namespace Buffers;
+
+static const size_t c_ReadSize = 32 * 1024;
+static const int c_SeeksCount = 200;
+static const uint32_t c_ReadTimeoutMs = 5000;
+static const int c_PauseMs = 100;
+// Wall time limit of a network session
+static const uint64_t c_SessionLimitUs = 120 * 1000000ULL;
+
+#pragma mark - Measurements
+
+static void PrintRate(const char* name, uint64_t bytes, uint64_t intervalUs)
+{
+    printf("  %-22s %.1f MB/s (%llu MB in %.2f s)\n", name, Rate(bytes, intervalUs),
+           (unsigned long long)(bytes >> 20), intervalUs / 1000000.0);
+}
+
+static void FillPattern(uint8_t* buffer, size_t size, uint64_t offset)
+{
+    // Cheap content depending on the stream offset
+    for(size_t i = 0; i < size; i += sizeof(uint64_t)) {
+        const uint64_t v = (offset + i) * 0x9E3779B97F4A7C15ULL;
+        memcpy(buffer + i, &v, std::min(sizeof(v), size - i));
+    }
+}
+
+#pragma mark - Cache buffers
+
+// Writes units until the cache is full or limit reached
+static uint64_t FillCache(ICacheBuffer& cache, uint64_t limit)
+{
+    uint64_t written = 0;
+    uint8_t* unit = nullptr;
+    const uint32_t unitSize = cache.UnitSize();
+    while(written < limit && cache.LockUnitForWrite(&unit) && nullptr != unit) {
+        FillPattern(unit, unitSize, written);
+        cache.UnlockAfterWriten(unit, unitSize);
+        written += unitSize;
+    }
+    return written;
+}
+
+// Random positions of the whole window, each followed by a read
+static void MeasureSeeks(ICacheBuffer& cache, Samples& samples)
+{
+    const int64_t begin = cache.Seek(0, SEEK_SET);
+    const int64_t end = cache.Length() - (int64_t)c_ReadSize;
+    if(begin < 0 || end <= begin)
+        return;
+    std::mt19937_64 random(42);
+    std::uniform_int_distribution<int64_t> position(begin, end);
+    std::vector<uint8_t> buffer(c_ReadSize);
+    for(int i = 0; i < c_SeeksCount; ++i) {
+        const uint64_t start = NowUs();
+        cache.Seek(position(random), SEEK_SET);
+        cache.Read(&buffer[0], buffer.size());
+        samples.Add(NowUs() - start);
+    }
+}
+
+// Writer thread streams through the cache while reader consumes it
+static void MeasureStreaming(ICacheBuffer& cache, uint64_t streamSize, Samples& readSamples)
+{
+    std::atomic<bool> isWriterDone(false);
+    const uint64_t start = NowUs();
+    uint64_t written = 0;
+    std::thread writer([&] {
+        const uint32_t unitSize = cache.UnitSize();
+        uint8_t* unit = nullptr;
+        while(written < streamSize) {
+            if(!cache.LockUnitForWrite(&unit) || nullptr == unit) {
+                // Full cache, wait for reader
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            FillPattern(unit, unitSize, written);
+            cache.UnlockAfterWriten(unit, unitSize);
+            written += unitSize;
+        }
+        isWriterDone = true;
+    });
+    std::vector<uint8_t> buffer(c_ReadSize);
+    uint64_t bytesRead = 0;
+    while(!isWriterDone || bytesRead < written) {
+        const uint64_t readStart = NowUs();
+        const ssize_t n = cache.Read(&buffer[0], buffer.size());
+        if(n > 0) {
+            readSamples.Add(NowUs() - readStart);
+            bytesRead += n;
+        } else if(isWriterDone) {
+            break;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    writer.join();
+    PrintRate("sustained write", written, NowUs() - start);
+}
+
+static void BenchmarkCache(const char* name, ICacheBuffer* cache, uint64_t windowSize, uint64_t streamSize)
+{
+    printf("%s\n", name);
+    std::unique_ptr<ICacheBuffer> holder(cache);
+    // Fill and seek over the window
+    cache->Init();
+    uint64_t start = NowUs();
+    const uint64_t filled = FillCache(*cache, windowSize);
+    PrintRate("fill write", filled, NowUs() - start);
+    Samples seeks;
+    MeasureSeeks(*cache, seeks);
+    seeks.Print("seek+read latency");
+    // Concurrent stream through the cache
+    cache->Init();
+    Samples reads;
+    MeasureStreaming(*cache, streamSize, reads);
+    reads.Print("read latency");
+}
+
+#pragma mark - Timeshift buffer
+
+// Endless synthetic source delivering data at the stream rate as live sources do
+class GeneratorBuffer : public InputBuffer
+{
+public:
+    GeneratorBuffer(double rate) : m_rate(rate), m_position(0), m_start(NowUs()) {}
+    int64_t GetLength() const {return -1;}
+    int64_t GetPosition() const {return m_position;}
+    ssize_t Read(unsigned char *buffer, size_t bufferSize, uint32_t timeoutMs) {
+        const uint64_t due = m_start + (m_position + bufferSize) / m_rate;
+        const uint64_t now = NowUs();
+        if(due > now)
+            std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+        FillPattern(buffer, bufferSize, m_position);
+        m_position += bufferSize;
+        return bufferSize;
+    }
+    int64_t Seek(int64_t iPosition, int iWhence) {return -1;}
+    bool SwitchStream(const std::string &newUrl) {return false;}
+private:
+    // Bytes per usec
+    const double m_rate;
+    // Read by the benchmark while the timeshift thread writes
+    std::atomic<int64_t> m_position;
+    const uint64_t m_start;
+};
+
+static void BenchmarkTimeshift(uint64_t windowSize, uint64_t streamSize, double rate)
+{
+    printf("TimeshiftBuffer (SimpleCyclicBuffer -> MemoryCacheBuffer swap, source %.1f MB/s)\n", rate);
+    StreamMetricsPtr metrics = std::make_shared<StreamMetrics>();
+    TimeshiftBuffer buffer(new GeneratorBuffer(rate), new SimpleCyclicBuffer(64), metrics);
+    std::vector<uint8_t> data(c_ReadSize);
+    Samples reads;
+    uint64_t bytesRead = 0;
+    auto readStream = [&](uint64_t amount) {
+        const uint64_t start = NowUs();
+        uint64_t total = 0;
+        while(total < amount) {
+            const uint64_t readStart = NowUs();
+            const ssize_t n = buffer.Read(&data[0], data.size(), c_ReadTimeoutMs);
+            if(n <= 0)
+                break;
+            reads.Add(NowUs() - readStart);
+            total += n;
+        }
+        bytesRead += total;
+        PrintRate("read", total, NowUs() - start);
+    };
+    readStream(streamSize / 2);
+    // Pause of live stream switches the cache to timeshift one.
+    // Writer waits for the swap, the swap is done by the next read on resume.
+    buffer.SwapCache(new MemoryCacheBuffer(windowSize / MemoryCacheBuffer::CHUNK_SIZE_LIMIT));
+    uint64_t resumeUs = 0;
+    while(0 == StreamMetrics::Get(metrics->swapsCount)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(c_PauseMs));
+        const uint64_t resumeStart = NowUs();
+        if(buffer.Read(&data[0], data.size(), c_ReadTimeoutMs) < 0)
+            break;
+        resumeUs = NowUs() - resumeStart;
+    }
+    printf("  %-22s %llu us (first read after pause %llu us)\n", "cache swap",
+           (unsigned long long)StreamMetrics::Get(metrics->swapTimeUs), (unsigned long long)resumeUs);
+    readStream(streamSize / 2);
+    reads.Print("read latency");
+    
+    // Seek over the timeshift window
+    Samples seeks;
+    const int64_t length = buffer.GetLength();
+    if(length > (int64_t)c_ReadSize) {
+        std::mt19937_64 random(42);
+        std::uniform_int_distribution<int64_t> position(std::max<int64_t>(0, length - windowSize), length - c_ReadSize);
+        for(int i = 0; i < c_SeeksCount; ++i) {
+            const uint64_t start = NowUs();
+            buffer.Seek(position(random), SEEK_SET);
+            buffer.Read(&data[0], data.size(), c_ReadTimeoutMs);
+            seeks.Add(NowUs() - start);
+        }
+    }
+    seeks.Print("seek+read latency");
+    PrintRate("ingest", StreamMetrics::Get(metrics->bytesIngested), metrics->SessionTimeUs());
+}
+
+#pragma mark - Playlist buffer
+
+static void BenchmarkPlaylist(uint64_t streamSize)
+{
+    printf("PlaylistBuffer (loopback VOD)\n");
+    HlsOrigin::Options options;
+    options.segmentSize = 2 * 1024 * 1024;
+    options.vodSegments = std::max<int>(4, streamSize / options.segmentSize);
+    HlsOrigin origin(options);
+    
+    StreamMetricsPtr metrics = std::make_shared<StreamMetrics>();
+    const uint64_t start = NowUs();
+    PlaylistBuffer buffer(origin.VodUrl(), std::make_shared<VodDelegate>(origin.VodUrl(), options.vodSegments * options.targetDuration), metrics);
+    std::vector<uint8_t> data(c_ReadSize);
+    Samples reads;
+    uint64_t firstByteUs = 0;
+    uint64_t total = 0;
+    int emptyReads = 0;
+    ssize_t n = 0;
+    // Kodi repeats reads returning no data, negative is EOF
+    while(total < streamSize / 2 && NowUs() - start < c_SessionLimitUs) {
+        const uint64_t readStart = NowUs();
+        if((n = buffer.Read(&data[0], data.size(), c_ReadTimeoutMs)) < 0)
+            break;
+        reads.Add(NowUs() - readStart);
+        if(0 == n) {
+            ++emptyReads;
+            continue;
+        }
+        if(0 == total)
+            firstByteUs = NowUs() - start;
+        total += n;
+    }
+    printf("  %-22s %llu us, %d empty reads\n", "first byte", (unsigned long long)firstByteUs, emptyReads);
+    PrintRate("read", total, NowUs() - start);
+    reads.Print("read latency");
+    
+    Samples seeks;
+    const int64_t length = buffer.GetLength();
+    if(length > (int64_t)c_ReadSize) {
+        std::mt19937_64 random(42);
+        std::uniform_int_distribution<int64_t> position(0, length - c_ReadSize);
+        // Each seek may download a segment
+        for(int i = 0; i < c_SeeksCount / 10; ++i) {
+            const uint64_t seekStart = NowUs();
+            buffer.Seek(position(random), SEEK_SET);
+            buffer.Read(&data[0], data.size(), c_ReadTimeoutMs);
+            seeks.Add(NowUs() - seekStart);
+        }
+    }
+    seeks.Print("seek+read latency");
+    printf("  %-22s %llu MB downloaded, %llu playlist reloads\n", "network",
+           (unsigned long long)(StreamMetrics::Get(metrics->bytesDownloaded) >> 20),
+           (unsigned long long)StreamMetrics::Get(metrics->playlistReloads));
+}
+
+#pragma mark - main
+
+int main(int argc, char* argv[])
+{
+    uint64_t windowMb = 64;
+    uint64_t streamMb = 256;
+    double rate = 16.0;
+    const char* tmpDir = getenv("TMPDIR");
+    std::string cacheDir = std::string(tmpDir ? tmpDir : "/tmp") + "/buffers_benchmark";
+    int opt;
+    while((opt = getopt(argc, argv, "vw:s:r:d:")) != -1) {
+        switch(opt) {
+            case 'v':
+                KodiStubSetLogLevel(ADDON::LOG_DEBUG);
+                Globals::SetDebugLogEnabled(true);
+                break;
+            case 'w': windowMb = strtoull(optarg, nullptr, 10); break;
+            case 's': streamMb = strtoull(optarg, nullptr, 10); break;
+            case 'r': rate = strtod(optarg, nullptr); break;
+            case 'd': cacheDir = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-v] [-w window_MB] [-s stream_MB] [-r source_MBps] [-d cache_dir]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(!Globals::CreateWithHandle(nullptr))
+        return 1;
+    const uint64_t windowSize = windowMb << 20;
+    const uint64_t streamSize = streamMb << 20;
+    
+    try {
+        BenchmarkCache("MemoryCacheBuffer", new MemoryCacheBuffer(windowSize / MemoryCacheBuffer::CHUNK_SIZE_LIMIT), windowSize, streamSize);
+        BenchmarkCache("FileCacheBuffer", new FileCacheBuffer(cacheDir, 3), windowSize, streamSize);
+        BenchmarkCache("SimpleCyclicBuffer", new SimpleCyclicBuffer(windowSize / SimpleCyclicBuffer::CHUNK_SIZE_LIMIT), windowSize, streamSize);
+        BenchmarkTimeshift(windowSize, streamSize, rate);
+        BenchmarkPlaylist(streamSize / 4);
+    } catch (std::exception& ex) {
+        fprintf(stderr, "Benchmark failed: %s\n", ex.what());
+        Globals::Cleanup();
+        return 1;
+    }
+    Globals::Cleanup();
+    return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+// Load test of PlaylistBuffer sessions against the loopback HLS origin.
+// Each session is played by a simple player model consuming data at the stream rate.
+//
+// Usage: hls_load [-v] [-n sessions] [-t seconds] [-m live|vod] [-d target_duration]
+//                 [-z segment_KB] [-w window] [-L latency_ms] [-e error_%]
+//                 [-s stall_%] [-S stall_ms] [-T truncate_%]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "libXBMC_addon.h"
+#include "globals.hpp"
+#include "helpers.h"
+#include "plist_buffer.h"
+#include "hls_origin.h"
+#include "bench_utils.h"
+
+namespace Globals
+{
+    bool CreateWithHandle(void* hdl);
+    void Cleanup();
+}
+
+using namespace Buffers;
+
+static const size_t c_ReadSize = 32 * 1024;
+static const uint32_t c_ReadTimeoutMs = 1000;
+// Player reads ahead of the playback position up to this time
+static const double c_PlayerBufferSec = 4.0;
+// Playback resumes after rebuffering with this time buffered
+static const double c_ResumeBufferSec = 1.0;
+// Player polls again after a read without data
+static const int c_EmptyReadPauseMs = 10;
+
+struct SessionResult
+{
+    SessionResult()
+    : isStarted(false), isFailed(false), startupUs(0), rebuffers(0), rebufferUs(0), emptyReads(0)
+    , delivered(0), downloaded(0), reloads(0), segmentsFailed(0), durationUs(0)
+    {}
+    bool isStarted;
+    // Playlist is not available or stream ended before time
+    bool isFailed;
+    uint64_t startupUs;
+    uint64_t rebuffers;
+    uint64_t rebufferUs;
+    uint64_t emptyReads;
+    uint64_t delivered;
+    uint64_t downloaded;
+    uint64_t reloads;
+    uint64_t segmentsFailed;
+    uint64_t durationUs;
+};
+
+// Plays the stream for the duration. Playback clock runs while data is buffered.
+static void RunSession(const std::string& url, PlaylistBufferDelegate delegate, double bitrate,
+                       uint64_t durationUs, SessionResult& result)
+{
+    const uint64_t start = NowUs();
+    StreamMetricsPtr metrics = std::make_shared<StreamMetrics>();
+    std::unique_ptr<PlaylistBuffer> buffer;
+    try {
+        buffer.reset(new PlaylistBuffer(url, delegate, metrics));
+    } catch (std::exception& ex) {
+        Globals::LogError("hls_load: session failed to start. %s", ex.what());
+        result.isFailed = true;
+        return;
+    }
+    
+    std::vector<uint8_t> data(c_ReadSize);
+    // Microseconds of media played and delivered
+    double playedUs = 0;
+    bool isRebuffering = false;
+    uint64_t lastTick = 0;
+    while(NowUs() - start < durationUs) {
+        const uint64_t now = NowUs();
+        const double deliveredUs = result.delivered / bitrate * 1000000.0;
+        if(result.isStarted) {
+            const uint64_t dt = now - lastTick;
+            lastTick = now;
+            if(isRebuffering) {
+                result.rebufferUs += dt;
+                isRebuffering = deliveredUs - playedUs < c_ResumeBufferSec * 1000000.0;
+            } else {
+                playedUs += dt;
+                if(playedUs > deliveredUs) {
+                    ++result.rebuffers;
+                    playedUs = deliveredUs;
+                    isRebuffering = true;
+                }
+            }
+            // Player buffer is full
+            const double aheadUs = deliveredUs - playedUs - c_PlayerBufferSec * 1000000.0;
+            if(!isRebuffering && aheadUs > 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)aheadUs));
+                continue;
+            }
+        }
+        const ssize_t bytesRead = buffer->Read(&data[0], data.size(), c_ReadTimeoutMs);
+        if(bytesRead < 0) {
+            // EOF of VOD or stopped download
+            result.isFailed = !delegate;
+            break;
+        }
+        if(0 == bytesRead) {
+            ++result.emptyReads;
+            std::this_thread::sleep_for(std::chrono::milliseconds(c_EmptyReadPauseMs));
+            continue;
+        }
+        if(!result.isStarted) {
+            result.isStarted = true;
+            result.startupUs = NowUs() - start;
+            lastTick = NowUs();
+        }
+        result.delivered += bytesRead;
+    }
+    result.durationUs = NowUs() - start;
+    result.downloaded = StreamMetrics::Get(metrics->bytesDownloaded);
+    result.reloads = StreamMetrics::Get(metrics->playlistReloads);
+    result.segmentsFailed = StreamMetrics::Get(metrics->segmentsFailed);
+}
+
+static void PrintUsage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-v] [-n sessions] [-t seconds] [-m live|vod] [-d target_duration]\n"
+                    "       [-z segment_KB] [-w window] [-L latency_ms] [-e error_%%]\n"
+                    "       [-s stall_%%] [-S stall_ms] [-T truncate_%%]\n", name);
+}
+
+int main(int argc, char* argv[])
+{
+    HlsOrigin::Options options;
+    int sessionsCount = 4;
+    int durationSec = 60;
+    bool isVod = false;
+    int opt;
+    while((opt = getopt(argc, argv, "vn:t:m:d:z:w:L:e:s:S:T:")) != -1) {
+        switch(opt) {
+            case 'v':
+                KodiStubSetLogLevel(ADDON::LOG_DEBUG);
+                Globals::SetDebugLogEnabled(true);
+                break;
+            case 'n': sessionsCount = atoi(optarg); break;
+            case 't': durationSec = atoi(optarg); break;
+            case 'm': isVod = 0 == strcmp(optarg, "vod"); break;
+            case 'd': options.targetDuration = atoi(optarg); break;
+            case 'z': options.segmentSize = strtoul(optarg, nullptr, 10) * 1024; break;
+            case 'w': options.windowSize = atoi(optarg); break;
+            case 'L': options.latencyMs = atoi(optarg); break;
+            case 'e': options.errorPercent = atoi(optarg); break;
+            case 's': options.stallPercent = atoi(optarg); break;
+            case 'S': options.stallMs = atoi(optarg); break;
+            case 'T': options.truncatePercent = atoi(optarg); break;
+            default:
+                PrintUsage(argv[0]);
+                return 1;
+        }
+    }
+    if(sessionsCount <= 0 || durationSec <= 0 || options.targetDuration <= 0 || options.windowSize <= 0 || 0 == options.segmentSize) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if(!Globals::CreateWithHandle(nullptr))
+        return 1;
+    
+    int result = 0;
+    try {
+        HlsOrigin origin(options);
+        const std::string url = isVod ? origin.VodUrl() : origin.LiveUrl();
+        // Live streams are played without delegate, as PVR clients do
+        PlaylistBufferDelegate delegate;
+        if(isVod)
+            delegate = std::make_shared<VodDelegate>(url, options.vodSegments * options.targetDuration);
+        
+        std::vector<SessionResult> results(sessionsCount);
+        std::vector<std::thread> sessions;
+        for(int i = 0; i < sessionsCount; ++i)
+            sessions.push_back(std::thread(RunSession, url, delegate, origin.Bitrate(), durationSec * 1000000ULL, std::ref(results[i])));
+        for(auto& session : sessions)
+            session.join();
+        
+        printf("HLS load: %d %s sessions, %d s, target duration %d s, segment %zu KB, window %d\n",
+               sessionsCount, isVod ? "VOD" : "live", durationSec, options.targetDuration, options.segmentSize / 1024, options.windowSize);
+        const HlsOrigin::Counters& counters = origin.Stats();
+        printf("  %-22s %llu playlists, %llu segments, %llu x 503, %llu stalls, %llu truncated\n", "origin requests",
+               (unsigned long long)counters.playlistRequests.load(), (unsigned long long)counters.segmentRequests.load(),
+               (unsigned long long)counters.errors.load(), (unsigned long long)counters.stalls.load(),
+               (unsigned long long)counters.truncations.load());
+        printf("  %-22s %.1f MB\n", "origin served", counters.bytesServed.load() / 1048576.0);
+        Samples startup;
+        uint64_t rebuffers = 0, rebufferUs = 0, emptyReads = 0, delivered = 0, downloaded = 0, reloads = 0, segmentsFailed = 0, durationUs = 0;
+        int failed = 0;
+        for(const auto& r : results) {
+            if(r.isStarted)
+                startup.Add(r.startupUs);
+            failed += r.isFailed || !r.isStarted;
+            rebuffers += r.rebuffers;
+            rebufferUs += r.rebufferUs;
+            emptyReads += r.emptyReads;
+            delivered += r.delivered;
+            downloaded += r.downloaded;
+            reloads += r.reloads;
+            segmentsFailed += r.segmentsFailed;
+            durationUs += r.durationUs;
+        }
+        startup.Print("startup latency");
+        printf("  %-22s %d of %d\n", "failed sessions", failed, sessionsCount);
+        printf("  %-22s %llu events, %.1f s total, %llu empty reads\n", "rebuffering", (unsigned long long)rebuffers,
+               rebufferUs / 1000000.0, (unsigned long long)emptyReads);
+        printf("  %-22s %.1f MB downloaded, %.1f MB delivered (%.2f)\n", "bytes", downloaded / 1048576.0, delivered / 1048576.0,
+               downloaded > 0 ? double(delivered) / downloaded : 0.0);
+        printf("  %-22s %.1f per session per minute\n", "playlist reloads", durationUs > 0 ? reloads * 60000000.0 / durationUs : 0.0);
+        printf("  %-22s %llu\n", "failed segments", (unsigned long long)segmentsFailed);
+    } catch (std::exception& ex) {
+        fprintf(stderr, "hls_load failed: %s\n", ex.what());
+        result = 1;
+    }
+    Globals::Cleanup();
+    return result;
+}
@@ -0,0 +1,191 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "hls_origin.h"
+#include "bench_utils.h"
+
+static const uint8_t c_TsSyncByte = 0x47;
+static const size_t c_TsPacketSize = 188;
+static const int c_VideoPid = 0x100;
+// Portion of streamed segment body
+static const size_t c_StreamChunkSize = 64 * 1024;
+
+static void SleepMs(int ms)
+{
+    if(ms > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+HlsOrigin::HlsOrigin(const Options& options)
+: m_options(options)
+, m_startTime(NowUs())
+, m_random(options.seed)
+, m_port(-1)
+{
+    m_counters.playlistRequests = 0;
+    m_counters.segmentRequests = 0;
+    m_counters.errors = 0;
+    m_counters.stalls = 0;
+    m_counters.truncations = 0;
+    m_counters.bytesServed = 0;
+    
+    // Same TS packets for all segments, one PID with continuity counter
+    m_segment.resize(m_options.segmentSize);
+    for(size_t pos = 0, counter = 0; pos < m_segment.size(); pos += c_TsPacketSize, ++counter) {
+        char packet[c_TsPacketSize];
+        memset(packet, 0xFF, sizeof(packet));
+        packet[0] = c_TsSyncByte;
+        packet[1] = (c_VideoPid >> 8) & 0x1F;
+        packet[2] = c_VideoPid & 0xFF;
+        packet[3] = 0x10 | (counter & 0x0F);
+        m_segment.replace(pos, std::min(c_TsPacketSize, m_segment.size() - pos), packet, std::min(c_TsPacketSize, m_segment.size() - pos));
+    }
+    
+    m_server.Get("/live.m3u8", [this](const httplib::Request& req, httplib::Response& res) {
+        ServePlaylist(req, res, true);
+    });
+    m_server.Get("/vod.m3u8", [this](const httplib::Request& req, httplib::Response& res) {
+        ServePlaylist(req, res, false);
+    });
+    m_server.Get(R"(/seg(\d+)\.ts)", [this](const httplib::Request& req, httplib::Response& res) {
+        ServeSegment(req, res);
+    });
+    m_port = m_server.bind_to_any_port("127.0.0.1");
+    if(m_port < 0)
+        throw std::runtime_error("HlsOrigin: failed to bind loopback port.");
+    m_thread = std::thread([this] {m_server.listen_after_bind();});
+}
+
+HlsOrigin::~HlsOrigin()
+{
+    m_server.stop();
+    m_thread.join();
+}
+
+std::string HlsOrigin::BaseUrl() const
+{
+    return "http://127.0.0.1:" + std::to_string(m_port);
+}
+
+int64_t HlsOrigin::LiveHead() const
+{
+    // Full window is available from the start
+    const int64_t elapsed = (NowUs() - m_startTime) / 1000000;
+    return elapsed / m_options.targetDuration + m_options.windowSize - 1;
+}
+
+HlsOrigin::Fault HlsOrigin::NextFault(const httplib::Request& req, bool isSegment)
+{
+    if(req.method != "GET")
+        return k_NoFault;
+    std::lock_guard<std::mutex> lock(m_randomMutex);
+    std::uniform_int_distribution<int> percent(0, 99);
+    if(percent(m_random) < m_options.errorPercent)
+        return k_Error;
+    if(!isSegment)
+        return k_NoFault;
+    if(percent(m_random) < m_options.stallPercent)
+        return k_Stall;
+    if(percent(m_random) < m_options.truncatePercent)
+        return k_Truncate;
+    return k_NoFault;
+}
+
+void HlsOrigin::ServePlaylist(const httplib::Request& req, httplib::Response& res, bool isLive)
+{
+    ++m_counters.playlistRequests;
+    SleepMs(m_options.latencyMs);
+    if(k_Error == NextFault(req, false)) {
+        ++m_counters.errors;
+        res.status = 503;
+        return;
+    }
+    const std::string duration = std::to_string(m_options.targetDuration);
+    int64_t first = 0;
+    int64_t last = m_options.vodSegments - 1;
+    std::string playlist = "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:" + duration + "\n";
+    if(isLive) {
+        last = LiveHead();
+        first = last - m_options.windowSize + 1;
+        playlist += "#EXT-X-MEDIA-SEQUENCE:" + std::to_string(first) + "\n";
+    } else {
+        playlist += "#EXT-X-PLAYLIST-TYPE:VOD\n";
+    }
+    for(int64_t i = first; i <= last; ++i)
+        playlist += "#EXTINF:" + duration + ".0,\nseg" + std::to_string(i) + ".ts\n";
+    if(!isLive)
+        playlist += "#EXT-X-ENDLIST\n";
+    res.set_content(playlist, "application/vnd.apple.mpegurl");
+}
+
+void HlsOrigin::ServeSegment(const httplib::Request& req, httplib::Response& res)
+{
+    ++m_counters.segmentRequests;
+    SleepMs(m_options.latencyMs);
+    const int64_t index = strtoll(req.matches[1].str().c_str(), nullptr, 10);
+    // Segments ahead of live edge don't exist yet. VOD range is served for live too (archive).
+    if(index > std::max<int64_t>(LiveHead(), m_options.vodSegments - 1)) {
+        res.status = 404;
+        return;
+    }
+    const Fault fault = NextFault(req, true);
+    if(k_Error == fault) {
+        ++m_counters.errors;
+        res.status = 503;
+        return;
+    }
+    res.status = 200;
+    if(k_NoFault == fault) {
+        if(req.method == "GET")
+            m_counters.bytesServed += m_segment.size();
+        res.set_content(m_segment, "video/mp2t");
+        return;
+    }
+    // Faulty body is streamed with full Content-Length
+    const size_t length = m_segment.size();
+    const size_t faultOffset = length / 2;
+    res.set_header("Content-Type", "video/mp2t");
+    res.set_header("Content-Length", std::to_string(length).c_str());
+    if(k_Stall == fault)
+        ++m_counters.stalls;
+    else
+        ++m_counters.truncations;
+    const std::string& segment = m_segment;
+    const int stallMs = m_options.stallMs;
+    std::atomic<uint64_t>& bytesServed = m_counters.bytesServed;
+    res.streamcb = [fault, faultOffset, stallMs, &segment, &bytesServed](uint64_t offset) {
+        if(offset == faultOffset) {
+            if(k_Truncate == fault)
+                return std::string();
+            SleepMs(stallMs);
+        }
+        // Chunks are split at the fault offset
+        const size_t end = offset < faultOffset ? faultOffset : segment.size();
+        const size_t size = std::min(c_StreamChunkSize, end - offset);
+        bytesServed += size;
+        return segment.substr(offset, size);
+    };
+}
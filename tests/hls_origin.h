@@ -0,0 +1,116 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef hls_origin_h
+#define hls_origin_h
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include "httplib.h"
+
+// Synthetic HLS origin on loopback for reproducible PlaylistBuffer tests.
+// Serves /live.m3u8 (sliding window advancing with wall time),
+// /vod.m3u8 and /seg<N>.ts of MPEG-TS packets.
+// Faults are injected into GET requests only, HEAD (StatFile) is served as is.
+class HlsOrigin
+{
+public:
+    struct Options
+    {
+        Options()
+        : targetDuration(6)
+        , segmentSize(1024 * 1024)
+        , windowSize(6)
+        , vodSegments(60)
+        , latencyMs(0)
+        , errorPercent(0)
+        , stallPercent(0)
+        , stallMs(0)
+        , truncatePercent(0)
+        , seed(1)
+        {}
+        // Seconds
+        int targetDuration;
+        size_t segmentSize;
+        // Segments in live playlist
+        int windowSize;
+        int vodSegments;
+        // Delay of every response
+        int latencyMs;
+        // Chance of 503 response, playlists included
+        int errorPercent;
+        // Chance of a pause in the middle of segment body
+        int stallPercent;
+        int stallMs;
+        // Chance of segment body closed at half of Content-Length
+        int truncatePercent;
+        unsigned int seed;
+    };
+    
+    struct Counters
+    {
+        std::atomic<uint64_t> playlistRequests;
+        std::atomic<uint64_t> segmentRequests;
+        std::atomic<uint64_t> errors;
+        std::atomic<uint64_t> stalls;
+        std::atomic<uint64_t> truncations;
+        // Segment body bytes sent to GET requests
+        std::atomic<uint64_t> bytesServed;
+    };
+    
+    // Starts listening on a free loopback port
+    HlsOrigin(const Options& options);
+    ~HlsOrigin();
+    
+    std::string LiveUrl() const {return BaseUrl() + "/live.m3u8";}
+    std::string VodUrl() const {return BaseUrl() + "/vod.m3u8";}
+    // Stream rate, bytes per second
+    double Bitrate() const {return double(m_options.segmentSize) / m_options.targetDuration;}
+    const Counters& Stats() const {return m_counters;}
+    
+private:
+    enum Fault {k_NoFault, k_Error, k_Stall, k_Truncate};
+    
+    std::string BaseUrl() const;
+    // Index of the newest live segment
+    int64_t LiveHead() const;
+    Fault NextFault(const httplib::Request& req, bool isSegment);
+    void ServePlaylist(const httplib::Request& req, httplib::Response& res, bool isLive);
+    void ServeSegment(const httplib::Request& req, httplib::Response& res);
+    
+    const Options m_options;
+    const uint64_t m_startTime;
+    std::string m_segment;
+    std::mutex m_randomMutex;
+    std::mt19937 m_random;
+    Counters m_counters;
+    httplib::Server m_server;
+    std::thread m_thread;
+    int m_port;
+};
+
+#endif /* hls_origin_h */
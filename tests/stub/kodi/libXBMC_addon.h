@@ -0,0 +1,147 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Minimal stand-in of Kodi add-on helper for offline tools.
+// Only API used by stream buffers is declared. File operations are mapped
+// to POSIX, http:// URLs to a plain HTTP/1.1 client (loopback servers).
+
+#ifndef __kodi_stub_libXBMC_addon_h__
+#define __kodi_stub_libXBMC_addon_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define PATH_SEPARATOR_CHAR '/'
+#define __stat64 stat
+
+namespace XFILE
+{
+    enum OpenFileFlags
+    {
+        READ_TRUNCATED = 0x01,
+        READ_CHUNKED = 0x02,
+        READ_CACHED = 0x04,
+        READ_NO_CACHE = 0x08,
+        READ_BITRATE = 0x10,
+        READ_MULTI_STREAM = 0x20,
+        READ_AUDIO_VIDEO = 0x40,
+        READ_AFTER_WRITE = 0x80,
+        READ_REOPEN = 0x100
+    };
+    
+    enum CURLOptiontype
+    {
+        CURL_OPTION_OPTION,
+        CURL_OPTION_PROTOCOL,
+        CURL_OPTION_CREDENTIALS,
+        CURL_OPTION_HEADER
+    };
+    
+    enum FilePropertyTypes
+    {
+        FILE_PROPERTY_RESPONSE_PROTOCOL,
+        FILE_PROPERTY_RESPONSE_HEADER,
+        FILE_PROPERTY_CONTENT_TYPE,
+        FILE_PROPERTY_CONTENT_CHARSET,
+        FILE_PROPERTY_MIME_TYPE,
+        FILE_PROPERTY_EFFECTIVE_URL
+    };
+}
+
+struct VFSProperty
+{
+    char* name;
+    char* val;
+};
+
+// Layout of entries Kodi actually returns (see VFSDirEntry_Patch)
+struct VFSDirEntry
+{
+    char* label;
+    char* title;
+    char* path;
+    unsigned int num_props;
+    VFSProperty* properties;
+    bool folder;
+    uint64_t size;
+};
+
+namespace ADDON
+{
+    typedef enum addon_log
+    {
+        LOG_DEBUG,
+        LOG_INFO,
+        LOG_NOTICE,
+        LOG_ERROR
+    } addon_log_t;
+    
+    typedef enum queue_msg
+    {
+        QUEUE_INFO,
+        QUEUE_WARNING,
+        QUEUE_ERROR
+    } queue_msg_t;
+    
+    class CHelper_libXBMC_addon
+    {
+    public:
+        CHelper_libXBMC_addon() {}
+        ~CHelper_libXBMC_addon() {}
+        
+        bool RegisterMe(void* handle);
+        
+        void Log(const addon_log_t loglevel, const char* format, ...);
+        bool GetSetting(const char* settingName, void* settingValue);
+        void QueueNotification(const queue_msg_t type, const char* format, ...);
+        char* GetLocalizedString(int dwCode);
+        void FreeString(char* str);
+        char* TranslateSpecialProtocol(const char* source);
+        
+        void* OpenFile(const char* strFileName, unsigned int flags);
+        void* OpenFileForWrite(const char* strFileName, bool bOverWrite);
+        ssize_t ReadFile(void* file, void* lpBuf, size_t uiBufSize);
+        ssize_t WriteFile(void* file, const void* lpBuf, size_t uiBufSize);
+        void FlushFile(void* file);
+        int64_t SeekFile(void* file, int64_t iFilePosition, int iWhence);
+        int TruncateFile(void* file, int64_t iSize);
+        int64_t GetFilePosition(void* file);
+        int64_t GetFileLength(void* file);
+        void CloseFile(void* file);
+        
+        bool FileExists(const char* strFileName, bool bUseCache);
+        int StatFile(const char* strFileName, struct __stat64* buffer);
+        bool DeleteFile(const char* strFileName);
+        bool CreateDirectory(const char* strPath);
+        bool DirectoryExists(const char* strPath);
+        bool RemoveDirectory(const char* strPath);
+        bool GetDirectory(const char* strPath, const char* mask, VFSDirEntry** items, unsigned int* num_items);
+        void FreeDirectory(VFSDirEntry* items, unsigned int num_items);
+    };
+}
+
+// Messages below the level are dropped. Default is LOG_NOTICE.
+void KodiStubSetLogLevel(ADDON::addon_log_t level);
+
+#endif /* __kodi_stub_libXBMC_addon_h__ */
@@ -0,0 +1,32 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Minimal stand-in of Kodi add-on types for offline tools.
+
+#ifndef __kodi_stub_xbmc_addon_types_h__
+#define __kodi_stub_xbmc_addon_types_h__
+
+#include "AddonBase.h"
+
+typedef struct ADDON_HANDLE_STRUCT* ADDON_HANDLE;
+
+#endif /* __kodi_stub_xbmc_addon_types_h__ */
@@ -0,0 +1,59 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Minimal stand-in of Kodi PVR types for offline tools.
+// Structures are only referred by the add-on interfaces, so they are incomplete.
+
+#ifndef __kodi_stub_xbmc_pvr_types_h__
+#define __kodi_stub_xbmc_pvr_types_h__
+
+#include <string.h>
+#include <time.h>
+#include "xbmc_addon_types.h"
+
+typedef enum
+{
+    PVR_ERROR_NO_ERROR = 0,
+    PVR_ERROR_UNKNOWN = -1,
+    PVR_ERROR_NOT_IMPLEMENTED = -2,
+    PVR_ERROR_SERVER_ERROR = -3,
+    PVR_ERROR_SERVER_TIMEOUT = -4,
+    PVR_ERROR_REJECTED = -5,
+    PVR_ERROR_ALREADY_PRESENT = -6,
+    PVR_ERROR_INVALID_PARAMETERS = -7,
+    PVR_ERROR_RECORDING_RUNNING = -8,
+    PVR_ERROR_FAILED = -9
+} PVR_ERROR;
+
+struct PVR_PROPERTIES;
+struct PVR_ADDON_CAPABILITIES;
+struct PVR_SIGNAL_STATUS;
+struct PVR_CHANNEL;
+struct PVR_CHANNEL_GROUP;
+struct PVR_RECORDING;
+struct PVR_TIMER;
+struct PVR_STREAM_TIMES;
+struct PVR_MENUHOOK;
+struct PVR_MENUHOOK_DATA;
+struct EPG_TAG;
+
+#endif /* __kodi_stub_xbmc_pvr_types_h__ */
@@ -0,0 +1,478 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include "kodi/libXBMC_addon.h"
+
+using namespace ADDON;
+
+static std::atomic<int> s_logLevel(LOG_NOTICE);
+// Receive timeout of HTTP connections
+static const int c_HttpTimeoutSec = 30;
+
+void KodiStubSetLogLevel(addon_log_t level)
+{
+    s_logLevel = level;
+}
+
+static void LogV(addon_log_t level, const char* format, va_list args)
+{
+    static const char* c_Levels[] = {"DEBUG", "INFO", "NOTICE", "ERROR"};
+    if(level < s_logLevel)
+        return;
+    char message[4096];
+    vsnprintf(message, sizeof(message), format, args);
+    fprintf(stderr, "%s: %s\n", c_Levels[level], message);
+}
+
+static void StubLog(addon_log_t level, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    LogV(level, format, args);
+    va_end(args);
+}
+
+#pragma mark - File handles
+
+namespace
+{
+    struct StubFile
+    {
+        StubFile() : fd(-1), sock(-1), contentLength(-1), position(0), isBroken(false) {}
+        ~StubFile() {
+            if(fd >= 0)
+                close(fd);
+            if(sock >= 0)
+                close(sock);
+        }
+        bool IsHttp() const {return sock >= 0;}
+        
+        // Local file
+        int fd;
+        // HTTP response body
+        int sock;
+        std::string pending;
+        int64_t contentLength;
+        int64_t position;
+        // Connection closed before Content-Length bytes
+        bool isBroken;
+    };
+    
+    struct HttpUrl
+    {
+        std::string host;
+        std::string port;
+        std::string path;
+    };
+}
+
+static bool IsHttpUrl(const char* url)
+{
+    return 0 == strncmp(url, "http://", 7);
+}
+
+static bool ParseHttpUrl(const std::string& url, HttpUrl& parsed)
+{
+    const std::string rest = url.substr(7);
+    const size_t pathPos = rest.find('/');
+    const std::string hostPort = rest.substr(0, pathPos);
+    parsed.path = std::string::npos == pathPos ? "/" : rest.substr(pathPos);
+    const size_t portPos = hostPort.find(':');
+    parsed.host = hostPort.substr(0, portPos);
+    parsed.port = std::string::npos == portPos ? "80" : hostPort.substr(portPos + 1);
+    return !parsed.host.empty();
+}
+
+static int Connect(const HttpUrl& url)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if(0 != getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &result))
+        return -1;
+    int sock = -1;
+    for(addrinfo* ai = result; ai != nullptr && sock < 0; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(sock < 0)
+            continue;
+        if(0 != connect(sock, ai->ai_addr, ai->ai_addrlen)) {
+            close(sock);
+            sock = -1;
+        }
+    }
+    freeaddrinfo(result);
+    if(sock >= 0) {
+        timeval timeout = {c_HttpTimeoutSec, 0};
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        int noDelay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+    return sock;
+}
+
+static bool SendAll(int sock, const std::string& data)
+{
+    size_t sent = 0;
+    while(sent < data.size()) {
+        const ssize_t n = send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Sends request and reads response head. Body bytes received with the head are kept as pending.
+// Returns NULL on connection failure or non 2xx status, as Kodi does.
+static StubFile* HttpRequest(const char* method, const char* url)
+{
+    HttpUrl parsed;
+    if(!ParseHttpUrl(url, parsed))
+        return nullptr;
+    StubFile* file = new StubFile();
+    file->sock = Connect(parsed);
+    std::string request = std::string(method) + " " + parsed.path + " HTTP/1.1\r\n";
+    request += "Host: " + parsed.host + ":" + parsed.port + "\r\n";
+    request += "Connection: close\r\n\r\n";
+    if(file->sock < 0 || !SendAll(file->sock, request)) {
+        delete file;
+        return nullptr;
+    }
+    std::string head;
+    size_t headEnd = std::string::npos;
+    char buffer[4096];
+    while(std::string::npos == (headEnd = head.find("\r\n\r\n"))) {
+        const ssize_t n = recv(file->sock, buffer, sizeof(buffer), 0);
+        if(n <= 0) {
+            delete file;
+            return nullptr;
+        }
+        head.append(buffer, n);
+    }
+    file->pending = head.substr(headEnd + 4);
+    head.resize(headEnd + 2);
+    
+    int status = 0;
+    if(1 != sscanf(head.c_str(), "HTTP/%*s %d", &status) || status < 200 || status > 299) {
+        StubLog(LOG_DEBUG, "KodiStub: HTTP status %d for %s", status, url);
+        delete file;
+        return nullptr;
+    }
+    for(size_t pos = head.find("\r\n"); pos != std::string::npos; ) {
+        const size_t next = head.find("\r\n", pos + 2);
+        if(next == std::string::npos)
+            break;
+        std::string line = head.substr(pos + 2, next - pos - 2);
+        std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+        if(0 == line.compare(0, 15, "content-length:"))
+            file->contentLength = strtoll(line.c_str() + 15, nullptr, 10);
+        pos = next;
+    }
+    return file;
+}
+
+static ssize_t HttpRead(StubFile* file, void* buffer, size_t size)
+{
+    if(file->contentLength >= 0)
+        size = (size_t)std::min<int64_t>(size, file->contentLength - file->position);
+    if(0 == size)
+        return 0;
+    ssize_t bytesRead = 0;
+    if(!file->pending.empty()) {
+        bytesRead = std::min(size, file->pending.size());
+        memcpy(buffer, file->pending.data(), bytesRead);
+        file->pending.erase(0, bytesRead);
+    } else {
+        bytesRead = recv(file->sock, buffer, size, 0);
+        if(bytesRead < 0 || (0 == bytesRead && file->contentLength >= 0)) {
+            file->isBroken = true;
+            return -1;
+        }
+    }
+    file->position += bytesRead;
+    return bytesRead;
+}
+
+#pragma mark - CHelper_libXBMC_addon
+
+bool CHelper_libXBMC_addon::RegisterMe(void* handle)
+{
+    (void)handle;
+    return true;
+}
+
+void CHelper_libXBMC_addon::Log(const addon_log_t loglevel, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    LogV(loglevel, format, args);
+    va_end(args);
+}
+
+bool CHelper_libXBMC_addon::GetSetting(const char* settingName, void* settingValue)
+{
+    (void)settingName;
+    (void)settingValue;
+    return false;
+}
+
+void CHelper_libXBMC_addon::QueueNotification(const queue_msg_t type, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    LogV(QUEUE_ERROR == type ? LOG_ERROR : LOG_NOTICE, format, args);
+    va_end(args);
+}
+
+char* CHelper_libXBMC_addon::GetLocalizedString(int dwCode)
+{
+    char* str = (char*)malloc(32);
+    snprintf(str, 32, "String #%d", dwCode);
+    return str;
+}
+
+void CHelper_libXBMC_addon::FreeString(char* str)
+{
+    free(str);
+}
+
+char* CHelper_libXBMC_addon::TranslateSpecialProtocol(const char* source)
+{
+    static const char c_Temp[] = "special://temp/";
+    if(0 != strncmp(source, c_Temp, sizeof(c_Temp) - 1))
+        return strdup(source);
+    const char* tmpDir = getenv("TMPDIR");
+    std::string path = std::string(tmpDir ? tmpDir : "/tmp") + "/" + (source + sizeof(c_Temp) - 1);
+    return strdup(path.c_str());
+}
+
+void* CHelper_libXBMC_addon::OpenFile(const char* strFileName, unsigned int flags)
+{
+    (void)flags;
+    if(IsHttpUrl(strFileName))
+        return HttpRequest("GET", strFileName);
+    const int fd = open(strFileName, O_RDONLY);
+    if(fd < 0)
+        return nullptr;
+    StubFile* file = new StubFile();
+    file->fd = fd;
+    return file;
+}
+
+void* CHelper_libXBMC_addon::OpenFileForWrite(const char* strFileName, bool bOverWrite)
+{
+    if(IsHttpUrl(strFileName))
+        return nullptr;
+    const int fd = open(strFileName, O_RDWR | O_CREAT | (bOverWrite ? O_TRUNC : 0), 0644);
+    if(fd < 0)
+        return nullptr;
+    StubFile* file = new StubFile();
+    file->fd = fd;
+    return file;
+}
+
+ssize_t CHelper_libXBMC_addon::ReadFile(void* file, void* lpBuf, size_t uiBufSize)
+{
+    StubFile* f = static_cast<StubFile*>(file);
+    if(f->IsHttp())
+        return HttpRead(f, lpBuf, uiBufSize);
+    return read(f->fd, lpBuf, uiBufSize);
+}
+
+ssize_t CHelper_libXBMC_addon::WriteFile(void* file, const void* lpBuf, size_t uiBufSize)
+{
+    StubFile* f = static_cast<StubFile*>(file);
+    if(f->IsHttp())
+        return -1;
+    size_t written = 0;
+    while(written < uiBufSize) {
+        const ssize_t n = write(f->fd, (const char*)lpBuf + written, uiBufSize - written);
+        if(n < 0)
+            return written > 0 ? (ssize_t)written : -1;
+        written += n;
+    }
+    return written;
+}
+
+void CHelper_libXBMC_addon::FlushFile(void* file)
+{
+    StubFile* f = static_cast<StubFile*>(file);
+    if(!f->IsHttp())
+        fsync(f->fd);
+}
+
+int64_t CHelper_libXBMC_addon::SeekFile(void* file, int64_t iFilePosition, int iWhence)
+{
+    StubFile* f = static_cast<StubFile*>(file);
+    if(f->IsHttp())
+        return -1;
+    return lseek(f->fd, iFilePosition, iWhence);
+}
+
+int CHelper_libXBMC_addon::TruncateFile(void* file, int64_t iSize)
+{
+    StubFile* f = static_cast<StubFile*>(file);
+    if(f->IsHttp())
+        return -1;
+    return ftruncate(f->fd, iSize);
+}
+
+int64_t CHelper_libXBMC_addon::GetFilePosition(void* file)
+{
+    StubFile* f = static_cast<StubFile*>(file);
+    if(f->IsHttp())
+        return f->position;
+    return lseek(f->fd, 0, SEEK_CUR);
+}
+
+int64_t CHelper_libXBMC_addon::GetFileLength(void* file)
+{
+    StubFile* f = static_cast<StubFile*>(file);
+    if(f->IsHttp())
+        return f->contentLength;
+    struct stat st;
+    return 0 == fstat(f->fd, &st) ? st.st_size : -1;
+}
+
+void CHelper_libXBMC_addon::CloseFile(void* file)
+{
+    delete static_cast<StubFile*>(file);
+}
+
+bool CHelper_libXBMC_addon::FileExists(const char* strFileName, bool bUseCache)
+{
+    (void)bUseCache;
+    struct __stat64 st;
+    return 0 == StatFile(strFileName, &st);
+}
+
+int CHelper_libXBMC_addon::StatFile(const char* strFileName, struct __stat64* buffer)
+{
+    if(!IsHttpUrl(strFileName))
+        return stat(strFileName, buffer);
+    // Size of HTTP resource from HEAD response
+    StubFile* file = HttpRequest("HEAD", strFileName);
+    if(nullptr == file)
+        return -1;
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->st_size = file->contentLength;
+    buffer->st_mode = S_IFREG;
+    delete file;
+    return 0;
+}
+
+bool CHelper_libXBMC_addon::DeleteFile(const char* strFileName)
+{
+    return 0 == unlink(strFileName);
+}
+
+bool CHelper_libXBMC_addon::CreateDirectory(const char* strPath)
+{
+    // Creates parents as Kodi does
+    std::string path(strPath);
+    for(size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+        const std::string parent = path.substr(0, pos);
+        if(0 != mkdir(parent.c_str(), 0755) && EEXIST != errno)
+            return false;
+        if(std::string::npos == pos)
+            break;
+    }
+    return true;
+}
+
+bool CHelper_libXBMC_addon::DirectoryExists(const char* strPath)
+{
+    struct stat st;
+    return 0 == stat(strPath, &st) && S_ISDIR(st.st_mode);
+}
+
+bool CHelper_libXBMC_addon::RemoveDirectory(const char* strPath)
+{
+    return 0 == rmdir(strPath);
+}
+
+bool CHelper_libXBMC_addon::GetDirectory(const char* strPath, const char* mask, VFSDirEntry** items, unsigned int* num_items)
+{
+    DIR* dir = opendir(strPath);
+    if(nullptr == dir)
+        return false;
+    std::vector<VFSDirEntry> entries;
+    std::string base(strPath);
+    if(!base.empty() && base[base.size() - 1] != '/')
+        base += '/';
+    while(dirent* e = readdir(dir)) {
+        if(0 == strcmp(e->d_name, ".") || 0 == strcmp(e->d_name, ".."))
+            continue;
+        const std::string path = base + e->d_name;
+        struct stat st;
+        if(0 != stat(path.c_str(), &st))
+            continue;
+        const bool isFolder = S_ISDIR(st.st_mode);
+        // Mask filters files only
+        if(!isFolder && mask && *mask && 0 != fnmatch(mask, e->d_name, 0))
+            continue;
+        VFSDirEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.label = strdup(e->d_name);
+        entry.title = strdup(e->d_name);
+        entry.path = strdup(path.c_str());
+        entry.folder = isFolder;
+        entry.size = st.st_size;
+        entries.push_back(entry);
+    }
+    closedir(dir);
+    *num_items = (unsigned int)entries.size();
+    *items = new VFSDirEntry[entries.size() + 1];
+    std::copy(entries.begin(), entries.end(), *items);
+    return true;
+}
+
+void CHelper_libXBMC_addon::FreeDirectory(VFSDirEntry* items, unsigned int num_items)
+{
+    for(unsigned int i = 0; i < num_items; ++i) {
+        free(items[i].label);
+        free(items[i].title);
+        free(items[i].path);
+    }
+    delete[] items;
+}
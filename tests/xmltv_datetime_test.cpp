@@ -0,0 +1,181 @@
+/*
+ *
+ *   Copyright (C) 2017 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Equivalence and fuzz test of XMLTV timestamp parser
+// against sscanf/mktime implementation.
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <random>
+#include "XMLTV_datetime.hpp"
+
+using namespace XMLTV;
+
+static int s_failures = 0;
+
+#define CHECK(condition, ...) \
+do { if(!(condition)) { ++s_failures; if(s_failures < 20) { fprintf(stderr, "FAILED %s: ", #condition); fprintf(stderr, __VA_ARGS__); fputc('\n', stderr);} } } while(0)
+
+static void SetTimeZone(const char* tz)
+{
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+static std::string Format(int year, int month, int day, int hour, int minute, int second, const char* zone)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%04d%02d%02d%02d%02d%02d%s", year, month, day, hour, minute, second, zone);
+    return buffer;
+}
+
+static std::string RandomZone(std::mt19937& rng)
+{
+    switch (rng() % 3) {
+        case 0:
+            return std::string();
+        default:
+        {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), " %c%02d%02d", rng() % 2 ? '+' : '-', int(rng() % 15), int(rng() % 4) * 15);
+            return buffer;
+        }
+    }
+}
+
+static void TestKnownValues()
+{
+    struct {const char* str; long utc;} cases[] = {
+        {"19700101000000", 0},
+        {"19700101000000 +0000", 0},
+        {"20200101000000 +0000", 1577836800},
+        {"20200101030000 +0300", 1577836800},
+        {"20191231220000 -0200", 1577836800},
+        {"20240229123000 -0130", 1709215200},
+        {"20381231235959 +0000", 2177452799},
+    };
+    for (const auto& c : cases) {
+        long utc = -1;
+        CHECK(ParseXmltvDateTime(c.str, utc) && utc == c.utc, "%s -> %ld, expected %ld", c.str, utc, c.utc);
+    }
+    const char* malformed[] = {"", "2020", "2020010100000", "20200101000000 ", "20200101000000 +03", "20200101000000 *0300",
+        "20200101000000+0300", "2020010100000a", "20201301000000", "20200100000000", "20200101240000", "20200101006000"};
+    for (auto str : malformed) {
+        long utc;
+        CHECK(!ParseXmltvDateTime(str, utc), "malformed '%s' is accepted", str);
+    }
+}
+
+// In UTC zone the old parser has no DST correction, results should be identical
+static void TestEquivalenceInUtc(std::mt19937& rng)
+{
+    SetTimeZone("UTC0");
+    const long localOffset = LocalTimeOffset();
+    for (int i = 0; i < 1000000; ++i) {
+        // Day 31 of short months and second 60 are normalized as mktime does
+        const std::string str = Format(1970 + rng() % 68, 1 + rng() % 12, 1 + rng() % 31,
+                                       rng() % 24, rng() % 60, rng() % 61, RandomZone(rng).c_str());
+        long fast = 0;
+        CHECK(ParseXmltvDateTime(str, fast), "'%s' is rejected", str.c_str());
+        const long slow = ParseDateTimeWithMktime(str, true, localOffset);
+        CHECK(fast == slow, "'%s': %ld != %ld", str.c_str(), fast, slow);
+    }
+}
+
+// In a zone with DST the result should match mktime() of the same moment
+// written in local time. The old parser applied current offset to all dates
+// and was an hour off on the other side of DST switch.
+static void TestDstZone(std::mt19937& rng)
+{
+    SetTimeZone("CET-1CEST,M3.5.0,M10.5.0/3");
+    for (int i = 0; i < 200000; ++i) {
+        const std::string str = Format(1980 + rng() % 58, 1 + rng() % 12, 1 + rng() % 28,
+                                       rng() % 24, rng() % 60, rng() % 60, RandomZone(rng).c_str());
+        long utc = 0;
+        CHECK(ParseXmltvDateTime(str, utc), "'%s' is rejected", str.c_str());
+        time_t t = utc;
+        struct tm local, before, after;
+        localtime_r(&t, &local);
+        time_t tBefore = t - 3600, tAfter = t + 3600;
+        localtime_r(&tBefore, &before);
+        localtime_r(&tAfter, &after);
+        // Local time is ambiguous near DST switch
+        if(before.tm_isdst != local.tm_isdst || after.tm_isdst != local.tm_isdst)
+            continue;
+        const std::string localStr = Format(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+                                            local.tm_hour, local.tm_min, local.tm_sec, "");
+        const long slow = ParseDateTimeWithMktime(localStr, true, 0);
+        CHECK(utc == slow, "'%s' (local '%s'): %ld != %ld", str.c_str(), localStr.c_str(), utc, slow);
+    }
+}
+
+// Damaged strings should be rejected or parsed the same way as before
+static void TestFuzz(std::mt19937& rng)
+{
+    SetTimeZone("UTC0");
+    const char alphabet[] = "0123456789 +-:.Tz\x7f";
+    for (int i = 0; i < 1000000; ++i) {
+        std::string str = Format(1970 + rng() % 68, 1 + rng() % 12, 1 + rng() % 28,
+                                 rng() % 24, rng() % 60, rng() % 60, RandomZone(rng).c_str());
+        const int mutations = 1 + rng() % 3;
+        for (int m = 0; m < mutations; ++m) {
+            switch (rng() % 4) {
+                case 0:
+                    str[rng() % str.size()] = alphabet[rng() % (sizeof(alphabet) - 1)];
+                    break;
+                case 1:
+                    str.resize(rng() % (str.size() + 1));
+                    break;
+                case 2:
+                    str.push_back(alphabet[rng() % (sizeof(alphabet) - 1)]);
+                    break;
+                default:
+                    str[rng() % str.size()] = char(rng() % 256);
+                    break;
+            }
+            if(str.empty())
+                break;
+        }
+        long fast = 0;
+        if(ParseXmltvDateTime(str, fast)) {
+            const long slow = ParseDateTimeWithMktime(str, true, 0);
+            CHECK(fast == slow, "fuzzed '%s': %ld != %ld", str.c_str(), fast, slow);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::mt19937 rng(argc > 1 ? atoi(argv[1]) : 2017);
+    TestKnownValues();
+    TestEquivalenceInUtc(rng);
+    TestDstZone(rng);
+    TestFuzz(rng);
+    if(s_failures > 0) {
+        fprintf(stderr, "%d checks failed.\n", s_failures);
+        return 1;
+    }
+    printf("All checks passed.\n");
+    return 0;
+}